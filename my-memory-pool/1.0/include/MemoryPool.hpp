@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -9,9 +10,16 @@
 
 namespace MyMemoryPool
 {
-#define MEMORY_POOL_NUM 64 // 内存池数量
-#define SLOT_BASE_SIZE 8   // 槽基础大小
-#define MAX_SLOT_SIZE 512  // 最大槽大小
+#define MEMORY_POOL_NUM 52      // 内存池数量
+#define SLOT_BASE_SIZE 8        // 槽基础大小
+#define LINEAR_SLOT_SIZE 128    // 不超过该大小的槽按SLOT_BASE_SIZE线性增长，之后每翻倍一次分为4档
+#define MAX_SLOT_SIZE 65536     // 最大槽大小
+#define MAGAZINE_SIZE 64        // 每个线程在每个内存池中缓存的空闲槽数量上限
+#define MAGAZINE_BYTES (1 << 18) // 每个弹匣缓存的字节数上限，大槽的弹匣容量相应减小
+#define CHUNK_SLOTS 32          // 每个线程每次从内存块中切下的槽数量
+#define CHUNK_BYTES (1 << 16)   // 每次切下的字节数上限，大槽每次切下的槽数相应减少
+#define MIN_BLOCK_SLOTS 8       // 每个内存块至少容纳的槽数量，决定各个内存池的首个内存块大小
+#define MAX_BLOCK_SIZE (1 << 20) // 内存块几何增长的上限
 
     // 槽结构体
     /*
@@ -23,6 +31,20 @@ namespace MyMemoryPool
         std::atomic<Slot *> next; // 原子指针
     };
 
+    class MemoryPool;
+
+    // 线程本地的空闲槽缓存(弹匣)，每个线程在每个内存池中各有一个
+    // 大部分分配和释放只操作弹匣，不触碰共享的freeList_
+    struct Magazine
+    {
+        Slot *head = nullptr;        // 缓存的空闲槽链表
+        Slot *tail = nullptr;        // 链表尾，整体归还时使用
+        size_t count = 0;            // 缓存的空闲槽数量
+        char *bumpPtr = nullptr;     // 线程私有的未使用区间，从内存块中整段切下，无需加锁即可分配
+        char *bumpEnd = nullptr;
+        MemoryPool *owner = nullptr; // 所属内存池，线程退出时将空闲槽归还给它
+    };
+
     // 具体的内存池实例，每个内存池实例的槽大小不同，用于实际内存分配
     class MemoryPool
     {
@@ -30,32 +52,73 @@ namespace MyMemoryPool
         MemoryPool(size_t BlockSize = 4096);
         ~MemoryPool();
 
-        void init(size_t size);
+        // poolId为HashBucket中的编号，只有在[0, MEMORY_POOL_NUM)内的内存池使用线程本地弹匣
+        void init(size_t size, int poolId = -1);
 
         void *allocate();           // 分配内存
         void deallocate(void *ptr); // 释放内存
+
+        // 将一串空闲槽整体放回共享的空闲链表
+        void pushFreeList(Slot *first, Slot *last);
+        // 线程退出时归还弹匣中的空闲槽和未使用的区间
+        void releaseMagazine(Magazine &mag);
+
     private:
-        void allocateNewBlock();                  // 分配新的内存块
+        // 内存块头部，内存块通过mmap申请，槽紧随头部之后
+        struct Block
+        {
+            Block *next;              // 内存块链表，析构时逐个归还系统
+            size_t size;              // 内存块总字节数
+            std::atomic<size_t> used; // 已被切分出去的字节数(相对内存块起始地址)，可能超过size
+        };
+
+        // 从当前内存块中切下至多bytes字节，区间通过[begin, end)返回，只需一次fetch_add
+        void carveChunk(size_t bytes, char *&begin, char *&end);
+        void allocateNewBlock(Block *expected);   // 当前内存块仍为expected时分配新的内存块
         size_t padPointer(char *p, size_t align); // 对齐内存指针
 
         // 使用 CAS 操作进行无锁入队和出队
         bool pushFreeList(Slot *slot); // 入队
         Slot *popFreeList();           // 出队
+
+        // 当前线程在本内存池中的弹匣，内存池编号超出范围时返回nullptr
+        Magazine *localMagazine();
+
+        // 带版本号的链表头：低48位为地址，高16位为版本号
+        // 每次修改链表头都使版本号加1，即使地址相同(ABA)CAS也会失败
+        static constexpr int TAG_SHIFT = 48;
+        static constexpr uint64_t PTR_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+        static Slot *ptrOf(uint64_t head) { return reinterpret_cast<Slot *>(head & PTR_MASK); }
+        static uint64_t nextHead(uint64_t head, Slot *ptr)
+        {
+            uint64_t tag = (head >> TAG_SHIFT) + 1;
+            return (tag << TAG_SHIFT) | reinterpret_cast<uint64_t>(ptr);
+        }
+
     private:
-        int BlockSize_;                // 内存块大小
+        int BlockSize_;                // 首个内存块大小
         int SlotSize_;                 // 槽大小
-        Slot *firstBlock_;             // 指向内存池管理的首个实际内存块
-        Slot *curSlot_;                // 指向当前未被使用过的槽
-        std::atomic<Slot *> freeList_; // 指向空闲的槽(被使用过后又被释放的槽)
-        Slot *lastSlot_;               // 作为当前内存块中最后能够存放元素的位置标识(超过该位置需申请新的内存块)
-        std::mutex mutexForBlock_;     // 保证多线程情况下避免不必要的重复开辟内存导致的浪费行为
+        int poolId_;                   // 内存池编号，用于定位线程本地弹匣，-1表示不使用弹匣
+        size_t magazineSize_;          // 弹匣容量，不超过MAGAZINE_SIZE和MAGAZINE_BYTES
+        size_t chunkBytes_;            // 每次从内存块中切下的字节数
+        size_t nextBlockSize_;         // 下一个内存块的大小，每次翻倍直到MAX_BLOCK_SIZE
+        std::atomic<Block *> curBlock_; // 当前用于切分的内存块，同时是内存块链表的头
+        std::atomic<uint64_t> freeList_; // 指向空闲的槽(被使用过后又被释放的槽)，带版本号
+        std::mutex mutexForBlock_;     // 只在申请新内存块时使用，避免多个线程同时开辟内存导致的浪费
     };
 
     // 内存池管理类，静态类，用于管理内存池实例
+    /*
+        槽大小的分布：
+        8, 16, 24, ..., 128                  按SLOT_BASE_SIZE线性增长，共16个
+        160, 192, 224, 256, 320, ..., 65536  每翻倍一次分为4档，相邻两档相差不超过25%
+     */
     class HashBucket
     {
     public:
-        static void initMemoryPool();                // 初始化内存池,在使用内存池前调用
+        // 内存池在首次使用时自动初始化(线程安全)，不再需要提前调用
+        // 保留该接口以兼容旧代码，调用它只会提前完成初始化
+        static void initMemoryPool();
         static MemoryPool &getMemoryPool(int index); // 获取内存池实例
 
         // 调用内存池分配内存
@@ -63,18 +126,95 @@ namespace MyMemoryPool
         // 调用内存池释放内存
         static void freeMemory(void *ptr, size_t size);
 
+        // 大小在编译期已知时使用，内存池编号在编译期确定
+        // 内存池中的槽按slotAlign()对齐，Align不超过它；超出MAX_SLOT_SIZE的大小使用operator new，只保证max_align_t的对齐
+        template <size_t Size, size_t Align = alignof(std::max_align_t)>
+        static void *useMemory()
+        {
+            static_assert(Size > 0, "size must be positive");
+            static_assert(Size > MAX_SLOT_SIZE || Align <= slotAlign(classSize(constIndex<Size>())),
+                          "slot is not aligned enough");
+            static_assert(Size <= MAX_SLOT_SIZE || Align <= alignof(std::max_align_t),
+                          "over-aligned types larger than MAX_SLOT_SIZE are not supported");
+            if (Size > MAX_SLOT_SIZE)
+                return operator new(Size);
+            return getMemoryPool(constIndex<Size>()).allocate();
+        }
+        template <size_t Size>
+        static void freeMemory(void *ptr)
+        {
+            if (ptr == nullptr)
+                return;
+            if (Size > MAX_SLOT_SIZE)
+            {
+                operator delete(ptr);
+                return;
+            }
+            getMemoryPool(constIndex<Size>()).deallocate(ptr);
+        }
+
+        // 大小对应的内存池编号，size需在(0, MAX_SLOT_SIZE]内
+        static constexpr int sizeClassIndex(size_t size)
+        {
+            if (size <= LINEAR_SLOT_SIZE)
+            {
+                return static_cast<int>((size + SLOT_BASE_SIZE - 1) / SLOT_BASE_SIZE) - 1;
+            }
+            // 找到满足 2^shift < size <= 2^(shift+1) 的shift，该区间等分为4档
+            int shift = 0;
+            while ((size_t(2) << shift) < size)
+            {
+                ++shift;
+            }
+            size_t step = size_t(1) << (shift - 2);
+            return static_cast<int>(LINEAR_SLOT_SIZE / SLOT_BASE_SIZE) +
+                   (shift - 7) * 4 + static_cast<int>((size - 1 - (size_t(1) << shift)) / step);
+        }
+
+        // 内存池编号对应的槽大小
+        static constexpr size_t classSize(int index)
+        {
+            constexpr int linearNum = LINEAR_SLOT_SIZE / SLOT_BASE_SIZE;
+            if (index < linearNum)
+            {
+                return (index + 1) * SLOT_BASE_SIZE;
+            }
+            int shift = 7 + (index - linearNum) / 4;
+            int rank = (index - linearNum) % 4 + 1;
+            return (size_t(1) << shift) + rank * (size_t(1) << (shift - 2));
+        }
+
+        // 槽的对齐：整除槽大小的最大2的幂，大小为2的幂的槽按自身大小对齐
+        // 大小为alignof(T)倍数的sizeof(T)所在的槽总是alignof(T)的倍数，newElement不需要额外处理对齐
+        static constexpr size_t slotAlign(size_t slotSize)
+        {
+            return slotSize & (~slotSize + 1);
+        }
+
         template <typename T, typename... Args>
         friend T *newElement(Args &&...args); // 内存池分配对象
 
         template <typename T>
         friend void deleteElement(T *ptr); // 内存池释放对象
+
+    private:
+        // 超出范围的大小不会使用内存池，编号取0只是为了让常量表达式合法
+        template <size_t Size>
+        static constexpr int constIndex()
+        {
+            return Size <= MAX_SLOT_SIZE ? sizeClassIndex(Size) : 0;
+        }
     };
 
+    static_assert(LINEAR_SLOT_SIZE == 128, "geometric classes start at 2^7");
+    static_assert(HashBucket::classSize(MEMORY_POOL_NUM - 1) == MAX_SLOT_SIZE, "pool count mismatch");
+    static_assert(HashBucket::sizeClassIndex(MAX_SLOT_SIZE) == MEMORY_POOL_NUM - 1, "pool count mismatch");
+
     template <typename T, typename... Args>
     T *newElement(Args &&...args)
     {
         T *ptr = nullptr;
-        ptr = reinterpret_cast<T *>(HashBucket::useMemory(sizeof(T)));
+        ptr = reinterpret_cast<T *>(HashBucket::useMemory<sizeof(T), alignof(T)>());
         if (ptr != nullptr)
         {
             new (ptr) T(std::forward<Args>(args)...);
@@ -89,7 +229,7 @@ namespace MyMemoryPool
         {
             ptr->~T();
             // 再回收内存
-            HashBucket::freeMemory(reinterpret_cast<void *>(ptr), sizeof(T));
+            HashBucket::freeMemory<sizeof(T)>(reinterpret_cast<void *>(ptr));
         }
     }
 } // namespace MemoryPool
\ No newline at end of file
@@ -1,61 +1,124 @@
 #include "../include/MemoryPool.hpp"
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace MyMemoryPool
 {
+    // 当前线程在各个内存池中的弹匣，线程退出时把缓存的空闲槽归还给所属内存池
+    struct ThreadMagazines
+    {
+        Magazine magazines[MEMORY_POOL_NUM];
+
+        ~ThreadMagazines()
+        {
+            for (Magazine &mag : magazines)
+            {
+                if (mag.owner != nullptr)
+                {
+                    mag.owner->releaseMagazine(mag);
+                }
+            }
+        }
+    };
+
+    static thread_local ThreadMagazines threadMagazines;
+
     MemoryPool::MemoryPool(size_t BlockSize) : BlockSize_(BlockSize),
                                                SlotSize_(0),
-                                               firstBlock_(nullptr),
-                                               curSlot_(nullptr),
-                                               freeList_(nullptr),
-                                               lastSlot_(nullptr)
+                                               poolId_(-1),
+                                               magazineSize_(MAGAZINE_SIZE),
+                                               chunkBytes_(0),
+                                               nextBlockSize_(BlockSize),
+                                               curBlock_(nullptr),
+                                               freeList_(0)
     {
     }
 
     MemoryPool::~MemoryPool()
     {
         // 删除连续的block（内存块）
-        Slot *cur = firstBlock_;
+        Block *cur = curBlock_.load(std::memory_order_relaxed);
         while (cur != nullptr)
         {
-            Slot *nxt = cur->next;
-            // 转化为void指针，不需要调用析构函数
-            operator delete(reinterpret_cast<void *>(cur));
+            Block *nxt = cur->next;
+            munmap(cur, cur->size);
             cur = nxt;
         }
     }
 
-    void MemoryPool::init(size_t SlotSize)
+    void MemoryPool::init(size_t SlotSize, int poolId)
     {
         assert(SlotSize > 0);
+        assert(poolId < MEMORY_POOL_NUM);
         SlotSize_ = SlotSize;
-        firstBlock_ = nullptr;
-        curSlot_ = nullptr;
-        freeList_ = nullptr;
-        lastSlot_ = nullptr;
+        poolId_ = poolId;
+        // 首个内存块至少容纳MIN_BLOCK_SLOTS个槽，大槽不会只用到内存块的一小部分
+        nextBlockSize_ = std::max<size_t>(BlockSize_, SlotSize_ * MIN_BLOCK_SLOTS);
+        magazineSize_ = std::max<size_t>(2, std::min<size_t>(MAGAZINE_SIZE, MAGAZINE_BYTES / SlotSize_));
+        chunkBytes_ = std::max<size_t>(1, std::min<size_t>(CHUNK_SLOTS, CHUNK_BYTES / SlotSize_)) * SlotSize_;
+        curBlock_ = nullptr;
+        freeList_ = 0;
     }
     // 分配内存
     void *MemoryPool::allocate()
     {
-        // 优先使用空闲链表中的内存槽
+        // 优先使用线程本地弹匣中的内存槽，不需要任何同步
+        Magazine *mag = localMagazine();
+        if (mag != nullptr && mag->count > 0)
+        {
+            Slot *slot = mag->head;
+            mag->head = slot->next.load(std::memory_order_relaxed);
+            if (--mag->count == 0)
+            {
+                mag->tail = nullptr;
+            }
+            return slot;
+        }
+
+        // 其次使用空闲链表中的内存槽
         Slot *slot = popFreeList();
         if (slot != nullptr)
         {
+            // 弹匣为空时顺便从空闲链表补充一批，后续的分配不再访问共享链表
+            if (mag != nullptr)
+            {
+                for (size_t i = 0; i < magazineSize_ / 2; ++i)
+                {
+                    Slot *extra = popFreeList();
+                    if (extra == nullptr)
+                    {
+                        break;
+                    }
+                    extra->next.store(mag->head, std::memory_order_relaxed);
+                    if (mag->count++ == 0)
+                    {
+                        mag->tail = extra;
+                    }
+                    mag->head = extra;
+                }
+            }
             return slot;
         }
 
-        Slot *temp;
-        // 用{}限制互斥锁的作用域
+        // 没有被释放过的槽，从未使用过的内存中切分
+        // 使用弹匣的线程一次切下chunkBytes_字节，之后在私有区间内移动指针即可
+        if (mag != nullptr)
         {
-            std::lock_guard<std::mutex> lock(mutexForBlock_);
-            if (curSlot_ >= lastSlot_)
+            if (mag->bumpPtr >= mag->bumpEnd)
             {
-                // 当前内存块已无内存槽可用，开辟一块新的内存
-                allocateNewBlock();
+                carveChunk(chunkBytes_, mag->bumpPtr, mag->bumpEnd);
             }
-            temp = curSlot_;
-            curSlot_ += SlotSize_ / sizeof(Slot);
+            char *temp = mag->bumpPtr;
+            mag->bumpPtr += SlotSize_;
+            return temp;
         }
-        return temp;
+
+        char *begin;
+        char *end;
+        carveChunk(SlotSize_, begin, end);
+        return begin;
     }
 
     // 释放内存
@@ -64,43 +127,155 @@ namespace MyMemoryPool
         if (ptr == nullptr)
             return;
         Slot *slot = reinterpret_cast<Slot *>(ptr);
-        pushFreeList(slot);
+
+        Magazine *mag = localMagazine();
+        if (mag == nullptr)
+        {
+            pushFreeList(slot);
+            return;
+        }
+
+        slot->next.store(mag->head, std::memory_order_relaxed);
+        if (mag->count++ == 0)
+        {
+            mag->tail = slot;
+        }
+        mag->head = slot;
+
+        // 弹匣已满，把较早放入的一半整体归还给空闲链表，只需一次CAS
+        if (mag->count > magazineSize_)
+        {
+            Slot *last = mag->head;
+            for (size_t i = 1; i < magazineSize_ / 2; ++i)
+            {
+                last = last->next.load(std::memory_order_relaxed);
+            }
+            Slot *first = last->next.load(std::memory_order_relaxed);
+            pushFreeList(first, mag->tail);
+            last->next.store(nullptr, std::memory_order_relaxed);
+            mag->tail = last;
+            mag->count = magazineSize_ / 2;
+        }
     }
 
-    void MemoryPool::allocateNewBlock()
+    Magazine *MemoryPool::localMagazine()
     {
-        void *newBlock = operator new(BlockSize_);
-        reinterpret_cast<Slot *>(newBlock)->next = firstBlock_;
-        firstBlock_ = reinterpret_cast<Slot *>(newBlock);
+        if (poolId_ < 0)
+        {
+            return nullptr;
+        }
+        Magazine &mag = threadMagazines.magazines[poolId_];
+        mag.owner = this;
+        return &mag;
+    }
+
+    void MemoryPool::releaseMagazine(Magazine &mag)
+    {
+        // 未使用的区间串成链表，和弹匣中的空闲槽一起归还
+        while (mag.bumpPtr < mag.bumpEnd)
+        {
+            Slot *slot = reinterpret_cast<Slot *>(mag.bumpPtr);
+            slot->next.store(mag.head, std::memory_order_relaxed);
+            if (mag.count++ == 0)
+            {
+                mag.tail = slot;
+            }
+            mag.head = slot;
+            mag.bumpPtr += SlotSize_;
+        }
+        if (mag.count > 0)
+        {
+            pushFreeList(mag.head, mag.tail);
+        }
+        mag = Magazine();
+    }
+
+    void MemoryPool::carveChunk(size_t bytes, char *&begin, char *&end)
+    {
+        while (true)
+        {
+            Block *block = curBlock_.load(std::memory_order_acquire);
+            if (block != nullptr)
+            {
+                // 多个线程并发切分同一内存块，各自得到互不重叠的区间
+                // 内存块用尽后used会继续增长并超过size，不影响正确性
+                size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+                if (offset + SlotSize_ <= block->size)
+                {
+                    size_t available = (block->size - offset) / SlotSize_ * SlotSize_;
+                    begin = reinterpret_cast<char *>(block) + offset;
+                    end = begin + std::min(bytes, available);
+                    return;
+                }
+            }
+            // 当前内存块已无内存槽可用，开辟一块新的内存
+            allocateNewBlock(block);
+        }
+    }
+
+    void MemoryPool::allocateNewBlock(Block *expected)
+    {
+        std::lock_guard<std::mutex> lock(mutexForBlock_);
+        // 其他线程已经换上了新的内存块
+        if (curBlock_.load(std::memory_order_relaxed) != expected)
+        {
+            return;
+        }
+
+        // 内存块至少要放下头部和两个槽，并按页对齐
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t blockSize = std::max(nextBlockSize_, sizeof(Block) + 2 * SlotSize_);
+        blockSize = (blockSize + pageSize - 1) / pageSize * pageSize;
+
+        void *newBlock = mmap(nullptr, blockSize, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (newBlock == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
         // 内存池的实际可用部分
-        char *body = reinterpret_cast<char *>(newBlock) + sizeof(Slot *);
-        size_t paddingSize = padPointer(body, SlotSize_);
-        curSlot_ = reinterpret_cast<Slot *>(body + paddingSize);
-        // 超过该标记位置，则说明该内存块已无内存槽可用，需向系统申请新的内存块
-        lastSlot_ = reinterpret_cast<Slot *>(reinterpret_cast<size_t>(newBlock) + BlockSize_ - SlotSize_ + 1);
-        freeList_ = nullptr;
+        Block *block = reinterpret_cast<Block *>(newBlock);
+        char *body = reinterpret_cast<char *>(newBlock) + sizeof(Block);
+        // 槽按整除槽大小的最大2的幂对齐，大小为2的幂的槽自然对齐，newElement依赖这一点满足alignof(T)
+        size_t paddingSize = padPointer(body, HashBucket::slotAlign(SlotSize_));
+        block->next = expected;
+        block->size = blockSize;
+        block->used.store(sizeof(Block) + paddingSize, std::memory_order_relaxed);
+        // 空闲链表中的槽仍然有效，不能在这里清空
+        curBlock_.store(block, std::memory_order_release);
+
+        // 内存块按几何级数增长，减少向系统申请内存的次数
+        nextBlockSize_ = std::min<size_t>(blockSize * 2, MAX_BLOCK_SIZE);
     }
 
     // 指针对齐
     size_t MemoryPool::padPointer(char *p, size_t align)
     {
-        // align就是该内存池的槽大小
         return (align - reinterpret_cast<size_t>(p)) % align;
     }
 
     // 无锁入队操作
     bool MemoryPool::pushFreeList(Slot *slot)
     {
+        pushFreeList(slot, slot);
+        return true;
+    }
+
+    // 将first到last的一串槽整体入队
+    void MemoryPool::pushFreeList(Slot *first, Slot *last)
+    {
+        uint64_t oldHead = freeList_.load(std::memory_order_relaxed);
         while (true)
         {
-            Slot *oldHead = freeList_.load(std::memory_order_relaxed);
             // 实现线程安全的值写入
-            slot->next.store(oldHead, std::memory_order_relaxed);
-            if (freeList_.compare_exchange_weak(oldHead, slot,
+            last->next.store(ptrOf(oldHead), std::memory_order_relaxed);
+            // 失败时oldHead会被更新为当前值
+            if (freeList_.compare_exchange_weak(oldHead, nextHead(oldHead, first),
                                                 std::memory_order_release,
                                                 std::memory_order_relaxed))
             {
-                return true;
+                return;
             }
         }
     }
@@ -108,50 +283,55 @@ namespace MyMemoryPool
     // 无锁出队操作
     Slot *MemoryPool::popFreeList()
     {
+        // load()函数是原子操作，用于在多线程的情况下获取freeList_的值
+        // 配合pushFreeList()函数中的release形成同步
+        uint64_t oldHead = freeList_.load(std::memory_order_acquire);
         // 用死循环是因为CAS操作可能失败，需要重试
         while (true)
         {
-            // load()函数是原子操作，用于在多线程的情况下获取freeList_的值
-            // 配合pushFreeList()函数中的release形成同步
-            Slot *oldHead = freeList_.load(std::memory_order_acquire);
-            if (oldHead == nullptr)
+            Slot *slot = ptrOf(oldHead);
+            if (slot == nullptr)
             {
                 return nullptr;
             }
-            Slot *newHead = nullptr;
-            try
-            {
-                newHead = oldHead->next.load(std::memory_order_relaxed);
-            }
-            catch (...)
-            {
-                // 返回失败，尝试重新申请内存
-                continue;
-            }
+            // slot可能已被其他线程取走并写入了用户数据，此时读到的next是无效值
+            // 但内存块在内存池析构前不会归还系统，读取本身是安全的
+            // 而链表头的版本号已经改变，下面的CAS一定会失败，无效值不会被写入链表头
+            Slot *newHead = slot->next.load(std::memory_order_relaxed);
 
             // 尝试更新头结点 继续用原子操作
-            if (freeList_.compare_exchange_weak(oldHead, newHead,
+            if (freeList_.compare_exchange_weak(oldHead, nextHead(oldHead, newHead),
                                                 std::memory_order_acquire,
-                                                std::memory_order_relaxed))
+                                                std::memory_order_acquire))
             {
-                return oldHead;
+                return slot;
             }
         }
     }
 
     void HashBucket::initMemoryPool()
     {
-        for (int i = 0; i < MEMORY_POOL_NUM; i++)
-        {
-            getMemoryPool(i).init((i + 1) * SLOT_BASE_SIZE);
-        }
+        getMemoryPool(0);
     }
 
     // 静态函数，获取内存池实例
+    // 局部静态变量的初始化是线程安全的，所有内存池在第一次调用时一并初始化
     MemoryPool &HashBucket::getMemoryPool(int index)
     {
-        static MemoryPool memoryPool[MEMORY_POOL_NUM];
-        return memoryPool[index];
+        struct Pools
+        {
+            MemoryPool memoryPool[MEMORY_POOL_NUM];
+
+            Pools()
+            {
+                for (int i = 0; i < MEMORY_POOL_NUM; i++)
+                {
+                    memoryPool[i].init(classSize(i), i);
+                }
+            }
+        };
+        static Pools pools;
+        return pools.memoryPool[index];
     }
 
     void *HashBucket::useMemory(size_t size)
@@ -161,7 +341,7 @@ namespace MyMemoryPool
         if (size > MAX_SLOT_SIZE)
             return operator new(size);
 
-        return getMemoryPool(((size + 7) / SLOT_BASE_SIZE) - 1).allocate();
+        return getMemoryPool(sizeClassIndex(size)).allocate();
     }
 
     void HashBucket::freeMemory(void *ptr, size_t size)
@@ -174,6 +354,6 @@ namespace MyMemoryPool
             return;
         }
 
-        getMemoryPool(((size + 7) / SLOT_BASE_SIZE) - 1).deallocate(ptr);
+        getMemoryPool(sizeClassIndex(size)).deallocate(ptr);
     }
 } // namespace memoryPool
\ No newline at end of file
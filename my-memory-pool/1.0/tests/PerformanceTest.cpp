@@ -0,0 +1,328 @@
+#include "../include/MemoryPool.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+using namespace MyMemoryPool;
+using namespace std::chrono;
+
+// 计时器类
+class Timer
+{
+    high_resolution_clock::time_point start;
+
+public:
+    Timer() : start(high_resolution_clock::now()) {}
+
+    double elapsed()
+    {
+        auto end = high_resolution_clock::now();
+        return duration_cast<microseconds>(end - start).count() / 1000.0; // 转换为毫秒
+    }
+};
+
+// 测试用例
+struct Obj16
+{
+    char data[16];
+};
+
+struct Obj64
+{
+    char data[64];
+};
+
+struct Obj256
+{
+    char data[256];
+};
+
+// 防止编译器把成对的new/delete优化掉
+static void *volatile sink;
+
+// 性能测试类
+class PerformanceTest
+{
+public:
+    // 1. 线程扩展性测试：每个线程独立地申请并释放，观察线程数从1增加到64时的耗时变化
+    static void testThreadScaling()
+    {
+        constexpr size_t OPS_PER_THREAD = 200000;
+        constexpr size_t BATCH = 64; // 每批同时持有的对象数
+
+        std::cout << "\nTesting thread scaling (" << OPS_PER_THREAD
+                  << " allocations per thread):" << std::endl;
+        std::cout << std::setw(8) << "Threads"
+                  << std::setw(16) << "Memory Pool"
+                  << std::setw(16) << "New/Delete"
+                  << std::setw(12) << "Speedup" << std::endl;
+
+        for (size_t numThreads : {1, 2, 4, 8, 16, 32, 64})
+        {
+            double poolTime = runThreads(numThreads, [&]()
+                                         {
+                std::vector<void *> ptrs(BATCH);
+                for (size_t i = 0; i < OPS_PER_THREAD; i += BATCH)
+                {
+                    for (size_t j = 0; j < BATCH; ++j)
+                    {
+                        ptrs[j] = newElement<Obj64>();
+                    }
+                    for (size_t j = 0; j < BATCH; ++j)
+                    {
+                        deleteElement(static_cast<Obj64 *>(ptrs[j]));
+                    }
+                } });
+
+            double newTime = runThreads(numThreads, [&]()
+                                        {
+                std::vector<void *> ptrs(BATCH);
+                for (size_t i = 0; i < OPS_PER_THREAD; i += BATCH)
+                {
+                    for (size_t j = 0; j < BATCH; ++j)
+                    {
+                        ptrs[j] = new Obj64;
+                    }
+                    for (size_t j = 0; j < BATCH; ++j)
+                    {
+                        delete static_cast<Obj64 *>(ptrs[j]);
+                    }
+                } });
+
+            printRow(numThreads, poolTime, newTime);
+        }
+    }
+
+    // 2. 冷启动测试：内存池中没有任何空闲槽，所有分配都来自未使用过的内存
+    // 每个线程数使用一个之前未用过的槽大小，保证每一行都从空的内存池开始
+    static void testColdStart()
+    {
+        constexpr size_t ALLOCS_PER_THREAD = 50000;
+
+        std::cout << "\nTesting cold-start allocation (" << ALLOCS_PER_THREAD
+                  << " allocations per thread, no frees in between):" << std::endl;
+        std::cout << std::setw(8) << "Threads"
+                  << std::setw(16) << "Memory Pool"
+                  << std::setw(16) << "New/Delete"
+                  << std::setw(12) << "Speedup" << std::endl;
+
+        size_t size = 24;
+        for (size_t numThreads : {1, 2, 4, 8, 16, 32, 64})
+        {
+            std::vector<std::vector<void *>> poolPtrs(numThreads, std::vector<void *>(ALLOCS_PER_THREAD));
+            std::vector<std::vector<void *>> newPtrs(numThreads, std::vector<void *>(ALLOCS_PER_THREAD));
+
+            double poolTime = runIndexed(numThreads, [&](size_t t)
+                                         {
+                for (auto &p : poolPtrs[t])
+                {
+                    p = HashBucket::useMemory(size);
+                } });
+
+            double newTime = runIndexed(numThreads, [&](size_t t)
+                                        {
+                for (auto &p : newPtrs[t])
+                {
+                    p = operator new(size);
+                } });
+
+            printRow(numThreads, poolTime, newTime);
+
+            for (size_t t = 0; t < numThreads; ++t)
+            {
+                for (size_t i = 0; i < ALLOCS_PER_THREAD; ++i)
+                {
+                    HashBucket::freeMemory(poolPtrs[t][i], size);
+                    operator delete(newPtrs[t][i]);
+                }
+            }
+            size += 16;
+        }
+    }
+
+    // 3. 跨线程释放测试：对象由一个线程申请、另一个线程释放，空闲槽需要经过共享的空闲链表
+    static void testCrossThreadFree()
+    {
+        constexpr size_t OPS_PER_THREAD = 100000;
+
+        std::cout << "\nTesting cross-thread free (" << OPS_PER_THREAD
+                  << " objects per thread pair):" << std::endl;
+        std::cout << std::setw(8) << "Threads"
+                  << std::setw(16) << "Memory Pool"
+                  << std::setw(16) << "New/Delete"
+                  << std::setw(12) << "Speedup" << std::endl;
+
+        for (size_t numThreads : {2, 4, 8, 16, 32, 64})
+        {
+            size_t numPairs = numThreads / 2;
+            std::vector<std::vector<Obj16 *>> poolObjs(numPairs, std::vector<Obj16 *>(OPS_PER_THREAD));
+            std::vector<std::vector<Obj16 *>> newObjs(numPairs, std::vector<Obj16 *>(OPS_PER_THREAD));
+
+            // 第一批线程申请，第二批线程释放第一批申请的对象
+            double poolTime = runPhases(numPairs, [&](size_t pair)
+                                        {
+                for (auto &p : poolObjs[pair])
+                {
+                    p = newElement<Obj16>();
+                } },
+                                        [&](size_t pair)
+                                        {
+                for (auto p : poolObjs[pair])
+                {
+                    deleteElement(p);
+                } });
+
+            double newTime = runPhases(numPairs, [&](size_t pair)
+                                       {
+                for (auto &p : newObjs[pair])
+                {
+                    p = new Obj16;
+                } },
+                                       [&](size_t pair)
+                                       {
+                for (auto p : newObjs[pair])
+                {
+                    delete p;
+                } });
+
+            printRow(numThreads, poolTime, newTime);
+        }
+    }
+
+    // 4. 混合大小测试：在多个内存池之间交替申请释放
+    static void testMixedSizes()
+    {
+        constexpr size_t OPS_PER_THREAD = 100000;
+        constexpr size_t NUM_THREADS = 8;
+
+        std::cout << "\nTesting mixed sizes (" << NUM_THREADS << " threads, "
+                  << OPS_PER_THREAD << " rounds per thread):" << std::endl;
+
+        double poolTime = runThreads(NUM_THREADS, [&]()
+                                     {
+            for (size_t i = 0; i < OPS_PER_THREAD; ++i)
+            {
+                Obj16 *a = newElement<Obj16>();
+                Obj64 *b = newElement<Obj64>();
+                Obj256 *c = newElement<Obj256>();
+                sink = a;
+                sink = b;
+                sink = c;
+                deleteElement(b);
+                deleteElement(a);
+                deleteElement(c);
+            } });
+
+        double newTime = runThreads(NUM_THREADS, [&]()
+                                    {
+            for (size_t i = 0; i < OPS_PER_THREAD; ++i)
+            {
+                Obj16 *a = new Obj16;
+                Obj64 *b = new Obj64;
+                Obj256 *c = new Obj256;
+                sink = a;
+                sink = b;
+                sink = c;
+                delete b;
+                delete a;
+                delete c;
+            } });
+
+        std::cout << "Memory Pool: " << std::fixed << std::setprecision(3)
+                  << poolTime << " ms" << std::endl;
+        std::cout << "New/Delete: " << std::fixed << std::setprecision(3)
+                  << newTime << " ms" << std::endl;
+    }
+
+private:
+    // 启动numThreads个线程执行work，返回全部完成的耗时
+    template <typename Work>
+    static double runThreads(size_t numThreads, Work work)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads);
+        Timer t;
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            threads.emplace_back(work);
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        return t.elapsed();
+    }
+
+    // 启动numThreads个线程，第t个线程执行work(t)，返回全部完成的耗时
+    template <typename Work>
+    static double runIndexed(size_t numThreads, Work work)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads);
+        Timer t;
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            threads.emplace_back(work, i);
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        return t.elapsed();
+    }
+
+    // 先并发执行所有分配线程，再并发执行所有释放线程，返回两个阶段的总耗时
+    template <typename Alloc, typename Free>
+    static double runPhases(size_t numPairs, Alloc alloc, Free free)
+    {
+        double total = 0;
+        for (int phase = 0; phase < 2; ++phase)
+        {
+            std::vector<std::thread> threads;
+            threads.reserve(numPairs);
+            Timer t;
+            for (size_t pair = 0; pair < numPairs; ++pair)
+            {
+                if (phase == 0)
+                {
+                    threads.emplace_back(alloc, pair);
+                }
+                else
+                {
+                    threads.emplace_back(free, pair);
+                }
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            total += t.elapsed();
+        }
+        return total;
+    }
+
+    static void printRow(size_t numThreads, double poolTime, double newTime)
+    {
+        std::cout << std::setw(8) << numThreads
+                  << std::setw(13) << std::fixed << std::setprecision(3) << poolTime << " ms"
+                  << std::setw(13) << std::fixed << std::setprecision(3) << newTime << " ms"
+                  << std::setw(11) << std::fixed << std::setprecision(2) << newTime / poolTime << "x"
+                  << std::endl;
+    }
+};
+
+int main()
+{
+    HashBucket::initMemoryPool(); // 使用内存池接口前一定要先调用该函数
+
+    std::cout << "Starting performance tests..." << std::endl;
+
+    PerformanceTest::testColdStart();
+    PerformanceTest::testThreadScaling();
+    PerformanceTest::testCrossThreadFree();
+    PerformanceTest::testMixedSizes();
+
+    return 0;
+}
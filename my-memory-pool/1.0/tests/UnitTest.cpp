@@ -27,6 +27,48 @@ class P4
 	int id_[20];
 };
 
+// 对齐要求超过16字节的类型，最后一个的槽大小不是2的幂
+struct alignas(32) A1
+{
+	char data[40];
+};
+
+struct alignas(64) A2
+{
+	char data[72];
+};
+
+struct alignas(64) A3
+{
+	char data[300];
+};
+
+// 分配n个T，返回没有按alignof(T)对齐的数量
+template <typename T>
+size_t CountMisaligned(size_t n)
+{
+	std::vector<T *> ptrs;
+	size_t misaligned = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		T *p = newElement<T>();
+		misaligned += reinterpret_cast<uintptr_t>(p) % alignof(T) != 0;
+		ptrs.push_back(p);
+	}
+	for (T *p : ptrs)
+	{
+		deleteElement<T>(p);
+	}
+	return misaligned;
+}
+
+bool TestOverAligned()
+{
+	size_t misaligned = CountMisaligned<A1>(1000) + CountMisaligned<A2>(1000) + CountMisaligned<A3>(1000);
+	printf("过度对齐类型：%lu个对象未对齐\n", misaligned);
+	return misaligned == 0;
+}
+
 // 单轮次申请释放次数 线程数 轮次
 void BenchmarkMemoryPool(size_t ntimes, size_t nworks, size_t rounds)
 {
@@ -104,5 +146,5 @@ int main()
 	std::cout << "===========================================================================" << std::endl;
 	BenchmarkNew(100, 1, 10); // 测试 new delete
 
-	return 0;
+	return TestOverAligned() ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include "Common.hpp"
+#include <new>
+#include <utility>
+
+namespace MyMemoryPool
+{
+    // 单调分配区域：从PageCache获取span，在span内移动指针分配，不支持单独释放
+    // 适用于一批同时失效的对象（例如一次请求中创建的对象），最后由reset()一次性归还全部span
+    // 分配出的对象不会被析构，只能存放无需析构或由调用者负责析构的对象
+    // 同一个Arena不能被多个线程同时使用，所属的堆必须在Arena之后销毁
+    class Arena
+    {
+        // 每个span起始处的头部，所有span通过prev串成链表，最新的在链表头
+        struct Chunk
+        {
+            Chunk *prev;
+            size_t numPages;
+        };
+
+    public:
+        // 检查点：记录某一时刻的分配位置，rewind()后其后分配的内存全部失效
+        struct Checkpoint
+        {
+            Chunk *chunk;
+            char *ptr;
+        };
+
+        // 作用域：构造时记录检查点，析构时回退，可以嵌套
+        class Scope
+        {
+        public:
+            explicit Scope(Arena &arena) : arena_(arena), checkpoint_(arena.checkpoint()) {}
+            ~Scope() { arena_.rewind(checkpoint_); }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            Arena &arena_;
+            Checkpoint checkpoint_;
+        };
+
+        // 从默认堆获取span
+        Arena();
+        // 从指定的堆获取span
+        explicit Arena(Heap &heap) : heap_(&heap) {}
+        ~Arena() { reset(); }
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        // 分配size字节，align必须是2的幂
+        void *allocate(size_t size, size_t align = ALIGNMENT)
+        {
+            assert((align & (align - 1)) == 0);
+            uintptr_t cur = reinterpret_cast<uintptr_t>(ptr_);
+            uintptr_t aligned = (cur + align - 1) & ~(uintptr_t(align) - 1);
+            if (ptr_ != nullptr && aligned + size <= reinterpret_cast<uintptr_t>(end_))
+            {
+                ptr_ = reinterpret_cast<char *>(aligned + size);
+                return reinterpret_cast<void *>(aligned);
+            }
+            return allocateSlow(size, align);
+        }
+
+        // 在Arena中构造对象
+        template <typename T, typename... Args>
+        T *create(Args &&...args)
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        Checkpoint checkpoint() const { return {current_, ptr_}; }
+        // 回退到检查点，检查点之后获取的span归还，检查点必须来自本Arena且未被更早的回退作废
+        void rewind(const Checkpoint &checkpoint);
+
+        // 归还所有span，复杂度与span数量成正比
+        void reset() { rewind({nullptr, nullptr}); }
+
+        // 当前持有的span占用的字节数
+        size_t bytesReserved() const { return bytesReserved_; }
+
+    private:
+        // 当前span空间不足时获取新的span
+        void *allocateSlow(size_t size, size_t align);
+
+        // 获取/归还span，默认堆中SPAN_PAGES页的span优先使用线程本地缓存
+        void *acquireSpan(size_t numPages);
+        void releaseSpan(void *span, size_t numPages);
+
+    private:
+        Heap *heap_;               // span的来源
+        Chunk *current_ = nullptr; // 当前用于分配的span
+        char *ptr_ = nullptr;      // 当前span中下一次分配的位置
+        char *end_ = nullptr;      // 当前span的结束位置
+        size_t bytesReserved_ = 0;
+    };
+} // namespace MyMemoryPool
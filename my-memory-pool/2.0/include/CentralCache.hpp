@@ -1,45 +1,131 @@
 #pragma once
 #include "Common.hpp"
+#include <vector>
 
 namespace MyMemoryPool
 {
+    struct Span;
+    class PageCache;
+
+    // 中心缓存中一个大小类的全部状态，独占一个缓存行
+    // 不同大小类的锁和链表头不再共用缓存行，相邻大小类被不同线程频繁访问时不会互相使对方的缓存行失效
+    struct alignas(64) CentralFreeList
+    {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        uint16_t refillSpans = 1; // 后台补充时保持的span数，请求线程仍需向PageCache申请时加倍
+        uint32_t numSpans = 0;    // spans链表的长度
+        Span *spans = nullptr; // 仍有空闲块（回收的块或未切分的内存）的span链表
+        size_t freeBlocks = 0; // spans中可以立即分出的内存块总数
+
+        // 统计，持有lock时更新
+        uint64_t fetches = 0;   // fetchRange的次数
+        uint64_t misses = 0;    // 已有span中没有空闲块、需要向PageCache申请的次数
+        uint64_t contended = 0; // 获取lock时需要等待的次数
+        uint64_t refills = 0;   // 后台线程补充span的次数
+        uint32_t inUse = 0;     // 已交给ThreadCache（包括其中缓存着的）的内存块数
+        uint32_t peakInUse = 0; // inUse的历史最大值，作为预热配置的依据
+    };
+    static_assert(sizeof(CentralFreeList) == 64, "CentralFreeList must fill exactly one cache line");
+
     class CentralCache
     {
     public:
-        // 懒惰初始化 单例模式 只有在被调用时才会初始化
-        static CentralCache &getInstance()
+        // 一个大小类的统计信息
+        struct ClassStats
         {
-            static CentralCache instance;
-            return instance;
-        }
+            uint64_t fetches;
+            uint64_t misses;
+            uint64_t contended;
+            uint64_t refills;
+            size_t numSpans;
+            size_t freeBlocks;
+            size_t inUse;
+            size_t peakInUse;
+        };
+
+        // 默认堆中node节点的中心缓存
+        // 每个堆的每个NUMA节点一个中心缓存，从同一堆中本节点的PageCache获取span
+        static CentralCache &getInstance(size_t node = 0);
 
-        // 从中心缓存获取内存 batchNum是批量获取的数量
-        void *fetchRange(size_t index, size_t batchNum);
+        // 从中心缓存获取内存 batchNum是期望获取的数量
+        // 获取到的内存块以链表形式通过start返回，返回值为实际获取的数量
+        size_t fetchRange(void *&start, size_t index, size_t batchNum);
         // 归还内存到中心缓存
         void returnRange(void *start, size_t blockNum, size_t index);
 
+        // 将为避免反复申请而保留的空span全部归还给PageCache
+        void releaseEmptySpans();
+
+        // 大小类的统计信息，从未使用过的大小类全部为0
+        ClassStats classStats(size_t index) const;
+
+        // 后台补充：所属的堆开启补充线程后，fetchRange取走内存块使大小类的空闲块少于低水位时标记该大小类，
+        // 补充线程定期调用refillMarked()，为被标记的大小类提前向PageCache申请span并预先触碰其中的页面
+        // 请求线程只设置标记位，不进行任何系统调用；返回补充的span数
+        size_t refillMarked();
+
+        // 预先为大小类准备至少count个可以立即分出的内存块，span的页面全部预先触碰
+        // 准备好的span在releaseMemory()之前一直保留；返回是否全部准备成功
+        bool reserve(size_t index, size_t count);
+
+        // fork前依次获取大小类的创建锁和所有已创建大小类的锁，fork后释放
+        void lockForFork();
+        void unlockAfterFork();
+
     private:
-        CentralCache()
+        friend class NodeInstances<CentralCache>;
+        CentralCache(Heap *heap, size_t node);
+        // 所属的堆销毁时调用，归还存放大小类状态的内存
+        ~CentralCache();
+
+        // 大小类的状态，首次使用时创建
+        CentralFreeList &freeList(size_t index)
         {
-            // 将所有原子指针初始化为nullptr
-            for (auto &ptr : centralFreeList_)
-            {
-                ptr.store(nullptr, std::memory_order_relaxed);
-            }
-            // 初始化所有锁
-            for (auto &lock : locks_)
-            {
-                lock.clear();
-            }
+            CentralFreeList *list = freeLists_[index].load(std::memory_order_acquire);
+            return list != nullptr ? *list : createFreeList(index);
         }
-        // 从页缓存获取内存
-        void *fetchFromPageCache(size_t size);
+        CentralFreeList &createFreeList(size_t index);
+
+        // 从已有的span中取出最多batchNum个内存块，调用者需持有list.lock
+        size_t takeBlocks(CentralFreeList &list, void *&start, size_t size, size_t batchNum);
+
+        // 从页缓存获取一个新的span，并初始化切分信息，不持有任何锁
+        Span *fetchFromPageCache(size_t size);
+
+        // 将内存块放回所属span，span全部空闲时归还给PageCache
+        void releaseBlock(CentralFreeList &list, Span *span, void *block);
+        // 将全部空闲的span交还给PageCache，调用者需持有list.lock
+        void releaseSpan(CentralFreeList &list, Span *span);
+
+        // 大小类的span页数与低水位：空闲块少于refillSpans个span的一半时需要补充
+        static size_t spanPages(size_t size);
+        static size_t refillLowWater(const CentralFreeList &list, size_t size);
+        static constexpr uint16_t MAX_REFILL_SPANS = 16;
+        // 补充线程为一个大小类申请span直到空闲块达到低水位的两倍，返回申请的span数
+        size_t refill(size_t index);
+        // 向页缓存申请span并触碰其全部页面，不持有任何锁
+        Span *fetchPrefaulted(size_t size);
+
+        // 将span挂入/摘出有空闲块的span链表
+        static void insertSpan(CentralFreeList &list, Span *span);
+        static void eraseSpan(CentralFreeList &list, Span *span);
 
     private:
-        // 中心缓存的自由链表
-        std::array<std::atomic<void *>, FREE_LIST_SIZE> centralFreeList_;
+        Heap *heap_;           // 所属的堆
+        size_t node_;          // 所属的NUMA节点
+        PageCache *pageCache_; // 同一堆中本节点的PageCache
+
+        // 每个大小类的状态，span自己维护回收块的自由链表和未使用内存的bump指针，内存块在分配时才按需串联
+        // 用到的大小类才分配状态，32768个大小类全部按缓存行展开需要2MB
+        std::array<std::atomic<CentralFreeList *>, FREE_LIST_SIZE> freeLists_;
+        // 需要后台补充的大小类，每位对应一个大小类
+        std::array<std::atomic<uint64_t>, FREE_LIST_SIZE / 64> refillWanted_;
 
-        // 用于同步的自旋锁
-        std::array<std::atomic_flag, FREE_LIST_SIZE> locks_;
+        // 大小类状态按页成批创建，新页由createMutex_保护
+        static constexpr size_t LISTS_PER_SLAB = 4096 / sizeof(CentralFreeList);
+        std::mutex createMutex_;
+        CentralFreeList *slab_ = nullptr; // 当前用于创建的页
+        size_t slabUsed_ = 0;             // 当前页已使用的个数
+        std::vector<CentralFreeList *> slabs_;
     };
-} // namespace MyMemoryPool
\ No newline at end of file
+} // namespace MyMemoryPool
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <atomic>
 #include <array>
 #include <cstdlib>
@@ -11,6 +12,7 @@
 #include <cstring>
 #include <cassert>
 #include <iostream>
+#include <new>
 
 namespace MyMemoryPool
 {
@@ -19,6 +21,50 @@ namespace MyMemoryPool
     constexpr size_t MAX_BYTES = 256 * 1024;                 // 256KB
     constexpr size_t FREE_LIST_SIZE = MAX_BYTES / ALIGNMENT; // 对齐数等于指针void*的大小
     constexpr size_t THREAD_MAX_SIZE = 64;                   // 线程本地自由链表大小上限
+    constexpr size_t SPAN_PAGES = 8;                         // CentralCache每次从PageCache获取的span页数
+    constexpr size_t MAX_NUMA_NODES = 8;                     // 支持的NUMA节点数上限，超出的节点归并到已有分区
+
+    // 加固模式：编译时定义MEMORY_POOL_HARDENED开启
+    // 关闭时所有检查都在编译期被消除，发布版本的快速路径没有任何额外开销
+#ifdef MEMORY_POOL_HARDENED
+    constexpr bool HARDENED = true;
+#else
+    constexpr bool HARDENED = false;
+#endif
+
+    // 标记模式：编译时定义MEMORY_POOL_TAGGING开启，按MemoryTag统计内存使用，见MemoryTags
+    // 关闭时内存块不预留标签空间，分配和释放路径与未标记时完全相同
+#ifdef MEMORY_POOL_TAGGING
+    constexpr bool TAGGED = true;
+#else
+    constexpr bool TAGGED = false;
+#endif
+
+    // 进程级随机密钥，加固模式下用于编码空闲链表中的next指针
+    uintptr_t freeListSecret();
+
+    // 读取空闲内存块中保存的下一块地址
+    inline void *nextBlock(void *block)
+    {
+        uintptr_t value = *reinterpret_cast<uintptr_t *>(block);
+        if constexpr (HARDENED)
+        {
+            value ^= freeListSecret();
+        }
+        return reinterpret_cast<void *>(value);
+    }
+
+    // 在空闲内存块中保存下一块地址
+    // 加固模式下与密钥异或后存储，释放后写入或越界写入会破坏指针，在取出时被检查出来
+    inline void setNextBlock(void *block, void *next)
+    {
+        uintptr_t value = reinterpret_cast<uintptr_t>(next);
+        if constexpr (HARDENED)
+        {
+            value ^= freeListSecret();
+        }
+        *reinterpret_cast<uintptr_t *>(block) = value;
+    }
 
     // 大小类管理
     class SizeClass
@@ -68,4 +114,71 @@ namespace MyMemoryPool
         SpinLockGuard(const SpinLockGuard &) = delete;
         SpinLockGuard &operator=(const SpinLockGuard &) = delete;
     };
+
+    class Heap;
+
+    // 按NUMA节点划分的懒惰初始化实例，每个节点一个实例，只有被访问的节点才会创建
+    // T需要提供以所属堆和节点编号为参数的构造函数，实例随NodeInstances一起销毁
+    // 实例放在匿名映射中，T可以依赖存储已清零，不必在构造函数中逐项清零大数组
+    template <typename T>
+    class NodeInstances
+    {
+    public:
+        explicit NodeInstances(Heap *heap) : heap_(heap) {}
+
+        ~NodeInstances()
+        {
+            for (auto &atomicInstance : instances_)
+            {
+                T *instance = atomicInstance.load(std::memory_order_relaxed);
+                if (instance != nullptr)
+                {
+                    instance->~T();
+                    munmap(instance, sizeof(T));
+                }
+            }
+        }
+
+        NodeInstances(const NodeInstances &) = delete;
+        NodeInstances &operator=(const NodeInstances &) = delete;
+
+        T &get(size_t node)
+        {
+            assert(node < MAX_NUMA_NODES);
+            T *instance = instances_[node].load(std::memory_order_acquire);
+            if (instance == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                instance = instances_[node].load(std::memory_order_relaxed);
+                if (instance == nullptr)
+                {
+                    void *memory = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (memory == MAP_FAILED)
+                    {
+                        throw std::bad_alloc();
+                    }
+                    instance = new (memory) T(heap_, node);
+                    instances_[node].store(instance, std::memory_order_release);
+                }
+            }
+            return *instance;
+        }
+
+        // fork前后锁住/释放创建实例用的锁
+        void lockForFork() { mutex_.lock(); }
+        void unlockAfterFork() { mutex_.unlock(); }
+
+        // 已创建的实例，未创建时返回nullptr，不会创建新实例
+        T *find(size_t node) const
+        {
+            assert(node < MAX_NUMA_NODES);
+            return instances_[node].load(std::memory_order_acquire);
+        }
+
+    private:
+        Heap *heap_;
+        std::array<std::atomic<T *>, MAX_NUMA_NODES> instances_{};
+        std::mutex mutex_;
+    };
 } // namespace MyMemoryPool
@@ -0,0 +1,51 @@
+#pragma once
+#include "Common.hpp"
+
+namespace MyMemoryPool
+{
+    // 基于纪元的延迟回收，供建立在内存池之上的无锁数据结构使用
+    // 读者在EpochGuard的作用域内访问共享节点；节点摘除后调用retire()而不是deallocate()，
+    // 它先进入当前线程的待回收列表，等所有线程都离开了摘除时所在的纪元后，才成批释放到本线程的ThreadCache
+    // 与风险指针相比，读者每次进入临界区只需一次存储和一次内存屏障，不需要逐个发布指针
+    // 只作用于默认堆：retire的内存块必须来自MemoryPool::allocate
+    class Epoch
+    {
+    public:
+        // 进入/离开读侧临界区，可以嵌套，通常通过EpochGuard使用
+        static void enter();
+        static void exit();
+
+        // 延迟释放ptr，size与分配时相同；可以在临界区内外调用
+        static void retire(void *ptr, size_t size);
+
+        // 所有处于临界区的线程都已观察到当前纪元时推进全局纪元，并释放本线程中已经安全的内存块
+        // retire()每累积RECLAIM_THRESHOLD个内存块自动调用一次；返回是否推进了纪元
+        static bool tryReclaim();
+        // 反复推进直到本线程retire的内存块全部释放，其他线程长期停留在临界区时会一直等待
+        // 不能在临界区内调用
+        static void drain();
+
+        // 全局纪元与本线程等待释放的内存块数
+        static uint64_t current();
+        static size_t pending();
+
+        // fork前后锁住/释放退出线程遗留列表的锁
+        static void lockForFork();
+        static void unlockAfterFork();
+        // fork后在子进程中调用：其他线程已不存在，它们不再阻止纪元推进，遗留的内存块交给之后的回收
+        static void reclaimAfterFork();
+
+        static constexpr size_t RECLAIM_THRESHOLD = 128;
+    };
+
+    // 读侧临界区，作用域内读到的共享节点不会被释放
+    class EpochGuard
+    {
+    public:
+        EpochGuard() { Epoch::enter(); }
+        ~EpochGuard() { Epoch::exit(); }
+
+        EpochGuard(const EpochGuard &) = delete;
+        EpochGuard &operator=(const EpochGuard &) = delete;
+    };
+} // namespace MyMemoryPool
@@ -0,0 +1,57 @@
+#pragma once
+#include "Common.hpp"
+
+namespace MyMemoryPool
+{
+    struct Span;
+
+    // 加固模式下的误用检测
+    // 包括空闲链表指针校验、金丝雀越界检测、基于状态位的重复释放检测，以及大对象的保护页和隔离区
+    // 只在HARDENED为true时被调用，检测到错误时输出信息并终止进程
+    class Hardening
+    {
+    public:
+        static constexpr size_t CANARY_SIZE = sizeof(uint64_t); // 用户数据之后的金丝雀字节数
+
+        // 小对象分配后：标记内存块为使用中，并在用户数据之后写入金丝雀
+        static void onAllocate(void *ptr, size_t size, size_t blockSize);
+        // 小对象释放前：检查非法释放、重复释放和越界写入，并标记为空闲
+        // 不带大小的释放不知道金丝雀的位置，checkCanary为false时跳过越界检查
+        static void onDeallocate(void *ptr, size_t size, size_t blockSize, bool checkCanary = true);
+        // 检查空闲链表中的下一块地址是否属于对应大小类，nullptr视为合法
+        static void checkFreeBlock(void *block, size_t blockSize);
+
+        // span被切分时初始化状态位，归还给PageCache前清空
+        static void attachBlockBits(Span *span, size_t totalBlocks);
+        static void detachBlockBits(Span *span);
+
+        // 大对象使用独立映射，末尾紧跟不可访问的保护页，越界访问会立即触发SIGSEGV
+        // 对象之前记录分配时的大小，释放时可以不提供大小
+        static void *allocateLarge(size_t size);
+        static void deallocateLarge(void *ptr, size_t size);
+        static void deallocateLarge(void *ptr);
+
+        // 已释放的大对象设为不可访问并保留在隔离区中，释放后访问会触发SIGSEGV
+        // bytes为隔离区的总字节数上限，超出时最早释放的对象归还系统，0表示不启用（默认）
+        static void setQuarantineLimit(size_t bytes);
+
+        // fork前后锁住/释放隔离区的锁
+        static void lockForFork();
+        static void unlockAfterFork();
+
+        // 输出错误信息并终止进程
+        [[noreturn]] static void reportError(const char *message, const void *ptr);
+
+    private:
+        // 大对象占用的页数，不含保护页
+        static size_t largeObjectPages(size_t size);
+        // 归还或隔离大对象的映射，调用者需持有隔离区的锁
+        static void releaseLarge(void *ptr, size_t size);
+
+        // 内存块对应的金丝雀值，与地址相关，无法从一个块的金丝雀推出另一个
+        static uint64_t canaryFor(const void *ptr)
+        {
+            return ~(freeListSecret() ^ reinterpret_cast<uintptr_t>(ptr));
+        }
+    };
+} // namespace MyMemoryPool
@@ -0,0 +1,215 @@
+#pragma once
+#include "CentralCache.hpp"
+#include "PageCache.hpp"
+#include "PageSource.hpp"
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace MyMemoryPool
+{
+    class ThreadCache;
+
+    // 预热配置：每个大小类需要预先准备的内存块数
+    // 通常由上一次运行结束前的Heap::captureProfile()得到，保存到文件，下次启动时加载后交给Heap::warmup()
+    struct WarmupProfile
+    {
+        struct Entry
+        {
+            size_t blockSize; // 大小类的内存块大小（加固模式下包含金丝雀）
+            size_t count;
+        };
+        std::vector<Entry> entries;
+
+        // 文本格式，每行一个大小类："块大小 数量"
+        bool save(const std::string &path) const;
+        // 文件不存在或格式错误时返回空的配置
+        static WarmupProfile load(const std::string &path);
+    };
+
+    // 堆遍历时报告的内存块状态
+    enum class BlockState
+    {
+        Live,   // 已分配给用户
+        Cached, // 空闲，位于某个线程的ThreadCache中
+        Free,   // 空闲，位于CentralCache的span中或PageCache中
+    };
+
+    // 堆的使用情况汇总，由Heap::summarize()得到
+    struct HeapSummary
+    {
+        struct SizeClassUsage
+        {
+            size_t blockSize; // 加固模式下包含金丝雀
+            size_t liveBlocks;
+            size_t cachedBlocks;
+            size_t freeBlocks; // 包括span中尚未切分的部分
+        };
+        std::vector<SizeClassUsage> classes; // 只包含拥有span的大小类，按块大小排序
+        size_t largeBlocks = 0;              // 整页分配的大对象（包括Arena的span）
+        size_t largeBytes = 0;
+        size_t spans = 0;     // 所有span，包括PageCache中的空闲span
+        size_t freeBytes = 0; // PageCache中空闲span的字节数
+
+        size_t liveBlocks() const;
+        size_t liveBytes() const;
+    };
+
+    // 对象的预期寿命，见MemoryPool::allocate(size, Lifetime)
+    enum class Lifetime
+    {
+        Short, // 请求期间的临时对象，使用默认堆
+        Long,  // 缓存条目等长期存活的对象，使用Heap::longLivedHeap()
+    };
+
+    // 独立的堆：拥有自己的PageCache、CentralCache和每个线程的ThreadCache
+    // 不同堆之间不共享任何空闲内存，一个堆的碎片不会影响其他堆，销毁时一次性归还全部内存
+    // MemoryPool的静态接口使用默认堆
+    class Heap
+    {
+    public:
+        // 内存不足时调用的处理函数，bytes为正在申请的字节数
+        // 可以释放调用者自己持有的缓存后返回true让内存池重试，返回false使本次申请失败，也可以抛出std::bad_alloc
+        // 调用时内存池不持有任何锁，但处理函数中不能再从本堆分配内存
+        using OomHandler = bool (*)(Heap &heap, size_t bytes);
+
+        // 创建新的堆，使用完毕后调用destroy()
+        // PageCache从source获取内存块，source必须比堆存活得更久
+        static Heap *create(PageSource &source = systemPageSource());
+
+        // 默认堆，永不销毁
+        static Heap &defaultHeap();
+        // 长寿命对象使用的堆，永不销毁
+        // 长期存活的对象集中在它自己的span中，不会把默认堆中的span钉住：
+        // 只装短寿命对象的span随请求结束整体变空，交还PageCache后合并，由releaseMemory()归还系统
+        static Heap &longLivedHeap();
+
+        void *allocate(size_t size);
+        // 不带大小的释放，大小由ptr所在的span确定
+        void deallocate(void *ptr);
+        // 带大小的释放，size必须与分配时相同，省去查询span的开销
+        void deallocate(void *ptr, size_t size);
+        // 调整大小，oldSize必须与分配时相同，见ThreadCache::reallocate()
+        void *reallocate(void *ptr, size_t oldSize, size_t newSize);
+
+        // 销毁堆并归还它拥有的全部内存，之前分配的内存全部失效
+        // 调用时其他线程不能正在使用该堆，各线程中该堆的ThreadCache在下次访问或线程退出时回收
+        // 加固模式下的大对象是独立的映射，不属于任何堆，需要在销毁前单独释放
+        void destroy();
+
+        // 本堆向系统映射的字节数上限，0表示不限制
+        // 超过软上限时先释放各级缓存中的空闲内存再继续映射；超过硬上限时不再映射，释放缓存后仍不足则调用OOM处理函数
+        // 以向系统申请的内存块（通常4MB）为单位计算
+        void setMemoryLimits(size_t softLimit, size_t hardLimit);
+        void setOomHandler(OomHandler handler);
+
+        // 本堆当前向系统映射的字节数
+        size_t mappedBytes() const { return mappedBytes_.load(std::memory_order_relaxed); }
+
+        // 尽可能把空闲内存还给系统：
+        // 通知各线程在下次进入慢速路径时清空ThreadCache，CentralCache交还保留的空span，
+        // PageCache归还整块空闲的内存块，其余空闲span的物理页通过madvise交还
+        void releaseMemory();
+
+        // releaseMemory()的调用次数，ThreadCache据此发现需要清空
+        uint64_t releaseEpoch() const { return releaseEpoch_.load(std::memory_order_relaxed); }
+
+        // 启动预热：在当前线程所在节点的CentralCache中为size大小的对象准备count个内存块，
+        // 提前完成映射内存、缺页和span的申请，第一批请求不再为此付出延迟
+        // fillThreadCache为true时同时填充当前线程的缓存；超过MAX_BYTES的大小不预热，返回false
+        bool reserve(size_t size, size_t count, bool fillThreadCache = false);
+        // 按配置预热每个大小类，返回是否全部成功
+        bool warmup(const WarmupProfile &profile, bool fillThreadCache = false);
+        // 各大小类在所有节点上同时使用的内存块数的历史最大值之和
+        WarmupProfile captureProfile() const;
+
+        // 后台补充线程：每隔interval检查CentralCache中被标记为即将耗尽的大小类，提前为其申请span并触碰页面
+        // 请求线程的慢速路径因此几乎总能在CentralCache中拿到内存块，不再映射内存或触发缺页
+        // 代价是被频繁使用的大小类保留更多空闲span（请求线程仍然缺块时加倍，最多16个）；重复启动时只更新间隔
+        // 与stopRefillWorker()不能并发调用；fork后子进程中不存在补充线程，需要时重新启动
+        void startRefillWorker(std::chrono::microseconds interval = std::chrono::milliseconds(1));
+        void stopRefillWorker();
+        bool backgroundRefill() const { return refillWorker_.load(std::memory_order_relaxed) != nullptr; }
+
+        // 堆遍历：访问PageCache中的每个span和小对象span中的每个内存块，visitor(void *ptr, size_t size, BlockState state)
+        // 小对象逐块报告，整页分配的大对象报告为一个Live块，PageCache中的空闲span报告为一个Free块，同一系统内存块中按地址顺序
+        // stop-the-world：调用时其他线程不能正在使用本堆；遍历期间持有本堆的全部锁，visitor中不能再从本堆分配或释放
+        // 加固模式下的大对象是独立的映射，不属于任何堆，不会被遍历
+        template <typename Visitor>
+        void walk(Visitor &&visitor)
+        {
+            walkBlocks(&invokeVisitor<std::remove_reference_t<Visitor>>, &visitor);
+        }
+        // 与walk()的要求相同，但只访问span，不逐块检查，代价与span数和缓存的块数成正比
+        HeapSummary summarize();
+        // 把summarize()中仍被使用的内存块按大小类输出，没有时只输出一行
+        void reportLeaks(std::ostream &out);
+
+        PageSource &pageSource() const { return *pageSource_; }
+        PageCache &pageCache(size_t node) { return pageCaches_.get(node); }
+        CentralCache &centralCache(size_t node) { return centralCaches_.get(node); }
+
+    private:
+        explicit Heap(PageSource &source);
+        ~Heap() = default;
+        Heap(const Heap &) = delete;
+        Heap &operator=(const Heap &) = delete;
+
+        // 当前线程在本堆中的ThreadCache，首次访问时创建
+        ThreadCache *threadCache();
+        ThreadCache *createThreadCache();
+
+        // 映射前登记字节数，超过硬上限时返回false；超过软上限时释放缓存
+        bool reserveMappedBytes(size_t bytes);
+        void unreserveMappedBytes(size_t bytes);
+        // 映射失败后调用，返回true表示可以重试，attempt为本次申请已经失败的次数
+        bool handleOutOfMemory(size_t bytes, size_t attempt);
+
+        // pthread_atfork的处理函数，默认堆创建时注册
+        // fork前按固定顺序获取所有锁，保证子进程中没有被已消失的线程持有的锁：
+        // 堆注册表 -> 各堆的实例创建锁 -> CentralCache各大小类的锁 -> PageCache各分段的锁 -> PageMap -> 隔离区 -> ThreadCache链表 -> 纪元遗留列表
+        static void prepareFork();
+        static void parentAfterFork();
+        static void childAfterFork();
+        // 获取/释放本堆的所有锁
+        void lockForFork();
+        void unlockAfterFork();
+
+        struct RefillWorker;
+        void runRefillWorker(RefillWorker &worker);
+
+        // walk()的非模板部分，callback(context, ptr, size, state)
+        using BlockCallback = void (*)(void *context, void *ptr, size_t size, BlockState state);
+        void walkBlocks(BlockCallback callback, void *context);
+        template <typename Visitor>
+        static void invokeVisitor(void *context, void *ptr, size_t size, BlockState state)
+        {
+            (*static_cast<Visitor *>(context))(ptr, size, state);
+        }
+        // 在stop-the-world下按地址顺序访问所有span，visitor(span, free, cachedBegin, cachedEnd)
+        // [cachedBegin, cachedEnd)是位于该span中、被ThreadCache缓存的内存块，已排序
+        template <typename Visitor>
+        void visitSpans(Visitor &&visitor);
+
+    private:
+        friend struct HeapThreadCaches;
+        friend class PageCache;
+
+        size_t id_;           // 堆编号，销毁后可被新的堆复用，用于索引线程本地的ThreadCache
+        uint64_t generation_; // 全局唯一，区分复用同一编号的新旧堆
+        PageSource *pageSource_;
+
+        std::atomic<size_t> mappedBytes_{0};
+        std::atomic<size_t> softLimit_{0};
+        std::atomic<size_t> hardLimit_{0};
+        std::atomic<OomHandler> oomHandler_{nullptr};
+        std::atomic<uint64_t> releaseEpoch_{0};
+        std::atomic<RefillWorker *> refillWorker_{nullptr};
+
+        // PageCache必须在CentralCache之前构造、之后析构
+        NodeInstances<PageCache> pageCaches_{this};
+        NodeInstances<CentralCache> centralCaches_{this};
+    };
+} // namespace MyMemoryPool
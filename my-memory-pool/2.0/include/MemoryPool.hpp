@@ -1,5 +1,10 @@
 #pragma once
+#include "Epoch.hpp"
+#include "Heap.hpp"
+#include "MemoryTag.hpp"
 #include "ThreadCache.hpp"
+#include <cstdlib>
+#include <iostream>
 
 namespace MyMemoryPool
 {
@@ -8,14 +13,115 @@ namespace MyMemoryPool
     class MemoryPool
     {
     public:
+        // 线程退出时在内存池的线程局部变量之后析构的对象不再有线程缓存，见ThreadCache::allocateUncached()
         static void *allocate(size_t size)
         {
-            return ThreadCache::getInstance()->allocate(size);
+            ThreadCache *cache = ThreadCache::getInstance();
+            return cache != nullptr ? cache->allocate(size) : ThreadCache::allocateUncached(Heap::defaultHeap(), size);
+        }
+
+        // 本次分配计入tag，释放时仍用deallocate()，见MemoryTags；未开启标记模式时与allocate(size)相同
+        static void *allocate(size_t size, MemoryTag tag)
+        {
+            if constexpr (TAGGED)
+            {
+                MemoryTagScope scope(tag);
+                return allocate(size);
+            }
+            else
+            {
+                (void)tag;
+                return allocate(size);
+            }
         }
 
         static void deallocate(void *ptr, size_t size)
         {
-            ThreadCache::getInstance()->deallocate(ptr, size);
+            if (ThreadCache *cache = ThreadCache::getInstance())
+            {
+                cache->deallocate(ptr, size);
+                return;
+            }
+            ThreadCache::deallocateUncached(Heap::defaultHeap(), ptr, size);
+        }
+
+        // 把oldSize字节的ptr调整为newSize字节，返回的指针可能与ptr相同，失败时返回nullptr且ptr仍然有效
+        // 大小类不变时不做任何事；大对象优先原地扩大或缩小，专用映射通过mremap调整，都不行时才复制
+        static void *reallocate(void *ptr, size_t oldSize, size_t newSize)
+        {
+            ThreadCache *cache = ThreadCache::getInstance();
+            return cache != nullptr ? cache->reallocate(ptr, oldSize, newSize)
+                                    : ThreadCache::reallocateUncached(Heap::defaultHeap(), ptr, oldSize, newSize);
+        }
+
+        // 按预期寿命分配：Lifetime::Long的对象来自Heap::longLivedHeap()，不与短寿命对象共用span
+        // 带大小释放时必须传入分配时的lifetime；不带大小的Heap::deallocate(ptr)可以释放任何一种
+        static void *allocate(size_t size, Lifetime lifetime)
+        {
+            if (lifetime == Lifetime::Long)
+            {
+                return Heap::longLivedHeap().allocate(size);
+            }
+            return allocate(size);
+        }
+
+        static void deallocate(void *ptr, size_t size, Lifetime lifetime)
+        {
+            if (lifetime == Lifetime::Long)
+            {
+                Heap::longLivedHeap().deallocate(ptr, size);
+                return;
+            }
+            deallocate(ptr, size);
+        }
+
+        // 延迟释放：其他线程可能仍在EpochGuard的作用域内读取ptr，等它们全部离开后才真正释放，见Epoch
+        static void retire(void *ptr, size_t size)
+        {
+            Epoch::retire(ptr, size);
+        }
+
+        // 在操作系统线程之间迁移线程缓存，见ThreadCache::detach()和ThreadCache::attach()
+        // 取下的句柄必须由某个线程attach，否则其中的内存块不会被归还
+        static ThreadCache *detachThreadCache()
+        {
+            return ThreadCache::detach();
+        }
+
+        static void attachThreadCache(ThreadCache *cache)
+        {
+            ThreadCache::attach(cache);
+        }
+
+        // 默认堆的启动预热，见Heap::reserve()和Heap::warmup()
+        static bool reserve(size_t size, size_t count, bool fillThreadCache = false)
+        {
+            return Heap::defaultHeap().reserve(size, count, fillThreadCache);
+        }
+
+        static bool warmup(const WarmupProfile &profile, bool fillThreadCache = false)
+        {
+            return Heap::defaultHeap().warmup(profile, fillThreadCache);
+        }
+
+        // 标签的使用情况，合并所有线程的计数；未开启标记模式时总是0
+        static MemoryTags::Usage tagUsage(MemoryTag tag)
+        {
+            return MemoryTags::usage(tag);
+        }
+
+        // 进程正常退出时把默认堆中仍被使用的内存块按大小类输出到标准错误，只注册一次
+        // 在所有其他线程都已停止分配后退出时结果才准确；主线程的ThreadCache在此之前已经停放，其中的内存块不计为泄漏
+        static void enableLeakReport()
+        {
+            static const bool registered = std::atexit(reportDefaultHeapLeaks) == 0;
+            (void)registered;
+        }
+
+    private:
+        static void reportDefaultHeapLeaks()
+        {
+            Heap::defaultHeap().reportLeaks(std::cerr);
         }
     };
 } // namespace MyMemoryPool
\ No newline at end of file
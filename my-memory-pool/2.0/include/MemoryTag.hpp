@@ -0,0 +1,143 @@
+#pragma once
+#include "Common.hpp"
+#include <vector>
+
+namespace MyMemoryPool
+{
+    // 内存标签，用于按租户或子系统统计内存使用，0表示未标记
+    using MemoryTag = uint32_t;
+
+    // 按标签统计内存使用（标记模式，编译时定义MEMORY_POOL_TAGGING开启）
+    // 分配时记录当前线程的标签：小对象记录在内存块末尾的TAG_SIZE字节中，大对象记录在span中，释放时据此计入原来的标签
+    // 计数器按线程分片，分配和释放只写本线程的分片，不需要原子的读改写；查询时合并所有分片
+    // 关闭时不预留标签空间，分配和释放路径上的标记代码在编译期被消除
+    class MemoryTags
+    {
+    public:
+        static constexpr size_t MAX_TAGS = 256;               // 超出范围的标签按MAX_TAGS取模
+        static constexpr size_t TAG_SIZE = sizeof(uint64_t); // 小对象内存块末尾记录标签的字节数
+
+        // 一个标签的使用情况，字节数按实际占用的内存块（或大对象的页）计算
+        struct Usage
+        {
+            int64_t liveBytes;    // 仍未释放的字节数
+            int64_t liveBlocks;   // 仍未释放的内存块数
+            uint64_t allocations; // 累计分配次数
+        };
+
+        // 当前线程的标签，之后的分配都计入该标签
+        static MemoryTag current() { return currentTag_; }
+        static void setCurrent(MemoryTag tag) { currentTag_ = tag; }
+
+        // 合并所有线程（包括已退出线程）的分片，其他线程并发分配时结果是近似值
+        static Usage usage(MemoryTag tag);
+        // 所有累计分配次数不为0的标签，按标签排序
+        static std::vector<std::pair<MemoryTag, Usage>> snapshot();
+
+        // 以下只在标记模式下由ThreadCache调用
+        // 小对象：在内存块末尾记录标签并计数，blockSize为大小类的块大小
+        static void onAllocateBlock(void *ptr, size_t blockSize)
+        {
+            MemoryTag tag = currentTag_;
+            *reinterpret_cast<uint64_t *>(static_cast<char *>(ptr) + blockSize - TAG_SIZE) = tag;
+            count(tag, static_cast<int64_t>(blockSize), 1);
+        }
+        static void onDeallocateBlock(void *ptr, size_t blockSize)
+        {
+            count(blockTag(ptr, blockSize), -static_cast<int64_t>(blockSize), -1);
+        }
+        // 小对象记录的标签
+        static MemoryTag blockTag(const void *ptr, size_t blockSize)
+        {
+            return static_cast<MemoryTag>(
+                *reinterpret_cast<const uint64_t *>(static_cast<const char *>(ptr) + blockSize - TAG_SIZE));
+        }
+        // 大对象：标签由调用者保存
+        static MemoryTag onAllocateLarge(size_t bytes)
+        {
+            MemoryTag tag = currentTag_;
+            count(tag, static_cast<int64_t>(bytes), 1);
+            return tag;
+        }
+        static void onDeallocateLarge(MemoryTag tag, size_t bytes)
+        {
+            count(tag, -static_cast<int64_t>(bytes), -1);
+        }
+        // 大对象原地调整大小：仍计入原来的标签，不算新的分配
+        static void onResizeLarge(MemoryTag tag, size_t oldBytes, size_t newBytes)
+        {
+            count(tag, static_cast<int64_t>(newBytes) - static_cast<int64_t>(oldBytes), 0);
+        }
+
+    private:
+        struct Counter
+        {
+            std::atomic<int64_t> liveBytes{0};
+            std::atomic<int64_t> liveBlocks{0};
+            std::atomic<uint64_t> allocations{0};
+        };
+
+        // 每个线程一个，线程退出后留给新线程复用，永不释放
+        // 释放可能发生在其他线程，单个分片的存活数可以为负，合并后才有意义
+        struct Shard
+        {
+            std::array<Counter, MAX_TAGS> counters;
+            std::atomic<bool> inUse{false};
+            Shard *next = nullptr; // 全部分片组成的链表，只在头部插入
+        };
+
+        // 只由所属线程写入，其他线程查询时读取，用普通的读和写代替原子加法
+        static void count(MemoryTag tag, int64_t bytes, int64_t blocks)
+        {
+            Shard *shard = shard_ != nullptr ? shard_ : acquireShard();
+            if (shard == nullptr)
+            {
+                countShared(tag, bytes, blocks);
+                return;
+            }
+            Counter &counter = shard->counters[tag % MAX_TAGS];
+            counter.liveBytes.store(counter.liveBytes.load(std::memory_order_relaxed) + bytes,
+                                    std::memory_order_relaxed);
+            counter.liveBlocks.store(counter.liveBlocks.load(std::memory_order_relaxed) + blocks,
+                                     std::memory_order_relaxed);
+            if (blocks > 0)
+            {
+                counter.allocations.store(counter.allocations.load(std::memory_order_relaxed) + 1,
+                                          std::memory_order_relaxed);
+            }
+        }
+        static std::atomic<Shard *> &shards();
+        // 为当前线程取得一个分片；线程已交还分片（正在退出）时返回nullptr
+        static Shard *acquireShard();
+        // 创建标记为使用中的分片并插入链表头部
+        static Shard *newShard();
+        // 线程交还分片之后，其他线程局部变量的析构函数中仍可能分配和释放，
+        // 这些计数用原子加法计入一个永不交还的共享分片，不写入可能已被新线程使用的分片
+        static void countShared(MemoryTag tag, int64_t bytes, int64_t blocks);
+
+        // 线程退出时交还分片，并使之后的计数转入共享分片
+        struct ShardReleaser;
+        static thread_local ShardReleaser shardReleaser_;
+
+        static inline thread_local MemoryTag currentTag_ = 0;
+        static inline thread_local Shard *shard_ = nullptr;
+        static inline thread_local bool shardReleased_ = false;
+    };
+
+    // 作用域内当前线程的分配计入tag，离开时恢复原来的标签，可以嵌套
+    class MemoryTagScope
+    {
+    public:
+        explicit MemoryTagScope(MemoryTag tag) : previous_(MemoryTags::current())
+        {
+            MemoryTags::setCurrent(tag);
+        }
+        ~MemoryTagScope() { MemoryTags::setCurrent(previous_); }
+
+        MemoryTagScope(const MemoryTagScope &) = delete;
+        MemoryTagScope &operator=(const MemoryTagScope &) = delete;
+
+    private:
+        MemoryTag previous_;
+    };
+} // namespace MyMemoryPool
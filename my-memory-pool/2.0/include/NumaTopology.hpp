@@ -0,0 +1,51 @@
+#pragma once
+#include "Common.hpp"
+
+namespace MyMemoryPool
+{
+    // NUMA拓扑信息
+    // 直接使用getcpu/mbind系统调用，不依赖libnuma
+    // 非NUMA机器（或无法读取拓扑信息时）退化为单个分区
+    class NumaTopology
+    {
+    public:
+        // 返回当前线程所在节点的函数，用于模拟拓扑
+        using NodeResolver = size_t (*)();
+
+        static NumaTopology &getInstance()
+        {
+            static NumaTopology instance;
+            return instance;
+        }
+
+        // 分区数量
+        size_t nodeCount() const
+        {
+            return nodeCount_.load(std::memory_order_relaxed);
+        }
+
+        // 当前线程所在的节点，结果总是小于nodeCount()
+        size_t currentNode() const;
+
+        // 将[addr, addr + size)的物理页优先分配在node节点上
+        // 必须在首次访问这段内存之前调用
+        void bindMemory(void *addr, size_t size, size_t node) const;
+
+        // 使用模拟的拓扑代替真实拓扑，用于在非NUMA机器上测试
+        // 已创建的ThreadCache保持原有节点，之后新建的ThreadCache按resolver选择节点
+        void setFakeTopology(size_t numNodes, NodeResolver resolver);
+        // 恢复为真实拓扑
+        void resetTopology();
+
+    private:
+        NumaTopology();
+
+        // 从/sys/devices/system/node/online读取节点数量
+        static size_t detectNodeCount();
+
+    private:
+        size_t systemNodeCount_;                      // 真实的节点数量
+        std::atomic<size_t> nodeCount_;               // 当前生效的节点数量
+        std::atomic<NodeResolver> fakeResolver_{nullptr}; // 模拟拓扑时的节点查询函数
+    };
+} // namespace MyMemoryPool
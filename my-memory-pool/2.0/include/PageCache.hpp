@@ -1,18 +1,55 @@
 #pragma once
 #include "Common.hpp"
+#include "PageMap.hpp"
+#include <vector>
 
 namespace MyMemoryPool
 {
+    class PageCache;
+
+    // 管理一段连续页面的元数据
+    struct Span
+    {
+        void *pageAddr;   // 页起始地址
+        size_t numPages;  // 页数
+        Span *next;       // 链表指针
+        Span *prev;       // 链表指针，用于从链表中间摘除
+        bool isUse;       // 是否已从PageCache分配出去
+        PageCache *owner; // 所属的PageCache，span对象只在其中复用，创建后不再改变
+        size_t node;      // 所属的NUMA分区，创建后不再改变
+        size_t stripe;    // 所属的PageCache分段，创建后不再改变
+        char *chunkBegin; // span所在的系统内存块，span只与同一内存块内的span合并
+        char *chunkEnd;
+        uint32_t tag;     // 标记模式下作为大对象分配时的MemoryTag
+
+        // 以下字段仅在span被CentralCache切分为小块时使用
+        size_t blockSize; // 切分的内存块大小，0表示未切分
+        size_t useCount;  // 已分配给ThreadCache的内存块数量
+        void *freeList;   // span内被回收的内存块组成的自由链表
+        char *bumpPtr;    // 从未使用过的内存的起始位置，按需切分
+        char *bumpEnd;    // span可切分区域的结束位置
+
+        // 加固模式下每个内存块的使用状态位，随span对象一起复用，不会被释放
+        std::atomic<uint64_t> *blockBits;
+    };
+
     class PageCache
     {
     public:
         static constexpr size_t PAGE_SIZE = 4096; // 4K页大小
+        static_assert(PAGE_SIZE == (size_t(1) << PageMap::PAGE_SHIFT), "PageMap page size mismatch");
 
-        static PageCache &getInstance()
-        {
-            static PageCache instance;
-            return instance;
-        }
+        static constexpr size_t STRIPE_NUM = 8;       // 分段数量，每段有独立的锁和空闲span
+        static constexpr size_t CHUNK_PAGES = 1024;   // 每次向系统预留的页数（4MB）
+        static constexpr size_t SPAN_CACHE_SIZE = 32; // 无锁缓存的SPAN_PAGES大小span数量
+        static constexpr size_t SPAN_SLAB_SIZE = 64;  // 每次批量创建的span对象数量
+
+        // 默认堆中node节点的PageCache
+        // 每个堆的每个NUMA节点一个PageCache，各自拥有独立的空闲span和锁
+        static PageCache &getInstance(size_t node = 0);
+
+        Heap &heap() const { return *heap_; }
+        size_t node() const { return node_; }
 
         // 分配指定页数的span
         void *allocateSpan(size_t numPages);
@@ -20,24 +57,114 @@ namespace MyMemoryPool
         // 释放span
         void deallocateSpan(void *ptr, size_t numPages);
 
-    private:
-        PageCache() = default;
+        // 把ptr处已分配的大对象span调整为newPages页，返回调整后的地址，无法原地调整时返回nullptr，span不变
+        // 缩小时尾部的页作为空闲span放回分段；扩大时接管同一内存块中紧随其后的空闲span
+        // 为单个大对象专门申请的内存块改由PageSource::resize()调整整个映射，地址可能改变
+        void *resizeSpan(void *ptr, size_t newPages);
 
-        // 向系统申请内存
-        void *systemAlloc(size_t numPages);
+        // 将无锁缓存中的span放回分段，整块空闲的内存块归还系统，其余空闲span的物理页交还系统(MADV_DONTNEED)
+        void releaseFreeMemory();
+
+        // 按地址顺序访问每个内存块中的每个span，visitor(span, free)，free表示span在分段或无锁缓存中空闲
+        // 调用者持有全部分段的锁，且其他线程没有在使用无锁缓存
+        template <typename Visitor>
+        void forEachSpan(Visitor &&visitor)
+        {
+            PageMap &pageMap = PageMap::getInstance();
+            for (Stripe &stripe : stripes_)
+            {
+                for (const auto &[chunk, numPages] : stripe.chunks)
+                {
+                    char *end = chunk + numPages * PAGE_SIZE;
+                    for (char *addr = chunk; addr < end;)
+                    {
+                        // 已分配的span映射全部页，空闲span映射首尾页，首页总能找到span
+                        Span *span = pageMap.get(addr);
+                        assert(span != nullptr && span->pageAddr == addr);
+                        visitor(span, !span->isUse || inSpanCache(span));
+                        addr += span->numPages * PAGE_SIZE;
+                    }
+                }
+            }
+        }
+
+        // fork前按分段顺序获取所有分段的锁，fork后释放
+        void lockForFork();
+        void unlockAfterFork();
+
+        // 之后count次向系统申请内存都视为失败，用于测试内存不足的处理，0表示恢复正常
+        static void injectMapFailures(size_t count);
 
     private:
-        struct Span
+        friend class NodeInstances<PageCache>;
+        PageCache(Heap *heap, size_t node) : heap_(heap), node_(node) {}
+        // 所属的堆销毁时调用，归还全部内存块和span对象
+        ~PageCache();
+
+        // 分段：一组从系统申请的内存块及其中的空闲span
+        // span只会与同一内存块内的相邻span合并，因此分割与合并只需持有本分段的锁
+        struct alignas(64) Stripe
         {
-            void *pageAddr;  // 页起始地址
-            size_t numPages; // 页数
-            Span *next;      // 链表指针
+            std::mutex mutex;                   // 保护本分段的所有成员
+            std::map<size_t, Span *> freeSpans; // 按页数管理空闲span，不同页数对应不同Span链表
+            Span *spanObjectFreeList = nullptr; // 未使用的span对象组成的链表，留待复用
+            std::map<char *, size_t> chunks;    // 本分段向系统申请的内存块及其页数
+            std::vector<Span *> spanSlabs;      // 批量创建的span对象数组
         };
 
-        // 按页数管理空闲span，不同页数对应不同Span链表
-        std::map<size_t, Span *> freeSpans_;
-        // 页首地址到span的映射，用于回收
-        std::map<void *, Span *> spanMap_;
-        std::mutex mutex_; // 互斥锁 用于保护freeSpans_和spanMap_
+        // 当前线程优先使用的分段，不同线程分散到不同分段上
+        static size_t preferredStripe();
+
+        // 从分段的空闲span中分配，调用者需持有分段的锁
+        Span *allocateFromStripe(Stripe &stripe, size_t numPages);
+        // 依次尝试所有分段，从preferred开始，blocking为false时跳过正被其他线程使用的分段
+        Span *allocateFromStripes(size_t numPages, size_t preferred, bool blocking);
+        // 将不再使用的span与相邻空闲span合并后放回分段，调用者需持有分段的锁
+        // 合并后整块空闲的大对象专用内存块通过unmapChunk返回，由调用者在锁外归还系统
+        void releaseToStripe(Stripe &stripe, Span *span, char *&unmapChunk, size_t &unmapPages);
+        // 归还内存块，不持有任何锁
+        void systemFree(char *chunk, size_t numPages);
+        // 与相邻的空闲span合并，调用者需持有分段的锁
+        Span *coalesce(Stripe &stripe, Span *span);
+        // 调整独占整个内存块的span所在的映射，失败返回nullptr
+        void *resizeChunk(Span *span, size_t newPages);
+
+        // 无锁span缓存，只缓存SPAN_PAGES页的span
+        Span *popSpanCache();
+        bool pushSpanCache(Span *span);
+        // 缓存中的span仍标记为isUse
+        bool inSpanCache(const Span *span) const
+        {
+            for (const auto &slot : spanCache_)
+            {
+                if (slot.load(std::memory_order_relaxed) == span)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // 向系统申请内存，不持有任何锁，超出所属堆的内存上限或映射失败时返回nullptr
+        void *systemAlloc(size_t numPages);
+
+        // 将空闲span挂入/摘出freeSpans，调用者需持有分段的锁
+        void insertFreeSpan(Stripe &stripe, Span *span);
+        void eraseFreeSpan(Stripe &stripe, Span *span);
+        // 记录空闲span首尾页的映射
+        void setFreeSpanBoundary(Span *span);
+
+        // 分配/回收span元数据对象，调用者需持有分段的锁
+        Span *newSpanObject(size_t stripeIndex);
+        void deleteSpanObject(Span *span);
+
+    private:
+        Heap *heap_;  // 所属的堆
+        size_t node_; // 所属的NUMA节点
+        std::array<Stripe, STRIPE_NUM> stripes_;
+        // 最常见的单个span申请/归还走这里，不需要加锁
+        std::array<std::atomic<Span *>, SPAN_CACHE_SIZE> spanCache_{};
+
+        static std::atomic<size_t> injectedMapFailures_; // 剩余的模拟映射失败次数
     };
-} // namespace MyMemoryPool
\ No newline at end of file
+} // namespace MyMemoryPool
@@ -0,0 +1,81 @@
+#pragma once
+#include "Common.hpp"
+
+namespace MyMemoryPool
+{
+    struct Span;
+
+    // 页号到Span的映射（两层基数树）
+    // 可以由span内任意地址反查其所属的span，供CentralCache归还内存块、PageCache合并相邻span使用
+    class PageMap
+    {
+    public:
+        static constexpr size_t PAGE_SHIFT = 12; // 4K页
+
+        static PageMap &getInstance()
+        {
+            static PageMap instance;
+            return instance;
+        }
+
+        // 查询地址所在页对应的span，无锁，未记录的页返回nullptr
+        Span *get(const void *ptr) const
+        {
+            size_t pageId = reinterpret_cast<uintptr_t>(ptr) >> PAGE_SHIFT;
+            size_t rootIndex = pageId >> LEAF_BITS;
+            if (rootIndex >= ROOT_LENGTH)
+            {
+                return nullptr;
+            }
+
+            Leaf *leaf = root_[rootIndex].load(std::memory_order_acquire);
+            if (leaf == nullptr)
+            {
+                return nullptr;
+            }
+            return leaf->spans[pageId & (LEAF_LENGTH - 1)].load(std::memory_order_acquire);
+        }
+
+        // 将[pageAddr, pageAddr + numPages页)中的每一页都映射到span
+        // span为nullptr时表示清除映射；创建叶子节点失败时返回false，此前的页可能已经映射
+        bool set(void *pageAddr, size_t numPages, Span *span);
+
+        // 提前创建覆盖[pageAddr, pageAddr + numPages页)的叶子节点，成功后对该区间的set()不会失败
+        // 叶子节点永不释放，PageCache在映射内存块时调用，之后在锁内分割、合并span时无需处理失败
+        bool prepare(void *pageAddr, size_t numPages);
+
+        // fork前后锁住/释放创建叶子节点用的锁
+        void lockForFork() { leafMutex_.lock(); }
+        void unlockAfterFork() { leafMutex_.unlock(); }
+
+        // 之后count次创建叶子节点都视为失败，用于测试映射叶子节点失败的处理，0表示恢复正常
+        static void injectLeafFailures(size_t count) { injectedLeafFailures_.store(count, std::memory_order_relaxed); }
+
+    private:
+        PageMap() = default;
+
+        // 叶子节点不存在时创建
+        struct Leaf;
+        Leaf *ensureLeaf(size_t rootIndex);
+
+    private:
+        static constexpr size_t ADDRESS_BITS = 48;                       // 用户态虚拟地址位数
+        static constexpr size_t PAGE_BITS = ADDRESS_BITS - PAGE_SHIFT;   // 页号位数
+        static constexpr size_t LEAF_BITS = 18;                          // 每个叶子覆盖1GB地址空间
+        static constexpr size_t ROOT_BITS = PAGE_BITS - LEAF_BITS;
+        static constexpr size_t ROOT_LENGTH = size_t(1) << ROOT_BITS;
+        static constexpr size_t LEAF_LENGTH = size_t(1) << LEAF_BITS;
+
+        struct Leaf
+        {
+            std::atomic<Span *> spans[LEAF_LENGTH];
+        };
+
+        // 叶子节点通过mmap按需创建，未访问的部分不会占用物理内存
+        // 根数组依赖静态存储的零初始化，不在构造函数中逐项清零，避免启动时触碰2MB内存
+        std::array<std::atomic<Leaf *>, ROOT_LENGTH> root_;
+        std::mutex leafMutex_; // 保护叶子节点的创建
+
+        static inline std::atomic<size_t> injectedLeafFailures_{0}; // 剩余的模拟创建失败次数
+    };
+} // namespace MyMemoryPool
@@ -0,0 +1,126 @@
+#pragma once
+#include "Common.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace MyMemoryPool
+{
+    // PageCache获取内存块的来源，创建堆时指定
+    // PageCache对每个内存块依次调用reserve和commit，之后可能对其中的空闲区间调用decommit，
+    // 最后（整块空闲或堆销毁时）用reserve时的地址和大小调用release
+    // decommit后的区间可能不经commit就再次被访问，实现必须保证此时仍然可以读写
+    // 各操作可能被多个线程同时调用，不持有内存池的任何锁
+    class PageSource
+    {
+    public:
+        virtual ~PageSource() = default;
+
+        // 预留size字节（页大小的倍数）的地址空间，返回页对齐的地址，失败返回nullptr
+        // node为期望的NUMA节点，实现可以忽略
+        virtual void *reserve(size_t size, size_t node) = 0;
+        // 使预留的区间可以访问，失败返回false，调用者随后release
+        virtual bool commit(void *addr, size_t size) = 0;
+        // 交还区间的物理内存，地址空间保留
+        virtual void decommit(void *addr, size_t size) = 0;
+        // 归还reserve得到的整个区间
+        virtual void release(void *addr, size_t size) = 0;
+        // 把reserve得到的整个区间调整为newSize字节，内容保留，返回是否成功，失败时原区间不变
+        // target为nullptr时原地调整；否则把内容移到target，target是reserve(newSize)得到并已提交的区间，成功后原区间不再存在
+        // 默认不支持，PageCache改为复制
+        virtual bool resize(void *, size_t, size_t, void *) { return false; }
+    };
+
+    // 匿名私有映射，默认的来源：reserve映射只预留地址空间的内存，decommit通过MADV_DONTNEED交还物理页
+    class MmapPageSource : public PageSource
+    {
+    public:
+        void *reserve(size_t size, size_t node) override;
+        bool commit(void *, size_t) override { return true; }
+        void decommit(void *addr, size_t size) override;
+        void release(void *addr, size_t size) override;
+        // mremap：只移动页表项，不复制内容
+        bool resize(void *addr, size_t size, size_t newSize, void *target) override;
+    };
+
+    // 默认堆使用的来源，永不析构
+    PageSource &systemPageSource();
+
+    // 调用者提供的固定缓冲区：构造之后的任何操作都不进行系统调用，分配结果只取决于调用顺序
+    // 适用于启动时预先分配好全部内存的实时进程；缓冲区用完后reserve失败，decommit不做任何事
+    // 缓冲区由调用者持有，必须比使用它的堆存活得更久
+    class FixedBufferPageSource : public PageSource
+    {
+    public:
+        // 缓冲区首尾不足一页的部分不使用
+        FixedBufferPageSource(void *buffer, size_t size);
+
+        void *reserve(size_t size, size_t node) override;
+        bool commit(void *, size_t) override { return true; }
+        void decommit(void *, size_t) override {}
+        void release(void *addr, size_t size) override;
+
+        // 尚未被reserve的字节数
+        size_t available() const;
+
+    private:
+        mutable std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+        // 空闲区间按地址排序，首次适配，归还时与相邻区间合并
+        // 容量在构造时按最多可能的区间数预留，之后不再分配内存
+        std::vector<std::pair<char *, size_t>> freeRanges_;
+    };
+
+    // 以文件为后端的共享映射，文件建在指定目录中并立即删除，进程退出后不留痕迹
+    // 每次reserve在文件末尾扩展一段并映射，release和decommit通过打洞归还文件占用的存储
+    // 适用于超过物理内存的大堆（目录位于磁盘上）；commit通过fallocate预先分配存储，空间不足时失败而不是在访问时触发SIGBUS
+    class FilePageSource : public PageSource
+    {
+    public:
+        explicit FilePageSource(const std::string &directory) : FilePageSource(directory, false) {}
+        ~FilePageSource() override;
+
+        FilePageSource(const FilePageSource &) = delete;
+        FilePageSource &operator=(const FilePageSource &) = delete;
+
+        // 文件是否创建成功，失败时reserve总是返回nullptr
+        bool valid() const { return fd_ >= 0; }
+        // 文件系统的分配粒度，映射的长度和打洞的区间都按它对齐
+        size_t granularity() const { return granularity_; }
+
+        void *reserve(size_t size, size_t node) override;
+        bool commit(void *addr, size_t size) override;
+        void decommit(void *addr, size_t size) override;
+        void release(void *addr, size_t size) override;
+
+    protected:
+        // requireHugetlbfs为true时目录不在hugetlbfs上视为失败
+        FilePageSource(const std::string &directory, bool requireHugetlbfs);
+
+    private:
+        struct Region
+        {
+            off_t offset;  // 在文件中的偏移
+            size_t length; // 实际映射的长度，按分配粒度向上取整
+        };
+
+        // 包含[addr, addr + size)的映射区间，调用者持有mutex_
+        std::map<char *, Region>::iterator findRegion(void *addr);
+        // 对文件中按粒度向内取整后的区间打洞
+        void punchHole(off_t offset, size_t size);
+
+    private:
+        int fd_ = -1;
+        size_t granularity_ = 0;
+        std::mutex mutex_;
+        std::map<char *, Region> regions_; // 以映射地址为键
+        off_t fileSize_ = 0;               // 文件只增长，归还的区间以空洞的形式保留
+    };
+
+    // hugetlbfs上的文件，每个内存块由大页组成，减少TLB缺失
+    // 需要系统预留大页并挂载hugetlbfs，不满足时valid()为false
+    class HugePageSource : public FilePageSource
+    {
+    public:
+        explicit HugePageSource(const std::string &mountPoint = "/dev/hugepages") : FilePageSource(mountPoint, true) {}
+    };
+} // namespace MyMemoryPool
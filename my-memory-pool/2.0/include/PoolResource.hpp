@@ -0,0 +1,242 @@
+#pragma once
+#include "Arena.hpp"
+#include "PageCache.hpp"
+#include <memory_resource>
+#include <new>
+
+namespace MyMemoryPool
+{
+    // 以内存池为后端的std::pmr::memory_resource
+    // 分配按大小类走ThreadCache，释放时利用pmr提供的大小直接定位大小类
+    // 所有PoolResource共享同一个内存池，因此彼此相等，可以互相释放对方分配的内存
+    class PoolResource : public std::pmr::memory_resource
+    {
+    protected:
+        void *do_allocate(size_t bytes, size_t align) override;
+        void do_deallocate(void *ptr, size_t bytes, size_t align) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    private:
+        // 大小类的内存块从页对齐的span起始处按块大小依次切分
+        // 块大小是对齐数的倍数时内存块天然对齐，不需要额外空间
+        static bool alignedBySizeClass(size_t bytes, size_t align);
+    };
+
+    // 进程内共享的PoolResource实例
+    PoolResource *poolResource();
+
+    // 以Arena为后端的单调分配资源，对应std::pmr::monotonic_buffer_resource
+    // 释放操作不做任何事，release()或析构时一次性归还全部span
+    class MonotonicResource : public std::pmr::memory_resource
+    {
+    public:
+        MonotonicResource() = default;
+        MonotonicResource(const MonotonicResource &) = delete;
+        MonotonicResource &operator=(const MonotonicResource &) = delete;
+
+        void release() { arena_.reset(); }
+
+    protected:
+        void *do_allocate(size_t bytes, size_t align) override;
+        void do_deallocate(void *, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        Arena arena_;
+    };
+
+    // 不加锁的锁类型，用于单线程版本
+    struct NullMutex
+    {
+        void lock() {}
+        void unlock() {}
+    };
+
+    // 对应std::pmr::(un)synchronized_pool_resource的池资源
+    // 不超过largest_required_pool_block的请求按2的幂分档，从本资源独占的Arena中切分，释放后挂在本资源的空闲链表上
+    // 更大或对齐要求超过max_align_t的请求交给上游资源，release()或析构时所有内存一并归还
+    // Arena按span获取内存，pool_options::max_blocks_per_chunk不起作用
+    template <typename Mutex>
+    class BasicPoolResource : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t MIN_BLOCK = ALIGNMENT;
+        static constexpr size_t MAX_POOL_BLOCK = SPAN_PAGES * PageCache::PAGE_SIZE; // 超过该大小的请求总是交给上游
+
+        explicit BasicPoolResource(const std::pmr::pool_options &options = {},
+                                   std::pmr::memory_resource *upstream = poolResource())
+            : upstream_(upstream), options_(options)
+        {
+            if (options_.largest_required_pool_block == 0 || options_.largest_required_pool_block > MAX_POOL_BLOCK)
+            {
+                options_.largest_required_pool_block = MAX_POOL_BLOCK;
+            }
+            options_.largest_required_pool_block = std::max(options_.largest_required_pool_block, MIN_BLOCK);
+            options_.largest_required_pool_block = blockSizeOf(poolIndex(options_.largest_required_pool_block));
+        }
+
+        explicit BasicPoolResource(std::pmr::memory_resource *upstream)
+            : BasicPoolResource(std::pmr::pool_options{}, upstream)
+        {
+        }
+
+        BasicPoolResource(const BasicPoolResource &) = delete;
+        BasicPoolResource &operator=(const BasicPoolResource &) = delete;
+
+        ~BasicPoolResource() override { release(); }
+
+        // 归还所有内存，包括尚未释放的内存块
+        void release()
+        {
+            std::lock_guard<Mutex> lock(mutex_);
+            while (largeList_ != nullptr)
+            {
+                LargeHeader *header = largeList_;
+                largeList_ = header->next;
+                upstream_->deallocate(header, headerOffset(header->align) + header->bytes, header->align);
+            }
+            freeLists_.fill(nullptr);
+            arena_.reset();
+        }
+
+        std::pmr::memory_resource *upstream_resource() const { return upstream_; }
+        std::pmr::pool_options options() const { return options_; }
+
+    protected:
+        void *do_allocate(size_t bytes, size_t align) override
+        {
+            if (!pooled(bytes, align))
+            {
+                return allocateLarge(bytes, align);
+            }
+
+            // 块大小不小于对齐数，切分时按块大小对齐(最多max_align_t)，因此满足对齐要求
+            size_t index = poolIndex(std::max(bytes, align));
+            std::lock_guard<Mutex> lock(mutex_);
+            void *ptr = freeLists_[index];
+            if (ptr != nullptr)
+            {
+                freeLists_[index] = *static_cast<void **>(ptr);
+                return ptr;
+            }
+            size_t blockSize = blockSizeOf(index);
+            ptr = arena_.allocate(blockSize, std::min(blockSize, alignof(std::max_align_t)));
+            if (ptr == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+
+        void do_deallocate(void *ptr, size_t bytes, size_t align) override
+        {
+            if (!pooled(bytes, align))
+            {
+                deallocateLarge(ptr, align);
+                return;
+            }
+
+            size_t index = poolIndex(std::max(bytes, align));
+            std::lock_guard<Mutex> lock(mutex_);
+            *static_cast<void **>(ptr) = freeLists_[index];
+            freeLists_[index] = ptr;
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        // 交给上游分配的内存前部的头，串成双向链表以便release()时归还
+        struct LargeHeader
+        {
+            LargeHeader *prev;
+            LargeHeader *next;
+            size_t bytes;
+            size_t align;
+        };
+
+        static constexpr size_t POOL_NUM = 13; // 8B到32KB，每档翻倍
+        static_assert((MIN_BLOCK << (POOL_NUM - 1)) == MAX_POOL_BLOCK, "pool count mismatch");
+
+        static size_t poolIndex(size_t bytes)
+        {
+            size_t index = 0;
+            while (blockSizeOf(index) < bytes)
+            {
+                ++index;
+            }
+            return index;
+        }
+
+        static constexpr size_t blockSizeOf(size_t index) { return MIN_BLOCK << index; }
+
+        bool pooled(size_t bytes, size_t align) const
+        {
+            return bytes <= options_.largest_required_pool_block && align <= alignof(std::max_align_t);
+        }
+
+        // 用户内存相对头部的偏移，由对齐数唯一确定，释放时据此找回头部
+        static size_t headerOffset(size_t align)
+        {
+            return (sizeof(LargeHeader) + align - 1) / align * align;
+        }
+
+        void *allocateLarge(size_t bytes, size_t align)
+        {
+            align = std::max(align, alignof(LargeHeader));
+            size_t offset = headerOffset(align);
+            auto *header = static_cast<LargeHeader *>(upstream_->allocate(offset + bytes, align));
+            header->bytes = bytes;
+            header->align = align;
+
+            std::lock_guard<Mutex> lock(mutex_);
+            header->prev = nullptr;
+            header->next = largeList_;
+            if (largeList_ != nullptr)
+            {
+                largeList_->prev = header;
+            }
+            largeList_ = header;
+            return reinterpret_cast<char *>(header) + offset;
+        }
+
+        void deallocateLarge(void *ptr, size_t align)
+        {
+            align = std::max(align, alignof(LargeHeader));
+            auto *header = reinterpret_cast<LargeHeader *>(static_cast<char *>(ptr) - headerOffset(align));
+
+            {
+                std::lock_guard<Mutex> lock(mutex_);
+                if (header->prev != nullptr)
+                {
+                    header->prev->next = header->next;
+                }
+                else
+                {
+                    largeList_ = header->next;
+                }
+                if (header->next != nullptr)
+                {
+                    header->next->prev = header->prev;
+                }
+            }
+            upstream_->deallocate(header, headerOffset(header->align) + header->bytes, header->align);
+        }
+
+    private:
+        std::pmr::memory_resource *upstream_;
+        std::pmr::pool_options options_;
+        Mutex mutex_;
+        Arena arena_;                              // 内存块的来源，release()时整体归还
+        std::array<void *, POOL_NUM> freeLists_{}; // 每档的空闲内存块
+        LargeHeader *largeList_ = nullptr;         // 交给上游分配的内存
+    };
+
+    using UnsynchronizedPoolResource = BasicPoolResource<NullMutex>;
+    using SynchronizedPoolResource = BasicPoolResource<std::mutex>;
+} // namespace MyMemoryPool
@@ -0,0 +1,63 @@
+#pragma once
+#include "Heap.hpp"
+
+namespace MyMemoryPool
+{
+    // 实时内存池：创建时一次性映射、预先触碰并锁定（mlock）全部内存，按配置把每个大小类切分成固定数量的内存块
+    // 创建之后的分配和释放不进行任何系统调用，不加锁也不让出CPU：
+    // 每个大小类是一个带版本号的无锁栈，一次操作只有在其他线程的操作成功时才需要重试
+    // 大小类的内存块用完后allocate()立即返回nullptr，不会从其他大小类借用，也不会向系统申请
+    // 与三级缓存相互独立，供音频、交易等不能容忍缺页和系统调用的线程使用
+    class RealtimePool
+    {
+    public:
+        static constexpr size_t MAX_CLASSES = 1024;
+
+        // capacity中每一项指定一个大小类的块大小（向上取整到ALIGNMENT的倍数，相同的合并）和块数
+        // 通常来自预先运行得到的Heap::captureProfile()，按需要留出余量
+        // 内存无法锁定（例如超出RLIMIT_MEMLOCK）时仍然创建，locked()为false；requireLocked为true时改为失败
+        static RealtimePool *create(const WarmupProfile &capacity, bool requireLocked = false);
+
+        // 解除映射，之前分配的内存全部失效
+        void destroy();
+
+        // 使用块大小不小于size的最小大小类；该大小类已用完或size超过最大的块大小时返回nullptr
+        void *allocate(size_t size);
+        // ptr必须来自本内存池，nullptr被忽略
+        void deallocate(void *ptr);
+
+        bool contains(const void *ptr) const;
+        bool locked() const { return locked_; }
+        size_t mappedBytes() const { return size_; }
+        size_t maxBlockSize() const { return maxBlockSize_; }
+        // 大小类的块大小与块数，块按ALIGNMENT对齐
+        size_t numClasses() const { return numClasses_; }
+        size_t classBlockSize(size_t index) const;
+        size_t classCapacity(size_t index) const;
+
+    private:
+        struct ClassState;
+
+        RealtimePool() = default;
+        ~RealtimePool() = default;
+        RealtimePool(const RealtimePool &) = delete;
+        RealtimePool &operator=(const RealtimePool &) = delete;
+
+        // 无锁栈的出栈与入栈
+        void *pop(ClassState &state);
+        void push(ClassState &state, void *block);
+
+    private:
+        char *base_;  // 映射的起始地址，本对象就位于这里，内存块用相对它的偏移（以ALIGNMENT为单位）链接
+        size_t size_; // 映射的总字节数
+        bool locked_;
+
+        ClassState *classes_;
+        size_t numClasses_;
+        uint16_t *sizeTable_; // 按(size - 1) / ALIGNMENT索引的大小类编号
+        size_t maxBlockSize_;
+        uint16_t *pageClass_; // 内存块区域中每一页所属的大小类编号
+        char *blocks_;        // 内存块区域的起始地址，各大小类从页边界开始连续存放
+        char *blocksEnd_;
+    };
+} // namespace MyMemoryPool
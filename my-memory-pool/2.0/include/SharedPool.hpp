@@ -0,0 +1,87 @@
+#pragma once
+#include "Common.hpp"
+#include <pthread.h>
+
+namespace MyMemoryPool
+{
+    // 跨进程共享内存池：页堆、span元数据和空闲链表全部位于一个memfd/shm_open共享内存段中
+    // 各进程把段映射到不同的地址，因此段内所有链接都用相对段起始的偏移表示，进程之间也只能传递偏移
+    // 锁是进程间共享的健壮互斥锁，持锁进程崩溃后其他进程仍能继续加锁（数据可能不一致）
+    // 与进程内的三级缓存相互独立：没有ThreadCache，每次小对象分配/释放获取一次所在大小类的锁
+    class SharedPool
+    {
+    public:
+        static constexpr size_t PAGE_SIZE = 4096;
+        static constexpr size_t MAX_SMALL = 32 * 1024;   // 超过该大小按整页分配
+        static constexpr size_t NUM_CLASSES = 44;        // 256B以下每16B一档，之后每次翻倍分4档
+        static constexpr size_t MAX_BUCKET_PAGES = 128;  // 空闲链表按页数精确分档的上限，更大的放在同一个链表中
+        static constexpr size_t MIN_CLASS_PAGES = SPAN_PAGES;
+
+        // 创建匿名共享内存段（memfd），子进程通过继承或SCM_RIGHTS传递的fd调用attach()
+        static SharedPool *create(size_t size);
+        // 创建命名共享内存段（shm_open），同名的段已存在时失败；其他进程通过open()映射
+        static SharedPool *create(const char *name, size_t size);
+        // 映射已初始化的段，fd会被复制，调用者仍需自行关闭
+        static SharedPool *attach(int fd);
+        static SharedPool *open(const char *name);
+        // 删除命名段，已映射的进程不受影响
+        static bool unlink(const char *name);
+
+        // 解除映射并删除本对象，之前得到的指针全部失效，段中的内存块不受影响
+        void detach();
+
+        // 失败（段内空间不足）时返回nullptr，内存块按16字节对齐
+        void *allocate(size_t size);
+        // 可以由任意进程释放其他进程分配的内存块，ptr必须是本进程映射中的地址
+        void deallocate(void *ptr);
+
+        // 段内偏移与本进程地址之间的转换，偏移0对应nullptr
+        uint64_t offsetOf(const void *ptr) const;
+        void *pointerAt(uint64_t offset) const;
+
+        // 根对象：各进程映射段后据此找到共享的数据结构
+        void setRoot(void *ptr);
+        void *root() const;
+
+        int fd() const { return fd_; }
+        // 可分配的字节数与当前空闲的整页字节数（不含大小类span中的空闲块）
+        size_t capacity() const;
+        size_t freeBytes() const;
+
+    private:
+        struct Header;
+        struct SpanDesc;
+        static const size_t DESC_OFFSET; // 页描述符数组在段内的偏移，紧跟在头部之后
+
+        SharedPool(int fd, char *base, size_t size) : fd_(fd), base_(base), size_(size) {}
+        ~SharedPool();
+        SharedPool(const SharedPool &) = delete;
+        SharedPool &operator=(const SharedPool &) = delete;
+
+        // 调整段大小并初始化头部、页描述符和锁
+        static SharedPool *createFromFd(int fd, size_t size);
+        static SharedPool *mapExisting(int fd);
+
+        Header *header() const { return reinterpret_cast<Header *>(base_); }
+        SpanDesc &desc(uint32_t page) const;
+
+        // 页堆，调用者持有页堆的锁；返回span首页号，0表示空间不足，span的每一页标记为state
+        uint32_t allocatePages(size_t numPages, uint8_t state);
+        void freePages(uint32_t start);
+        void insertFree(uint32_t start);
+        void removeFree(uint32_t start);
+
+        // 大小类，调用者持有该大小类的锁
+        void *allocateSmall(size_t index);
+        void insertPartial(size_t index, uint32_t start);
+        void removePartial(size_t index, uint32_t start);
+
+        static size_t classIndex(size_t size);
+        static size_t classSize(size_t index);
+
+    private:
+        int fd_;
+        char *base_; // 段在本进程中的映射地址
+        size_t size_;
+    };
+} // namespace MyMemoryPool
@@ -1,25 +1,133 @@
 #pragma once
 #include "Common.hpp"
+#include "Hardening.hpp"
+#include "MemoryTag.hpp"
+#include <pthread.h>
+#include <vector>
 
 namespace MyMemoryPool
 {
+    class CentralCache;
+    class PageCache;
+    struct Span;
 
-    // 线程本地缓存
+    // ThreadCache中一个大小类的自由链表
+    // 分配和释放只访问这一个结构体，16字节对齐保证不跨缓存行，相邻的4个大小类共用一个缓存行
+    // 存放在已清零的存储中，全部字段的初始值为0
+    struct alignas(16) FreeList
+    {
+        void *head;         // 链表头
+        uint32_t length;    // 链表中的内存块数量
+        uint16_t maxLength; // 超过后把多余的内存块还给中心缓存；从0开始，每次从中心缓存取块或链表超长时增长，上限THREAD_MAX_SIZE
+        uint16_t lowWater;  // 上次归还以来链表长度的最小值，这些内存块一直没有被使用
+    };
+    static_assert(sizeof(FreeList) == 16, "FreeList must stay within one cache line");
+
+    // 线程本地缓存，每个线程在每个用到的堆中各有一个
     class ThreadCache
     {
     public:
-        // 懒惰初始化 单例模式 只有在被调用时才会初始化
-        static ThreadCache *getInstance()
+        // 当前线程在默认堆中的线程缓存
+        // 懒惰初始化 只有在被调用时才会初始化：优先接管已退出线程停放的缓存，没有时创建新的
+        // 线程退出、缓存已经停放之后返回nullptr，之后的分配和释放改用下面的Uncached函数
+        static ThreadCache *getInstance();
+
+        // 不经过线程缓存的分配和释放，小对象每次向heap中的中心缓存取一块、还一块，大对象直接使用页缓存
+        // 用于线程退出时在内存池的线程局部变量之后析构的对象：这时再接管或创建缓存，缓存不会再被停放或释放，
+        // 接管的停放缓存也从此离开槽位；语义与同名的成员函数相同
+        static void *allocateUncached(Heap &heap, size_t size);
+        static void deallocateUncached(Heap &heap, void *ptr, size_t size);
+        static void deallocateUncached(void *ptr);
+        static void *reallocateUncached(Heap &heap, void *ptr, size_t oldSize, size_t newSize);
+
+        // 线程池替换工作线程时，新线程不必从空缓存开始逐个大小类向中心缓存取块：
+        // 线程退出时它在默认堆中的缓存连同其中的内存块停放在无锁的槽位中，由同一NUMA节点上之后第一次分配的新线程整体接管
+        // 每个节点PARKED_CACHES个槽位，已满时才把内存块还给中心缓存
+        static constexpr size_t PARKED_CACHES = 16;
+
+        // 把当前线程的默认堆缓存从线程上取下并返回，没有时返回nullptr
+        // 供在操作系统线程之间迁移工作的纤程/协程调度器使用，本线程之后的分配另外接管或创建缓存
+        // fork后子进程只保留调用fork的线程上装着的缓存，此前取下的句柄在子进程中不能再使用
+        static ThreadCache *detach();
+        // 把detach()得到的缓存装到当前线程，当前线程原有的缓存被停放，cache为nullptr时只停放
+        // 同一缓存同时只能装在一个线程上
+        static void attach(ThreadCache *cache);
+        // 释放全部停放的缓存，其中的内存块还给中心缓存，由默认堆的releaseMemory()调用
+        static void releaseParked();
+        // 当前停放的缓存数量，合计所有节点
+        static size_t parkedCount();
+
+        // ThreadCache对象很大，用匿名映射保存，未用到的自由链表不占用物理内存；映射失败时返回nullptr
+        static ThreadCache *create(Heap *heap);
+        static void destroy(ThreadCache *cache);
+
+        // 线程首次使用堆时确定所在的NUMA节点，之后都从该堆中该节点的CentralCache获取内存
+        explicit ThreadCache(Heap *heap);
+        ~ThreadCache();
+
+        ThreadCache(const ThreadCache &) = delete;
+        ThreadCache &operator=(const ThreadCache &) = delete;
+
+        // 请求size字节时使用的内存块大小（取整到大小类之前）：加固模式加上金丝雀，标记模式加上标签
+        static size_t blockSizeFor(size_t size)
         {
-            static thread_local ThreadCache instance;
-            return &instance;
+            if constexpr (HARDENED)
+            {
+                size += Hardening::CANARY_SIZE;
+            }
+            if constexpr (TAGGED)
+            {
+                size += MemoryTags::TAG_SIZE;
+            }
+            return size;
         }
 
         void *allocate(size_t size);
         void deallocate(void *ptr, size_t size);
+        // 不带大小的释放，由ptr所在的span确定大小，属于其他堆的内存交给所属的堆释放
+        void deallocate(void *ptr);
+        // 把oldSize字节的ptr调整为newSize字节，保留前min(oldSize, newSize)字节的内容
+        // 取整后的大小类不变时返回ptr；大对象优先原地调整span，见PageCache::resizeSpan()；都不行时才分配新的内存并复制
+        // ptr为nullptr时等同于allocate(newSize)，newSize为0时释放ptr并返回nullptr；失败返回nullptr，ptr仍然有效
+        void *reallocate(void *ptr, size_t oldSize, size_t newSize);
+
+        // 将所有缓存的内存块归还给中心缓存
+        void releaseAll();
+
+        // 在本线程所在节点的中心缓存中为第index个大小类准备count个内存块
+        // fillCache为true时同时把其中最多THREAD_MAX_SIZE个放入本线程的自由链表
+        bool reserve(size_t index, size_t count, bool fillCache);
+
+        // 堆销毁时调用，该堆的ThreadCache不再归还内存块
+        static void detachHeap(Heap *heap);
+
+        // 所有线程的缓存中属于heap的内存块，用于堆遍历，其他线程必须已停止使用该堆
+        static void collectCachedBlocks(const Heap *heap, std::vector<void *> &blocks);
+
+        // fork前后锁住/释放ThreadCache链表的锁
+        static void lockForFork();
+        static void unlockAfterFork();
+        // fork后在子进程中调用，子进程只剩下调用fork的线程
+        // 将其他线程的ThreadCache中缓存的内存块归还给所属的堆，并从链表中移除
+        static void reclaimAfterFork();
 
     private:
-        ThreadCache() = default;
+        // 超过MAX_BYTES的对象直接从PageCache分配整数页的span；释放时归还给分配它的PageCache
+        static void *allocateLarge(PageCache &pageCache, size_t size);
+        static void deallocateLarge(void *ptr, size_t size);
+        // 不带大小的释放中，ptr所在的span未切分时按大对象释放
+        static void deallocateSpan(Span *span, void *ptr);
+        // 分配出的内存块交给用户之前：加固模式写入金丝雀，标记模式记录标签
+        static void *onAllocate(void *ptr, size_t size, size_t blockSize);
+        // reallocate()中不需要复制的情况：大小类不变，或大对象原地调整成功；都不是时返回nullptr
+        static void *reallocateInPlace(void *ptr, size_t oldSize, size_t newSize);
+        // 原地调整大对象的span，失败返回nullptr
+        static void *resizeLarge(void *ptr, size_t size);
+        // 标记模式下size字节的ptr分配时记录的标签
+        static MemoryTag tagOf(void *ptr, size_t size);
+
+        // 将内存块放入线程本地自由链表，blockSize为大小类的块大小
+        void cacheBlock(void *ptr, size_t index, size_t blockSize);
 
         // 从中心缓存获取内存
         void *fetchFromCentralCache(size_t index);
@@ -31,13 +139,30 @@ namespace MyMemoryPool
         size_t getBatchNum(size_t size);
 
         // 判断是否需要归还内存给中心缓存
-        bool shouldReturnToCentralCache(size_t index);
+        bool shouldReturnToCentralCache(const FreeList &list) const { return list.length > list.maxLength; }
+
+        // 所属的堆要求释放内存时清空全部缓存，只在慢速路径上检查，返回是否清空了
+        bool checkReleaseEpoch();
+
+        // 线程退出或被替换的默认堆缓存放入所属节点的空槽位，没有空槽位时释放；取出node节点上任意一个停放的缓存
+        static void park(ThreadCache *cache);
+        static ThreadCache *adoptParked(size_t node);
+        // 缓存换到当前线程上，fork后据此判断缓存是否属于已不存在的线程
+        void setOwner();
 
     private:
-        // 每个线程的自由链表数组
-        // 数组的每个元素是一个指针，指向一个空闲链表，每个空闲链表的内存块大小是不同的
-        // 具体大小是  (index +1) * ALIGNMENT
-        std::array<void *, FREE_LIST_SIZE> freeList_;
-        std::array<size_t, FREE_LIST_SIZE> freeListSize_; // 自由链表大小统计
+        Heap *heap_;            // 所属的堆
+        size_t node_;           // 所属的NUMA节点
+        CentralCache *central_; // 本节点的中心缓存
+        uint64_t releaseEpoch_; // 最近一次清空时所属堆的releaseEpoch()
+
+        // 所有存在的ThreadCache组成的链表，fork后据此找到已不存在的线程的缓存
+        pthread_t owner_;
+        ThreadCache *prevCache_;
+        ThreadCache *nextCache_;
+
+        // 每个线程的自由链表数组，第index条链表的内存块大小是(index + 1) * ALIGNMENT
+        // 对象很大，只放在已清零的匿名映射中，构造函数不逐项清零，避免触碰所有页面
+        std::array<FreeList, FREE_LIST_SIZE> freeLists_;
     };
 } // namespace MyMemoryPool
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "../include/Arena.hpp"
+#include "../include/Heap.hpp"
+#include "../include/NumaTopology.hpp"
+
+namespace MyMemoryPool
+{
+    // 每个线程缓存的SPAN_PAGES页span数量上限
+    static constexpr size_t ARENA_CACHE_SPANS = 16;
+
+    // 线程本地的span缓存，创建和销毁Arena时不需要访问PageCache
+    // 只缓存默认堆的span，其他堆销毁时不必清理各线程的缓存
+    struct ArenaSpanCache
+    {
+        std::array<void *, ARENA_CACHE_SPANS> spans;
+        size_t count = 0;
+
+        ~ArenaSpanCache()
+        {
+            while (count > 0)
+            {
+                void *span = spans[--count];
+                PageMap::getInstance().get(span)->owner->deallocateSpan(span, SPAN_PAGES);
+            }
+        }
+    };
+
+    static thread_local ArenaSpanCache arenaSpanCache;
+
+    Arena::Arena() : heap_(&Heap::defaultHeap())
+    {
+    }
+
+    void Arena::rewind(const Checkpoint &checkpoint)
+    {
+        // 归还检查点之后获取的span
+        while (current_ != checkpoint.chunk)
+        {
+            assert(current_ != nullptr);
+            Chunk *prev = current_->prev;
+            size_t numPages = current_->numPages;
+            bytesReserved_ -= numPages * PageCache::PAGE_SIZE;
+            releaseSpan(current_, numPages);
+            current_ = prev;
+        }
+
+        if (current_ == nullptr)
+        {
+            ptr_ = nullptr;
+            end_ = nullptr;
+            return;
+        }
+        ptr_ = checkpoint.ptr;
+        end_ = reinterpret_cast<char *>(current_) + current_->numPages * PageCache::PAGE_SIZE;
+    }
+
+    void *Arena::allocateSlow(size_t size, size_t align)
+    {
+        // 头部之后需要留出对齐的余量，超过单个span的请求单独获取足够大的span
+        size_t needed = sizeof(Chunk) + align + size;
+        size_t numPages = SPAN_PAGES;
+        if (needed > SPAN_PAGES * PageCache::PAGE_SIZE)
+        {
+            numPages = (needed + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+        }
+
+        void *memory = acquireSpan(numPages);
+        if (memory == nullptr)
+        {
+            return nullptr;
+        }
+
+        // 新span成为当前span，旧span剩余的空间不再使用
+        Chunk *chunk = static_cast<Chunk *>(memory);
+        chunk->prev = current_;
+        chunk->numPages = numPages;
+        current_ = chunk;
+        ptr_ = reinterpret_cast<char *>(chunk + 1);
+        end_ = static_cast<char *>(memory) + numPages * PageCache::PAGE_SIZE;
+        bytesReserved_ += numPages * PageCache::PAGE_SIZE;
+
+        return allocate(size, align);
+    }
+
+    void *Arena::acquireSpan(size_t numPages)
+    {
+        bool cacheable = numPages == SPAN_PAGES && heap_ == &Heap::defaultHeap();
+        ArenaSpanCache &cache = arenaSpanCache;
+        if (cacheable && cache.count > 0)
+        {
+            return cache.spans[--cache.count];
+        }
+        size_t node = NumaTopology::getInstance().currentNode();
+        return heap_->pageCache(node).allocateSpan(numPages);
+    }
+
+    void Arena::releaseSpan(void *span, size_t numPages)
+    {
+        bool cacheable = numPages == SPAN_PAGES && heap_ == &Heap::defaultHeap();
+        ArenaSpanCache &cache = arenaSpanCache;
+        if (cacheable && cache.count < ARENA_CACHE_SPANS)
+        {
+            cache.spans[cache.count++] = span;
+            return;
+        }
+        // span可能由其他节点的线程获取，需要归还给它所属的PageCache
+        PageMap::getInstance().get(span)->owner->deallocateSpan(span, numPages);
+    }
+} // namespace MyMemoryPool
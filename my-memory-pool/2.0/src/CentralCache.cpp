@@ -1,163 +1,555 @@
 #include "../include/CentralCache.hpp"
+#include "../include/Hardening.hpp"
+#include "../include/Heap.hpp"
 #include "../include/PageCache.hpp"
 
 namespace MyMemoryPool
 {
-    // 每次从PageCache获取span大小（以页为单位）
-    static constexpr size_t SPAN_PAGES = 8;
+    // 大小类的自旋锁，获取时需要等待则计入contended
+    class FreeListLockGuard
+    {
+    public:
+        explicit FreeListLockGuard(CentralFreeList &list) : list_(list)
+        {
+            if (!list_.lock.test_and_set(std::memory_order_acquire))
+            {
+                return;
+            }
+            while (list_.lock.test_and_set(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            ++list_.contended;
+        }
+
+        ~FreeListLockGuard() { list_.lock.clear(std::memory_order_release); }
+
+        FreeListLockGuard(const FreeListLockGuard &) = delete;
+        FreeListLockGuard &operator=(const FreeListLockGuard &) = delete;
+
+    private:
+        CentralFreeList &list_;
+    };
+
+    CentralCache &CentralCache::getInstance(size_t node)
+    {
+        return Heap::defaultHeap().centralCache(node);
+    }
+
+    CentralCache::CentralCache(Heap *heap, size_t node)
+        : heap_(heap), node_(node), pageCache_(&heap->pageCache(node))
+    {
+        // 由NodeInstances在已清零的映射中构造，freeLists_已全部为空
+        // 不逐项初始化，创建堆时不必触碰整个数组
+    }
+
+    CentralCache::~CentralCache()
+    {
+        for (CentralFreeList *slab : slabs_)
+        {
+            munmap(slab, LISTS_PER_SLAB * sizeof(CentralFreeList));
+        }
+    }
+
+    CentralFreeList &CentralCache::createFreeList(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(createMutex_);
+        CentralFreeList *list = freeLists_[index].load(std::memory_order_relaxed);
+        if (list != nullptr)
+        {
+            return *list;
+        }
+
+        if (slab_ == nullptr || slabUsed_ == LISTS_PER_SLAB)
+        {
+            void *memory = mmap(nullptr, LISTS_PER_SLAB * sizeof(CentralFreeList), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED)
+            {
+                throw std::bad_alloc();
+            }
+            slab_ = static_cast<CentralFreeList *>(memory);
+            slabUsed_ = 0;
+            slabs_.push_back(slab_);
+        }
+
+        list = new (slab_ + slabUsed_++) CentralFreeList();
+        freeLists_[index].store(list, std::memory_order_release);
+        return *list;
+    }
+
+    CentralCache::ClassStats CentralCache::classStats(size_t index) const
+    {
+        const CentralFreeList *list = freeLists_[index].load(std::memory_order_acquire);
+        if (list == nullptr)
+        {
+            return {0, 0, 0, 0, 0, 0, 0, 0};
+        }
+        return {list->fetches, list->misses, list->contended, list->refills,
+                list->numSpans, list->freeBlocks, list->inUse, list->peakInUse};
+    }
 
-    void *CentralCache::fetchRange(size_t index, size_t batchNum)
+    size_t CentralCache::fetchRange(void *&start, size_t index, size_t batchNum)
     {
+        start = nullptr;
+
         // 索引检查，当索引大于等于FREE_LIST_SIZE时，说明申请内存过大应直接向系统申请
         if (index >= FREE_LIST_SIZE || batchNum == 0)
         {
-            return nullptr;
+            return 0;
+        }
+
+        size_t size = (index + 1) * ALIGNMENT;
+        CentralFreeList &list = freeList(index);
+        Span *newSpan = nullptr;
+        while (true)
+        {
+            {
+                // 自旋锁保护 作用域结束时自动释放锁
+                FreeListLockGuard lock(list);
+                if (newSpan != nullptr)
+                {
+                    insertSpan(list, newSpan);
+                    list.freeBlocks += (newSpan->bumpEnd - newSpan->bumpPtr) / size;
+                }
+                else
+                {
+                    ++list.fetches;
+                }
+                size_t count = takeBlocks(list, start, size, batchNum);
+                if (count > 0)
+                {
+                    // 在耗尽之前请补充线程准备新的span，只设置标记位
+                    if (heap_->backgroundRefill() && list.freeBlocks < refillLowWater(list, size))
+                    {
+                        std::atomic<uint64_t> &word = refillWanted_[index / 64];
+                        uint64_t bit = uint64_t(1) << (index % 64);
+                        if ((word.load(std::memory_order_relaxed) & bit) == 0)
+                        {
+                            word.fetch_or(bit, std::memory_order_relaxed);
+                        }
+                    }
+                    return count;
+                }
+                ++list.misses;
+                // 补充线程没能跟上，该大小类需要更多的储备
+                if (heap_->backgroundRefill() && list.refillSpans < MAX_REFILL_SPANS)
+                {
+                    list.refillSpans *= 2;
+                }
+            }
+
+            // 没有可用的span，从页缓存获取新的span
+            // 不持有本大小类的锁：申请内存可能很慢，内存不足时还会释放各级缓存或调用OOM处理函数
+            // 新span只记录切分信息，不预先构建链表，避免一次性触碰整个span
+            newSpan = fetchFromPageCache(size);
+            if (newSpan == nullptr)
+            {
+                return 0;
+            }
         }
+    }
 
-        // 自旋锁保护 函数作用域结束时自动释放锁
-        SpinLockGuard lock(locks_[index]);
+    // 已有的span不足batchNum个内存块时只返回现有的，不为凑满一批而申请新span
+    size_t CentralCache::takeBlocks(CentralFreeList &list, void *&start, size_t size, size_t batchNum)
+    {
+        void *head = nullptr;
+        void *tail = nullptr;
+        size_t count = 0;
 
-        void *result = nullptr;
+        // 将内存块追加到返回给ThreadCache的链表尾部
+        auto append = [&](void *block)
+        {
+            if (head == nullptr)
+            {
+                head = block;
+            }
+            else
+            {
+                setNextBlock(tail, block);
+            }
+            tail = block;
+            ++count;
+        };
 
-        try
+        while (count < batchNum && list.spans != nullptr)
         {
-            // 尝试从中心缓存获取内存块
-            result = centralFreeList_[index].load(std::memory_order_relaxed);
+            Span *span = list.spans;
 
-            // 如果中心缓存为空，从页缓存获取新的内存块
-            if (result == nullptr)
+            // 优先复用span内被回收的内存块
+            while (count < batchNum && span->freeList != nullptr)
             {
-                // 如果中心缓存为空，从页缓存获取新的内存块
-                size_t size = (index + 1) * ALIGNMENT;
-                result = fetchFromPageCache(size);
-
-                if (result == nullptr)
+                void *block = span->freeList;
+                span->freeList = nextBlock(block);
+                if constexpr (HARDENED)
                 {
-                    return nullptr;
+                    Hardening::checkFreeBlock(span->freeList, size);
                 }
+                span->useCount++;
+                append(block);
+            }
+
+            // 再从未使用过的内存中按需切分
+            while (count < batchNum && static_cast<size_t>(span->bumpEnd - span->bumpPtr) >= size)
+            {
+                void *block = span->bumpPtr;
+                span->bumpPtr += size;
+                span->useCount++;
+                append(block);
+            }
+
+            // span已无空闲块，从链表中摘除，等有内存块归还时再挂回
+            if (span->freeList == nullptr &&
+                static_cast<size_t>(span->bumpEnd - span->bumpPtr) < size)
+            {
+                eraseSpan(list, span);
+            }
+        }
+
+        if (tail != nullptr)
+        {
+            setNextBlock(tail, nullptr);
+        }
+
+        list.freeBlocks -= count;
+        list.inUse += static_cast<uint32_t>(count);
+        list.peakInUse = std::max(list.peakInUse, list.inUse);
+        start = head;
+        return count;
+    }
+
+    void CentralCache::returnRange(void *start, size_t blockNum, size_t index)
+    {
+        if (!start || index >= FREE_LIST_SIZE || blockNum == 0)
+        {
+            return;
+        }
+
+        size_t size = (index + 1) * ALIGNMENT;
+        PageMap &pageMap = PageMap::getInstance();
+
+        // 属于其他NUMA分区的内存块，按分区收集后在释放锁之后送回
+        std::array<void *, MAX_NUMA_NODES> foreignLists{};
+        std::array<size_t, MAX_NUMA_NODES> foreignNums{};
+
+        CentralFreeList &list = freeList(index);
+        {
+            // 自旋锁保护 作用域结束时自动释放锁
+            FreeListLockGuard lock(list);
 
-                // 将从PageCache获取的内存块切分成小块
-                char *start = static_cast<char *>(result);
-                size_t totalBlocks = (SPAN_PAGES * PageCache::PAGE_SIZE) / size;
-                size_t allocBlocks = std::min(batchNum, totalBlocks);
+            void *current = start;
+            size_t count = 0;
+            while (current != nullptr && count < blockNum)
+            {
+                void *next = nextBlock(current);
+                ++count;
 
-                // 构建返回给ThreadCache的内存块链表
-                if (allocBlocks > 1)
+                // 找到内存块所属的span，放回该span的自由链表
+                Span *span = pageMap.get(current);
+                if (span == nullptr || span->blockSize != size || &span->owner->heap() != heap_)
                 {
-                    // 确保至少有两个块才构建链表
-                    // 构建链表
-                    // 循环实际执行了allocBlocks-1次
-                    for (size_t i = 1; i < allocBlocks; ++i)
+                    if constexpr (HARDENED)
                     {
-                        void *current = start + (i - 1) * size;
-                        void *next = start + i * size;
-                        *reinterpret_cast<void **>(current) = next;
+                        Hardening::reportError("returned block does not belong to its size class", current);
                     }
-                    *reinterpret_cast<void **>(start + (allocBlocks - 1) * size) = nullptr;
+                    // 不是由本堆的该大小类分配的内存块，输出调试语句并跳过
+                    std::cout << "returnRange error: block does not belong to size class "
+                              << size << std::endl;
+                    current = next;
+                    continue;
                 }
 
-                // 构建保留在CentralCache的链表
-                if (totalBlocks > allocBlocks)
+                if (span->node != node_)
                 {
-                    // 指针指向剩余内存块的起始地址
-                    void *remainStart = start + allocBlocks * size;
-                    for (size_t i = allocBlocks + 1; i < totalBlocks; ++i)
-                    {
-                        void *current = start + (i - 1) * size;
-                        void *next = start + i * size;
-                        *reinterpret_cast<void **>(current) = next;
-                    }
-                    *reinterpret_cast<void **>(start + (totalBlocks - 1) * size) = nullptr;
-
-                    centralFreeList_[index].store(remainStart, std::memory_order_release);
+                    setNextBlock(current, foreignLists[span->node]);
+                    foreignLists[span->node] = current;
+                    foreignNums[span->node]++;
+                    current = next;
+                    continue;
                 }
+
+                releaseBlock(list, span, current);
+                current = next;
             }
-            else
+        }
+
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (foreignNums[node] > 0)
             {
-                // 从现有链表中获取指定数量的块
-                void *current = result;
-                void *prev = nullptr;
-                size_t count = 0;
+                heap_->centralCache(node).returnRange(foreignLists[node], foreignNums[node], index);
+            }
+        }
+    }
 
-                while (current && count < batchNum)
+    void CentralCache::releaseEmptySpans()
+    {
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            CentralFreeList *list = freeLists_[index].load(std::memory_order_acquire);
+            if (list == nullptr)
+            {
+                continue;
+            }
+            FreeListLockGuard lock(*list);
+            // 内存块全部归还的span只有在是该大小类唯一的span时才会被保留，
+            // 此外还有补充线程提前准备、尚未用到的span
+            Span *span = list->spans;
+            while (span != nullptr)
+            {
+                Span *next = span->next;
+                if (span->useCount == 0)
                 {
-                    prev = current;
-                    current = *reinterpret_cast<void **>(current);
-                    count++;
+                    releaseSpan(*list, span);
                 }
+                span = next;
+            }
+        }
+    }
 
-                // 断开链表
-                if (prev != nullptr)
+    void CentralCache::lockForFork()
+    {
+        createMutex_.lock();
+        for (auto &slot : freeLists_)
+        {
+            if (CentralFreeList *list = slot.load(std::memory_order_acquire))
+            {
+                while (list->lock.test_and_set(std::memory_order_acquire))
                 {
-                    *reinterpret_cast<void **>(prev) = nullptr;
+                    std::this_thread::yield();
                 }
+            }
+        }
+    }
 
-                // 更新中心缓存链表头
-                centralFreeList_[index].store(current, std::memory_order_release);
+    void CentralCache::unlockAfterFork()
+    {
+        for (auto &slot : freeLists_)
+        {
+            if (CentralFreeList *list = slot.load(std::memory_order_relaxed))
+            {
+                list->lock.clear(std::memory_order_release);
             }
         }
-        catch (...)
+        createMutex_.unlock();
+    }
+
+    // 将内存块放回所属span，调用者需持有list.lock
+    void CentralCache::releaseBlock(CentralFreeList &list, Span *span, void *block)
+    {
+        size_t size = span->blockSize;
+        assert(span->useCount > 0);
+
+        // span此前已无空闲块，不在链表中，需要重新挂回
+        bool wasFull = span->freeList == nullptr &&
+                       static_cast<size_t>(span->bumpEnd - span->bumpPtr) < size;
+
+        setNextBlock(block, span->freeList);
+        span->freeList = block;
+        span->useCount--;
+        list.freeBlocks++;
+        list.inUse--;
+
+        if (wasFull)
+        {
+            insertSpan(list, span);
+        }
+
+        if (span->useCount == 0)
         {
-            throw;
+            if (list.spans == span && span->next == nullptr)
+            {
+                // 该大小类只剩这一个span，保留下来避免反复向PageCache申请
+                // 重置为未切分状态，之后的分配重新从头顺序切分，局部性更好
+                span->freeList = nullptr;
+                span->bumpPtr = static_cast<char *>(span->pageAddr);
+            }
+            else
+            {
+                // span中的内存块已全部归还，交还给PageCache以便合并
+                releaseSpan(list, span);
+            }
         }
+    }
 
-        return result;
+    void CentralCache::releaseSpan(CentralFreeList &list, Span *span)
+    {
+        eraseSpan(list, span);
+        list.freeBlocks -= (span->bumpEnd - static_cast<char *>(span->pageAddr)) / span->blockSize;
+        if constexpr (HARDENED)
+        {
+            Hardening::detachBlockBits(span);
+        }
+        pageCache_->deallocateSpan(span->pageAddr, span->numPages);
     }
 
-    void CentralCache::returnRange(void *start, size_t blockNum, size_t index)
+    size_t CentralCache::spanPages(size_t size)
     {
-        if (!start || index >= FREE_LIST_SIZE || blockNum == 0)
+        // 小于等于32KB的请求，使用固定8页；大于32KB的请求，按实际需求分配
+        if (size <= SPAN_PAGES * PageCache::PAGE_SIZE)
         {
-            return;
+            return SPAN_PAGES;
+        }
+        return (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+    }
+
+    size_t CentralCache::refillLowWater(const CentralFreeList &list, size_t size)
+    {
+        // 至少为1：每个span只有一个内存块的大小类在取走最后一块时补充
+        return std::max<size_t>(list.refillSpans * (spanPages(size) * PageCache::PAGE_SIZE / size) / 2, 1);
+    }
+
+    size_t CentralCache::refillMarked()
+    {
+        size_t refilled = 0;
+        for (size_t word = 0; word < refillWanted_.size(); ++word)
+        {
+            uint64_t bits = refillWanted_[word].exchange(0, std::memory_order_relaxed);
+            while (bits != 0)
+            {
+                size_t index = word * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                refilled += refill(index);
+            }
         }
+        return refilled;
+    }
+
+    size_t CentralCache::refill(size_t index)
+    {
+        size_t size = (index + 1) * ALIGNMENT;
+        CentralFreeList &list = freeList(index);
+        size_t refilled = 0;
+        while (true)
+        {
+            {
+                FreeListLockGuard lock(list);
+                if (list.freeBlocks >= 2 * refillLowWater(list, size))
+                {
+                    return refilled;
+                }
+            }
+
+            // 与fetchRange的慢速路径相同，只是在补充线程上提前完成：
+            // 映射新的内存块和首次访问页面的缺页都发生在这里，而不是请求线程上
+            Span *span = fetchPrefaulted(size);
+            if (span == nullptr)
+            {
+                return refilled;
+            }
 
-        // 自旋锁保护 函数作用域结束时自动释放锁
-        SpinLockGuard lock(locks_[index]);
+            FreeListLockGuard lock(list);
+            insertSpan(list, span);
+            list.freeBlocks += (span->bumpEnd - span->bumpPtr) / size;
+            ++list.refills;
+            ++refilled;
+        }
+    }
 
-        try
+    bool CentralCache::reserve(size_t index, size_t count)
+    {
+        if (index >= FREE_LIST_SIZE)
+        {
+            return false;
+        }
+        size_t size = (index + 1) * ALIGNMENT;
+        CentralFreeList &list = freeList(index);
+        while (true)
         {
-            // 找到归还内存的尾指针
-            void *end = start;
-            size_t count = 1;
-            while (*reinterpret_cast<void **>(end) && count < blockNum)
             {
-                end = *reinterpret_cast<void **>(end);
-                count++;
+                FreeListLockGuard lock(list);
+                if (list.freeBlocks >= count)
+                {
+                    return true;
+                }
             }
 
-            if (count > blockNum)
+            // 内存块在分配时从bumpPtr顺序切出，不需要预先串成链表，准备好span并触碰页面即可
+            Span *span = fetchPrefaulted(size);
+            if (span == nullptr)
             {
-                // 如果归还的内存块数量大于blockNum，则输出调试语句
-                std::cout << "returnRange error: count > blockNum" << std::endl;
+                return false;
             }
+            FreeListLockGuard lock(list);
+            insertSpan(list, span);
+            list.freeBlocks += (span->bumpEnd - span->bumpPtr) / size;
+        }
+    }
 
-            // 将内存块链表插入到中心缓存
-            void *current = centralFreeList_[index].load(std::memory_order_relaxed);
-            *reinterpret_cast<void **>(end) = current;
-            centralFreeList_[index].store(start, std::memory_order_release);
+    Span *CentralCache::fetchPrefaulted(size_t size)
+    {
+        Span *span = fetchFromPageCache(size);
+        if (span == nullptr)
+        {
+            return nullptr;
         }
-        catch (...)
+        for (char *page = span->bumpPtr; page < span->bumpEnd; page += PageCache::PAGE_SIZE)
         {
-            throw;
+            // 读出再写回原值，不改变内容，只让页面真正分配
+            volatile char *byte = page;
+            *byte = *byte;
         }
+        return span;
     }
 
     // 从页缓存获取内存
-    void *CentralCache::fetchFromPageCache(size_t size)
+    Span *CentralCache::fetchFromPageCache(size_t size)
     {
         // 1. 计算实际需要的页数
-        size_t numPages = (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+        size_t numPages = spanPages(size);
 
-        // 2. 根据大小决定分配策略
-        if (size <= SPAN_PAGES * PageCache::PAGE_SIZE)
+        // 2. 向页缓存申请
+        void *memory = pageCache_->allocateSpan(numPages);
+        if (memory == nullptr)
+        {
+            return nullptr;
+        }
+
+        // 3. 记录切分信息，内存块在分配时才从bumpPtr处切出
+        Span *span = PageMap::getInstance().get(memory);
+        assert(span != nullptr && span->pageAddr == memory);
+        size_t totalBlocks = (numPages * PageCache::PAGE_SIZE) / size;
+        span->blockSize = size;
+        span->useCount = 0;
+        span->freeList = nullptr;
+        span->bumpPtr = static_cast<char *>(memory);
+        span->bumpEnd = span->bumpPtr + totalBlocks * size;
+        if constexpr (HARDENED)
+        {
+            Hardening::attachBlockBits(span, totalBlocks);
+        }
+        return span;
+    }
+
+    void CentralCache::insertSpan(CentralFreeList &list, Span *span)
+    {
+        span->prev = nullptr;
+        span->next = list.spans;
+        if (span->next != nullptr)
+        {
+            span->next->prev = span;
+        }
+        list.spans = span;
+        ++list.numSpans;
+    }
+
+    void CentralCache::eraseSpan(CentralFreeList &list, Span *span)
+    {
+        if (span->prev != nullptr)
         {
-            // 小于等于32KB的请求，使用固定8页
-            return PageCache::getInstance().allocateSpan(SPAN_PAGES);
+            span->prev->next = span->next;
         }
         else
         {
-            // 大于32KB的请求，按实际需求分配
-            return PageCache::getInstance().allocateSpan(numPages);
+            list.spans = span->next;
+        }
+        --list.numSpans;
+
+        if (span->next != nullptr)
+        {
+            span->next->prev = span->prev;
         }
+        span->next = nullptr;
+        span->prev = nullptr;
     }
-} // namespace MyMemoryPool
\ No newline at end of file
+} // namespace MyMemoryPool
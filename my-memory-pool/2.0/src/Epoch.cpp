@@ -0,0 +1,307 @@
+#include "../include/Epoch.hpp"
+#include "../include/Heap.hpp"
+#include "../include/ThreadCache.hpp"
+#include <pthread.h>
+#include <vector>
+
+namespace MyMemoryPool
+{
+    namespace
+    {
+        // 同一纪元中retire的内存块
+        struct LimboBag
+        {
+            uint64_t epoch = 0;
+            std::vector<std::pair<void *, size_t>> blocks;
+        };
+
+        // 每个线程一个，线程退出后留给新线程复用，永不释放
+        struct alignas(64) EpochRecord
+        {
+            // 其他线程读取：处于临界区时为(进入时的纪元 << 1) | 1，否则为0
+            std::atomic<uint64_t> state{0};
+            std::atomic<bool> inUse{false};
+            pthread_t owner;
+            EpochRecord *next = nullptr; // 全部记录组成的链表，只在头部插入
+
+            // 只由所属线程访问
+            uint32_t nesting = 0;
+            size_t sinceReclaim = 0;
+            // 纪元e的内存块放在bags[e % 3]中：同一时刻只有三个纪元的内存块可能还不安全
+            std::array<LimboBag, 3> bags;
+        };
+
+        struct EpochDomain
+        {
+            std::atomic<uint64_t> global{0};
+            std::atomic<EpochRecord *> records{nullptr};
+            // 已退出线程遗留的内存块，由之后调用tryReclaim()的线程释放
+            std::mutex orphanMutex;
+            std::vector<LimboBag> orphans;
+        };
+
+        // 永不析构，线程退出时仍会访问
+        EpochDomain &epochDomain()
+        {
+            static EpochDomain *domain = new EpochDomain();
+            return *domain;
+        }
+
+        void freeBlocks(std::vector<std::pair<void *, size_t>> &blocks)
+        {
+            // 线程退出时析构的对象仍可能调用retire()并触发回收，这时本线程的缓存已经停放
+            ThreadCache *cache = ThreadCache::getInstance();
+            for (const auto &[ptr, size] : blocks)
+            {
+                if (cache != nullptr)
+                {
+                    cache->deallocate(ptr, size);
+                }
+                else
+                {
+                    ThreadCache::deallocateUncached(Heap::defaultHeap(), ptr, size);
+                }
+            }
+            blocks.clear();
+        }
+
+        // 把记录中的内存块移入遗留列表，调用者持有orphanMutex
+        void orphanBags(EpochDomain &domain, EpochRecord &record)
+        {
+            for (LimboBag &bag : record.bags)
+            {
+                if (!bag.blocks.empty())
+                {
+                    domain.orphans.push_back(std::move(bag));
+                    bag.blocks.clear();
+                }
+            }
+        }
+
+        EpochRecord *acquireRecord()
+        {
+            EpochDomain &domain = epochDomain();
+            for (EpochRecord *record = domain.records.load(std::memory_order_acquire); record != nullptr;
+                 record = record->next)
+            {
+                bool expected = false;
+                if (!record->inUse.load(std::memory_order_relaxed) &&
+                    record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    record->owner = pthread_self();
+                    return record;
+                }
+            }
+
+            EpochRecord *record = new EpochRecord();
+            record->inUse.store(true, std::memory_order_relaxed);
+            record->owner = pthread_self();
+            EpochRecord *head = domain.records.load(std::memory_order_relaxed);
+            do
+            {
+                record->next = head;
+            } while (!domain.records.compare_exchange_weak(head, record, std::memory_order_release,
+                                                           std::memory_order_relaxed));
+            return record;
+        }
+
+        // 线程退出时交还记录，未释放的内存块留给其他线程
+        struct EpochRecordHolder
+        {
+            EpochRecord *record = nullptr;
+
+            ~EpochRecordHolder()
+            {
+                if (record == nullptr)
+                {
+                    return;
+                }
+                EpochDomain &domain = epochDomain();
+                record->state.store(0, std::memory_order_release);
+                record->nesting = 0;
+                record->sinceReclaim = 0;
+                {
+                    std::lock_guard<std::mutex> lock(domain.orphanMutex);
+                    orphanBags(domain, *record);
+                }
+                record->inUse.store(false, std::memory_order_release);
+            }
+        };
+
+        thread_local EpochRecordHolder epochRecordHolder;
+
+        EpochRecord &localRecord()
+        {
+            if (epochRecordHolder.record == nullptr)
+            {
+                epochRecordHolder.record = acquireRecord();
+            }
+            return *epochRecordHolder.record;
+        }
+
+        // 所有处于临界区的线程都已进入当前纪元时推进一步
+        bool tryAdvance(EpochDomain &domain)
+        {
+            uint64_t epoch = domain.global.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (EpochRecord *record = domain.records.load(std::memory_order_acquire); record != nullptr;
+                 record = record->next)
+            {
+                uint64_t state = record->state.load(std::memory_order_relaxed);
+                if ((state & 1) != 0 && (state >> 1) != epoch)
+                {
+                    return false;
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return domain.global.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+        }
+    } // namespace
+
+    void Epoch::enter()
+    {
+        EpochRecord &record = localRecord();
+        if (record.nesting++ == 0)
+        {
+            uint64_t epoch = epochDomain().global.load(std::memory_order_relaxed);
+            record.state.store((epoch << 1) | 1, std::memory_order_relaxed);
+            // 之后对共享节点的读取不能早于声明进入临界区
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void Epoch::exit()
+    {
+        EpochRecord &record = localRecord();
+        assert(record.nesting > 0);
+        if (--record.nesting == 0)
+        {
+            record.state.store(0, std::memory_order_release);
+        }
+    }
+
+    void Epoch::retire(void *ptr, size_t size)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+        EpochRecord &record = localRecord();
+        // 节点的摘除必须先于读取纪元
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = epochDomain().global.load(std::memory_order_relaxed);
+
+        LimboBag &bag = record.bags[epoch % 3];
+        if (bag.epoch != epoch)
+        {
+            // 原有的内存块至少早三个纪元，已经安全
+            freeBlocks(bag.blocks);
+            bag.epoch = epoch;
+        }
+        bag.blocks.emplace_back(ptr, size);
+
+        if (++record.sinceReclaim >= RECLAIM_THRESHOLD)
+        {
+            record.sinceReclaim = 0;
+            tryReclaim();
+        }
+    }
+
+    bool Epoch::tryReclaim()
+    {
+        EpochDomain &domain = epochDomain();
+        bool advanced = tryAdvance(domain);
+        uint64_t epoch = domain.global.load(std::memory_order_acquire);
+
+        // 纪元e的内存块在全局纪元达到e + 2后安全：此时所有临界区都开始于它被摘除之后
+        EpochRecord &record = localRecord();
+        for (LimboBag &bag : record.bags)
+        {
+            if (bag.epoch + 2 <= epoch)
+            {
+                freeBlocks(bag.blocks);
+            }
+        }
+
+        // 在锁外释放遗留的内存块，orphanMutex不与分配器的锁嵌套
+        std::vector<LimboBag> safe;
+        if (domain.orphanMutex.try_lock())
+        {
+            for (auto it = domain.orphans.begin(); it != domain.orphans.end();)
+            {
+                if (it->epoch + 2 <= epoch)
+                {
+                    safe.push_back(std::move(*it));
+                    it = domain.orphans.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            domain.orphanMutex.unlock();
+        }
+        for (LimboBag &bag : safe)
+        {
+            freeBlocks(bag.blocks);
+        }
+        return advanced;
+    }
+
+    void Epoch::drain()
+    {
+        assert(localRecord().nesting == 0);
+        while (pending() > 0)
+        {
+            if (!tryReclaim())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    uint64_t Epoch::current()
+    {
+        return epochDomain().global.load(std::memory_order_relaxed);
+    }
+
+    size_t Epoch::pending()
+    {
+        size_t count = 0;
+        for (const LimboBag &bag : localRecord().bags)
+        {
+            count += bag.blocks.size();
+        }
+        return count;
+    }
+
+    void Epoch::lockForFork()
+    {
+        epochDomain().orphanMutex.lock();
+    }
+
+    void Epoch::unlockAfterFork()
+    {
+        epochDomain().orphanMutex.unlock();
+    }
+
+    void Epoch::reclaimAfterFork()
+    {
+        EpochDomain &domain = epochDomain();
+        std::lock_guard<std::mutex> lock(domain.orphanMutex);
+        pthread_t self = pthread_self();
+        for (EpochRecord *record = domain.records.load(std::memory_order_acquire); record != nullptr;
+             record = record->next)
+        {
+            if (record->inUse.load(std::memory_order_relaxed) && !pthread_equal(record->owner, self))
+            {
+                // 所属的线程在子进程中不存在，不再阻止纪元推进
+                record->state.store(0, std::memory_order_relaxed);
+                record->nesting = 0;
+                record->sinceReclaim = 0;
+                orphanBags(domain, *record);
+                record->inUse.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+} // namespace MyMemoryPool
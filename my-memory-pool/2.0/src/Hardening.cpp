@@ -0,0 +1,272 @@
+#include "../include/Hardening.hpp"
+#include "../include/MemoryTag.hpp"
+#include "../include/PageCache.hpp"
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <random>
+
+namespace MyMemoryPool
+{
+    // 每个span最多需要的状态位字数，按最小的内存块计算
+    static constexpr size_t BLOCK_BITS_WORDS = SPAN_PAGES * PageCache::PAGE_SIZE / ALIGNMENT / 64;
+
+    uintptr_t freeListSecret()
+    {
+        static const uintptr_t secret = []()
+        {
+            std::random_device rd;
+            uintptr_t value = (static_cast<uintptr_t>(rd()) << 32) ^ rd();
+            // 保证密钥非零且低位不全为0，编码后的nullptr不会仍是nullptr
+            return value | 1;
+        }();
+        return secret;
+    }
+
+    void Hardening::onAllocate(void *ptr, size_t size, size_t blockSize)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr || span->blockBits == nullptr || span->blockSize != blockSize)
+        {
+            reportError("allocated block does not belong to its size class", ptr);
+        }
+
+        size_t blockIndex = (static_cast<char *>(ptr) - static_cast<char *>(span->pageAddr)) / blockSize;
+        uint64_t mask = uint64_t(1) << (blockIndex % 64);
+        uint64_t old = span->blockBits[blockIndex / 64].fetch_or(mask, std::memory_order_relaxed);
+        if (old & mask)
+        {
+            reportError("free list returned a block that is still in use", ptr);
+        }
+
+        // 金丝雀紧跟在用户数据之后，越界写入一个字节也能发现
+        uint64_t canary = canaryFor(ptr);
+        memcpy(static_cast<char *>(ptr) + size, &canary, CANARY_SIZE);
+    }
+
+    void Hardening::onDeallocate(void *ptr, size_t size, size_t blockSize, bool checkCanary)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr || !span->isUse || span->blockSize == 0 || span->blockBits == nullptr)
+        {
+            reportError("free of a pointer that was not allocated by the pool", ptr);
+        }
+        if (span->blockSize != blockSize)
+        {
+            reportError("free with a size that does not match the allocation", ptr);
+        }
+
+        size_t offset = static_cast<char *>(ptr) - static_cast<char *>(span->pageAddr);
+        if (offset % blockSize != 0)
+        {
+            reportError("free of a pointer into the middle of a block", ptr);
+        }
+
+        size_t blockIndex = offset / blockSize;
+        uint64_t mask = uint64_t(1) << (blockIndex % 64);
+        uint64_t old = span->blockBits[blockIndex / 64].fetch_and(~mask, std::memory_order_relaxed);
+        if (!(old & mask))
+        {
+            reportError("double free", ptr);
+        }
+
+        if (!checkCanary)
+        {
+            return;
+        }
+        uint64_t canary;
+        memcpy(&canary, static_cast<char *>(ptr) + size, CANARY_SIZE);
+        if (canary != canaryFor(ptr))
+        {
+            reportError("heap buffer overflow: canary after the block was overwritten", ptr);
+        }
+    }
+
+    void Hardening::checkFreeBlock(void *block, size_t blockSize)
+    {
+        if (block == nullptr)
+        {
+            return;
+        }
+
+        // 被释放后写入的内存块，其next指针解码后基本不可能仍指向同一大小类的块边界
+        Span *span = PageMap::getInstance().get(block);
+        if (span == nullptr || span->blockSize != blockSize ||
+            (static_cast<char *>(block) - static_cast<char *>(span->pageAddr)) % blockSize != 0)
+        {
+            reportError("free list corrupted (write after free?)", block);
+        }
+    }
+
+    void Hardening::attachBlockBits(Span *span, size_t totalBlocks)
+    {
+        assert(totalBlocks <= BLOCK_BITS_WORDS * 64);
+        (void)totalBlocks;
+        if (span->blockBits == nullptr)
+        {
+            span->blockBits = new std::atomic<uint64_t>[BLOCK_BITS_WORDS]();
+        }
+    }
+
+    void Hardening::detachBlockBits(Span *span)
+    {
+        if (span->blockBits == nullptr)
+        {
+            return;
+        }
+        for (size_t i = 0; i < BLOCK_BITS_WORDS; ++i)
+        {
+            span->blockBits[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // 大对象隔离区
+    static std::mutex quarantineMutex;
+    static std::deque<std::pair<void *, size_t>> quarantine; // 按释放顺序排列的映射区域
+    static std::map<char *, size_t> quarantineMap;           // 映射起始地址到大小，用于发现重复释放
+    static size_t quarantineBytes = 0;
+    static size_t quarantineLimit = 0;
+
+    // 按释放顺序归还隔离区中的映射，直到总量不超过上限，调用者需持有quarantineMutex
+    static void trimQuarantine()
+    {
+        while (quarantineBytes > quarantineLimit && !quarantine.empty())
+        {
+            auto [base, mapSize] = quarantine.front();
+            quarantine.pop_front();
+            quarantineMap.erase(static_cast<char *>(base));
+            quarantineBytes -= mapSize;
+            munmap(base, mapSize);
+        }
+    }
+
+    // 对象之前留出记录大小的空间
+    size_t Hardening::largeObjectPages(size_t size)
+    {
+        const size_t pageSize = PageCache::PAGE_SIZE;
+        // 对象之前记录大小，标记模式下再记录标签
+        size_t header = TAGGED ? 2 * sizeof(size_t) : sizeof(size_t);
+        return (SizeClass::roundUp(size) + header + pageSize - 1) / pageSize;
+    }
+
+    void *Hardening::allocateLarge(size_t size)
+    {
+        const size_t pageSize = PageCache::PAGE_SIZE;
+        size_t objectPages = largeObjectPages(size);
+        size_t mapSize = (objectPages + 1) * pageSize;
+
+        void *ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        // 最后一页作为保护页
+        char *base = static_cast<char *>(ptr);
+        if (mprotect(base + objectPages * pageSize, pageSize, PROT_NONE) != 0)
+        {
+            munmap(ptr, mapSize);
+            return nullptr;
+        }
+
+        // 对象的末尾紧贴保护页
+        char *object = base + objectPages * pageSize - SizeClass::roundUp(size);
+        reinterpret_cast<size_t *>(object)[-1] = size;
+        if constexpr (TAGGED)
+        {
+            reinterpret_cast<size_t *>(object)[-2] = MemoryTags::onAllocateLarge(SizeClass::roundUp(size));
+        }
+        return object;
+    }
+
+    // 隔离区中的映射不可访问，必须在读取对象之前的大小之前检查
+    static bool inQuarantine(void *ptr)
+    {
+        auto it = quarantineMap.upper_bound(static_cast<char *>(ptr));
+        if (it == quarantineMap.begin())
+        {
+            return false;
+        }
+        --it;
+        return static_cast<char *>(ptr) < it->first + it->second;
+    }
+
+    void Hardening::deallocateLarge(void *ptr, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(quarantineMutex);
+        if (inQuarantine(ptr))
+        {
+            reportError("double free of a large object", ptr);
+        }
+        if (reinterpret_cast<size_t *>(ptr)[-1] != size)
+        {
+            reportError("free of a large object with a mismatched size", ptr);
+        }
+        releaseLarge(ptr, size);
+    }
+
+    void Hardening::deallocateLarge(void *ptr)
+    {
+        std::lock_guard<std::mutex> lock(quarantineMutex);
+        if (inQuarantine(ptr))
+        {
+            reportError("double free of a large object", ptr);
+        }
+        releaseLarge(ptr, reinterpret_cast<size_t *>(ptr)[-1]);
+    }
+
+    void Hardening::releaseLarge(void *ptr, size_t size)
+    {
+        const size_t pageSize = PageCache::PAGE_SIZE;
+        size_t objectPages = largeObjectPages(size);
+        size_t mapSize = (objectPages + 1) * pageSize;
+
+        char *base = static_cast<char *>(ptr) + SizeClass::roundUp(size) - objectPages * pageSize;
+        if (reinterpret_cast<uintptr_t>(base) % pageSize != 0)
+        {
+            reportError("free of a pointer that was not allocated as a large object", ptr);
+        }
+        if constexpr (TAGGED)
+        {
+            MemoryTags::onDeallocateLarge(static_cast<MemoryTag>(reinterpret_cast<size_t *>(ptr)[-2]),
+                                          SizeClass::roundUp(size));
+        }
+
+        if (quarantineLimit == 0)
+        {
+            munmap(base, mapSize);
+            return;
+        }
+
+        // 放入隔离区，任何访问都会触发SIGSEGV
+        mprotect(base, objectPages * pageSize, PROT_NONE);
+        quarantine.emplace_back(base, mapSize);
+        quarantineMap.emplace(base, mapSize);
+        quarantineBytes += mapSize;
+        trimQuarantine();
+    }
+
+    void Hardening::setQuarantineLimit(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(quarantineMutex);
+        quarantineLimit = bytes;
+        trimQuarantine();
+    }
+
+    void Hardening::lockForFork()
+    {
+        quarantineMutex.lock();
+    }
+
+    void Hardening::unlockAfterFork()
+    {
+        quarantineMutex.unlock();
+    }
+
+    void Hardening::reportError(const char *message, const void *ptr)
+    {
+        fprintf(stderr, "MemoryPool error: %s (address %p)\n", message, ptr);
+        abort();
+    }
+} // namespace MyMemoryPool
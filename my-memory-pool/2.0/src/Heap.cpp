@@ -0,0 +1,679 @@
+#include "../include/Heap.hpp"
+#include "../include/Epoch.hpp"
+#include "../include/Hardening.hpp"
+#include "../include/ThreadCache.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <new>
+#include <pthread.h>
+#include <vector>
+
+namespace MyMemoryPool
+{
+    // 所有存活的堆，按编号索引，编号0是默认堆
+    struct HeapRegistry
+    {
+        std::mutex mutex;
+        std::vector<Heap *> heaps;
+        std::vector<size_t> freeIds;
+        uint64_t nextGeneration = 1;
+    };
+
+    // 永不析构，线程退出时仍可能访问
+    static HeapRegistry &heapRegistry()
+    {
+        static HeapRegistry *registry = new HeapRegistry();
+        return *registry;
+    }
+
+    // 当前线程在各个堆中的ThreadCache，按堆编号索引（默认堆使用ThreadCache::getInstance()）
+    // generation与堆不符时说明原来的堆已销毁，其中缓存的内存块已随堆归还，只需释放ThreadCache本身
+    // HeapThreadCaches已析构：之后析构的线程局部对象仍可能使用堆，这时不再访问entries，也不再创建缓存
+    static thread_local bool heapCachesExiting = false;
+
+    struct HeapThreadCaches
+    {
+        struct Entry
+        {
+            uint64_t generation = 0;
+            ThreadCache *cache = nullptr;
+        };
+        std::vector<Entry> entries;
+
+        // 线程退出时将缓存的内存块还给仍然存在的堆
+        // 持有注册表的锁，保证归还期间堆不会被销毁
+        ~HeapThreadCaches()
+        {
+            heapCachesExiting = true;
+            HeapRegistry &registry = heapRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (size_t id = 0; id < entries.size(); ++id)
+            {
+                Entry &entry = entries[id];
+                if (entry.cache == nullptr)
+                {
+                    continue;
+                }
+                Heap *heap = registry.heaps[id];
+                if (heap != nullptr && heap->generation_ == entry.generation)
+                {
+                    entry.cache->releaseAll();
+                }
+                ThreadCache::destroy(entry.cache);
+            }
+        }
+    };
+
+    static thread_local HeapThreadCaches heapThreadCaches;
+
+    struct Heap::RefillWorker
+    {
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::chrono::microseconds interval;
+        bool stop = false;
+        std::thread thread;
+    };
+
+    Heap::Heap(PageSource &source) : pageSource_(&source)
+    {
+        HeapRegistry &registry = heapRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        generation_ = registry.nextGeneration++;
+        if (!registry.freeIds.empty())
+        {
+            id_ = registry.freeIds.back();
+            registry.freeIds.pop_back();
+        }
+        else
+        {
+            id_ = registry.heaps.size();
+            registry.heaps.push_back(nullptr);
+        }
+        registry.heaps[id_] = this;
+    }
+
+    Heap *Heap::create(PageSource &source)
+    {
+        // 保证默认堆占用编号0
+        defaultHeap();
+        return new Heap(source);
+    }
+
+    Heap &Heap::defaultHeap()
+    {
+        // 永不析构，静态对象析构之后仍可能有代码释放内存
+        static Heap *heap = []()
+        {
+            pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+            return new Heap(systemPageSource());
+        }();
+        return *heap;
+    }
+
+    Heap &Heap::longLivedHeap()
+    {
+        static Heap *heap = create();
+        return *heap;
+    }
+
+    // 没有ThreadCache时（线程正在退出，或无法创建）不经过线程缓存，直接使用中心缓存和页缓存
+    void *Heap::allocate(size_t size)
+    {
+        ThreadCache *cache = threadCache();
+        return cache != nullptr ? cache->allocate(size) : ThreadCache::allocateUncached(*this, size);
+    }
+
+    void Heap::deallocate(void *ptr)
+    {
+        if (ThreadCache *cache = threadCache())
+        {
+            cache->deallocate(ptr);
+            return;
+        }
+        ThreadCache::deallocateUncached(ptr);
+    }
+
+    void Heap::deallocate(void *ptr, size_t size)
+    {
+        if (ThreadCache *cache = threadCache())
+        {
+            cache->deallocate(ptr, size);
+            return;
+        }
+        ThreadCache::deallocateUncached(*this, ptr, size);
+    }
+
+    void *Heap::reallocate(void *ptr, size_t oldSize, size_t newSize)
+    {
+        ThreadCache *cache = threadCache();
+        return cache != nullptr ? cache->reallocate(ptr, oldSize, newSize)
+                                : ThreadCache::reallocateUncached(*this, ptr, oldSize, newSize);
+    }
+
+    void Heap::destroy()
+    {
+        assert(id_ != 0 && "the default heap cannot be destroyed");
+        if (id_ == 0)
+        {
+            return;
+        }
+
+        stopRefillWorker();
+
+        // 其他线程的ThreadCache不能再归还内存块（包括fork后子进程的回收）
+        ThreadCache::detachHeap(this);
+
+        // 当前线程的ThreadCache立即释放，其他线程的在下次访问或线程退出时释放
+        std::vector<HeapThreadCaches::Entry> &entries = heapThreadCaches.entries;
+        if (id_ < entries.size() && entries[id_].generation == generation_)
+        {
+            ThreadCache::destroy(entries[id_].cache);
+            entries[id_] = {};
+        }
+
+        {
+            HeapRegistry &registry = heapRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.heaps[id_] = nullptr;
+            registry.freeIds.push_back(id_);
+        }
+
+        // PageCache析构时归还全部内存块
+        delete this;
+    }
+
+    void Heap::setMemoryLimits(size_t softLimit, size_t hardLimit)
+    {
+        softLimit_.store(softLimit, std::memory_order_relaxed);
+        hardLimit_.store(hardLimit, std::memory_order_relaxed);
+    }
+
+    void Heap::setOomHandler(OomHandler handler)
+    {
+        oomHandler_.store(handler, std::memory_order_relaxed);
+    }
+
+    void Heap::releaseMemory()
+    {
+        // 其他线程的ThreadCache只能由线程自己清空
+        releaseEpoch_.fetch_add(1, std::memory_order_relaxed);
+
+        // 停放的ThreadCache不属于任何线程，直接释放
+        if (id_ == 0)
+        {
+            ThreadCache::releaseParked();
+        }
+
+        // 先让CentralCache交还span，PageCache才能合并出整块空闲的内存块
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (CentralCache *central = centralCaches_.find(node))
+            {
+                central->releaseEmptySpans();
+            }
+        }
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (PageCache *pageCache = pageCaches_.find(node))
+            {
+                pageCache->releaseFreeMemory();
+            }
+        }
+    }
+
+    bool Heap::reserve(size_t size, size_t count, bool fillThreadCache)
+    {
+        // 与ThreadCache::allocate()使用相同的块大小
+        size_t blockSize = ThreadCache::blockSizeFor(std::max(size, ALIGNMENT));
+        if (blockSize > MAX_BYTES)
+        {
+            return false;
+        }
+        ThreadCache *cache = threadCache();
+        return cache != nullptr && cache->reserve(SizeClass::getIndex(blockSize), count, fillThreadCache);
+    }
+
+    bool Heap::warmup(const WarmupProfile &profile, bool fillThreadCache)
+    {
+        ThreadCache *cache = threadCache();
+        if (cache == nullptr)
+        {
+            return false;
+        }
+        bool reserved = true;
+        for (const WarmupProfile::Entry &entry : profile.entries)
+        {
+            if (entry.blockSize == 0 || entry.blockSize > MAX_BYTES)
+            {
+                reserved = false;
+                continue;
+            }
+            reserved &= cache->reserve(SizeClass::getIndex(entry.blockSize), entry.count, fillThreadCache);
+        }
+        return reserved;
+    }
+
+    WarmupProfile Heap::captureProfile() const
+    {
+        WarmupProfile profile;
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            size_t count = 0;
+            for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+            {
+                if (CentralCache *central = centralCaches_.find(node))
+                {
+                    count += central->classStats(index).peakInUse;
+                }
+            }
+            if (count > 0)
+            {
+                profile.entries.push_back({(index + 1) * ALIGNMENT, count});
+            }
+        }
+        return profile;
+    }
+
+    bool WarmupProfile::save(const std::string &path) const
+    {
+        std::ofstream file(path);
+        for (const Entry &entry : entries)
+        {
+            file << entry.blockSize << ' ' << entry.count << '\n';
+        }
+        return static_cast<bool>(file.flush());
+    }
+
+    WarmupProfile WarmupProfile::load(const std::string &path)
+    {
+        WarmupProfile profile;
+        std::ifstream file(path);
+        Entry entry;
+        while (file >> entry.blockSize >> entry.count)
+        {
+            profile.entries.push_back(entry);
+        }
+        if (!file.eof())
+        {
+            profile.entries.clear();
+        }
+        return profile;
+    }
+
+    size_t HeapSummary::liveBlocks() const
+    {
+        size_t count = largeBlocks;
+        for (const SizeClassUsage &usage : classes)
+        {
+            count += usage.liveBlocks;
+        }
+        return count;
+    }
+
+    size_t HeapSummary::liveBytes() const
+    {
+        size_t bytes = largeBytes;
+        for (const SizeClassUsage &usage : classes)
+        {
+            bytes += usage.liveBlocks * usage.blockSize;
+        }
+        return bytes;
+    }
+
+    template <typename Visitor>
+    void Heap::visitSpans(Visitor &&visitor)
+    {
+        lockForFork();
+        // ThreadCache中的内存块只能从链表中找到，先收集并排序，之后按span的地址范围查找
+        std::vector<void *> cached;
+        ThreadCache::collectCachedBlocks(this, cached);
+        std::sort(cached.begin(), cached.end(), std::less<void *>());
+        auto visit = [&](Span *span, bool free)
+        {
+            void *begin = span->pageAddr;
+            void *end = static_cast<char *>(begin) + span->numPages * PageCache::PAGE_SIZE;
+            auto first = std::lower_bound(cached.begin(), cached.end(), begin, std::less<void *>());
+            auto last = std::lower_bound(first, cached.end(), end, std::less<void *>());
+            visitor(span, free, first, last);
+        };
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (PageCache *pageCache = pageCaches_.find(node))
+            {
+                pageCache->forEachSpan(visit);
+            }
+        }
+        unlockAfterFork();
+    }
+
+    void Heap::walkBlocks(BlockCallback callback, void *context)
+    {
+        std::vector<BlockState> states; // 当前span中已切分的每个内存块的状态，在span之间复用
+        auto visit = [&](Span *span, bool free, auto cachedBegin, auto cachedEnd)
+        {
+            char *begin = static_cast<char *>(span->pageAddr);
+            size_t bytes = span->numPages * PageCache::PAGE_SIZE;
+            if (free || span->blockSize == 0)
+            {
+                callback(context, begin, bytes, free ? BlockState::Free : BlockState::Live);
+                return;
+            }
+
+            // 已切分的内存块先视为已分配，再标出span自由链表和ThreadCache中的空闲块
+            size_t size = span->blockSize;
+            size_t carved = (span->bumpPtr - begin) / size;
+            size_t total = (span->bumpEnd - begin) / size;
+            states.assign(carved, BlockState::Live);
+            for (void *block = span->freeList; block != nullptr; block = nextBlock(block))
+            {
+                states[(static_cast<char *>(block) - begin) / size] = BlockState::Free;
+            }
+            for (auto it = cachedBegin; it != cachedEnd; ++it)
+            {
+                states[(static_cast<char *>(*it) - begin) / size] = BlockState::Cached;
+            }
+            for (size_t i = 0; i < carved; ++i)
+            {
+                callback(context, begin + i * size, size, states[i]);
+            }
+            for (size_t i = carved; i < total; ++i)
+            {
+                callback(context, begin + i * size, size, BlockState::Free);
+            }
+        };
+        visitSpans(visit);
+    }
+
+    HeapSummary Heap::summarize()
+    {
+        HeapSummary summary;
+        std::map<size_t, HeapSummary::SizeClassUsage> classes;
+        auto visit = [&](Span *span, bool free, auto cachedBegin, auto cachedEnd)
+        {
+            ++summary.spans;
+            size_t bytes = span->numPages * PageCache::PAGE_SIZE;
+            if (free)
+            {
+                summary.freeBytes += bytes;
+                return;
+            }
+            if (span->blockSize == 0)
+            {
+                ++summary.largeBlocks;
+                summary.largeBytes += bytes;
+                return;
+            }
+
+            // useCount包括被ThreadCache缓存的内存块
+            HeapSummary::SizeClassUsage &usage = classes[span->blockSize];
+            usage.blockSize = span->blockSize;
+            size_t cached = cachedEnd - cachedBegin;
+            size_t total = (span->bumpEnd - static_cast<char *>(span->pageAddr)) / span->blockSize;
+            usage.cachedBlocks += cached;
+            usage.liveBlocks += span->useCount - cached;
+            usage.freeBlocks += total - span->useCount;
+        };
+        visitSpans(visit);
+        for (const auto &[blockSize, usage] : classes)
+        {
+            summary.classes.push_back(usage);
+        }
+        return summary;
+    }
+
+    void Heap::reportLeaks(std::ostream &out)
+    {
+        HeapSummary summary = summarize();
+        out << "MemoryPool: " << summary.liveBlocks() << " blocks (" << summary.liveBytes()
+            << " bytes) still in use\n";
+
+        // 按占用字节数从多到少输出
+        std::vector<HeapSummary::SizeClassUsage> classes;
+        for (const HeapSummary::SizeClassUsage &usage : summary.classes)
+        {
+            if (usage.liveBlocks > 0)
+            {
+                classes.push_back(usage);
+            }
+        }
+        auto moreBytes = [](const HeapSummary::SizeClassUsage &a, const HeapSummary::SizeClassUsage &b)
+        {
+            return a.liveBlocks * a.blockSize > b.liveBlocks * b.blockSize;
+        };
+        std::sort(classes.begin(), classes.end(), moreBytes);
+        for (const HeapSummary::SizeClassUsage &usage : classes)
+        {
+            out << "  size " << usage.blockSize << ": " << usage.liveBlocks << " blocks, "
+                << usage.liveBlocks * usage.blockSize << " bytes\n";
+        }
+        if (summary.largeBlocks > 0)
+        {
+            out << "  large: " << summary.largeBlocks << " blocks, " << summary.largeBytes << " bytes\n";
+        }
+    }
+
+    void Heap::startRefillWorker(std::chrono::microseconds interval)
+    {
+        if (RefillWorker *worker = refillWorker_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->interval = interval;
+            return;
+        }
+        RefillWorker *worker = new RefillWorker();
+        worker->interval = interval;
+        worker->thread = std::thread([this, worker]()
+                                     { runRefillWorker(*worker); });
+        refillWorker_.store(worker, std::memory_order_relaxed);
+    }
+
+    void Heap::stopRefillWorker()
+    {
+        RefillWorker *worker = refillWorker_.exchange(nullptr, std::memory_order_relaxed);
+        if (worker == nullptr)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stop = true;
+        }
+        worker->wakeup.notify_one();
+        worker->thread.join();
+        delete worker;
+    }
+
+    void Heap::runRefillWorker(RefillWorker &worker)
+    {
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        while (!worker.stop)
+        {
+            lock.unlock();
+            for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+            {
+                if (CentralCache *central = centralCaches_.find(node))
+                {
+                    central->refillMarked();
+                }
+            }
+            lock.lock();
+            worker.wakeup.wait_for(lock, worker.interval, [&worker]()
+                                   { return worker.stop; });
+        }
+    }
+
+    bool Heap::reserveMappedBytes(size_t bytes)
+    {
+        size_t hardLimit = hardLimit_.load(std::memory_order_relaxed);
+        size_t mapped = mappedBytes_.load(std::memory_order_relaxed);
+        do
+        {
+            if (hardLimit != 0 && mapped + bytes > hardLimit)
+            {
+                return false;
+            }
+        } while (!mappedBytes_.compare_exchange_weak(mapped, mapped + bytes, std::memory_order_relaxed));
+
+        size_t softLimit = softLimit_.load(std::memory_order_relaxed);
+        if (softLimit != 0 && mapped + bytes > softLimit)
+        {
+            releaseMemory();
+        }
+        return true;
+    }
+
+    void Heap::unreserveMappedBytes(size_t bytes)
+    {
+        mappedBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    bool Heap::handleOutOfMemory(size_t bytes, size_t attempt)
+    {
+        // 第一次失败时先释放本堆的缓存，之后每次失败都询问处理函数
+        if (attempt == 0)
+        {
+            releaseMemory();
+            return true;
+        }
+        OomHandler handler = oomHandler_.load(std::memory_order_relaxed);
+        return handler != nullptr && handler(*this, bytes);
+    }
+
+    void Heap::prepareFork()
+    {
+        HeapRegistry &registry = heapRegistry();
+        registry.mutex.lock();
+        for (Heap *heap : registry.heaps)
+        {
+            if (heap != nullptr)
+            {
+                heap->lockForFork();
+            }
+        }
+        PageMap::getInstance().lockForFork();
+        Hardening::lockForFork();
+        ThreadCache::lockForFork();
+        Epoch::lockForFork();
+    }
+
+    void Heap::parentAfterFork()
+    {
+        HeapRegistry &registry = heapRegistry();
+        Epoch::unlockAfterFork();
+        ThreadCache::unlockAfterFork();
+        Hardening::unlockAfterFork();
+        PageMap::getInstance().unlockAfterFork();
+        for (auto it = registry.heaps.rbegin(); it != registry.heaps.rend(); ++it)
+        {
+            if (*it != nullptr)
+            {
+                (*it)->unlockAfterFork();
+            }
+        }
+        registry.mutex.unlock();
+    }
+
+    void Heap::childAfterFork()
+    {
+        // 子进程中唯一的线程就是获取这些锁的线程，可以直接释放
+        parentAfterFork();
+        ThreadCache::reclaimAfterFork();
+        Epoch::reclaimAfterFork();
+
+        // 补充线程没有被复制到子进程，其对象无法析构（std::thread仍认为线程可以join），直接丢弃
+        for (Heap *heap : heapRegistry().heaps)
+        {
+            if (heap != nullptr)
+            {
+                heap->refillWorker_.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 实例创建时CentralCache的构造函数会获取PageCache的实例，因此先锁centralCaches_
+    void Heap::lockForFork()
+    {
+        centralCaches_.lockForFork();
+        pageCaches_.lockForFork();
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (CentralCache *central = centralCaches_.find(node))
+            {
+                central->lockForFork();
+            }
+        }
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (PageCache *pageCache = pageCaches_.find(node))
+            {
+                pageCache->lockForFork();
+            }
+        }
+    }
+
+    void Heap::unlockAfterFork()
+    {
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (PageCache *pageCache = pageCaches_.find(node))
+            {
+                pageCache->unlockAfterFork();
+            }
+        }
+        for (size_t node = 0; node < MAX_NUMA_NODES; ++node)
+        {
+            if (CentralCache *central = centralCaches_.find(node))
+            {
+                central->unlockAfterFork();
+            }
+        }
+        pageCaches_.unlockAfterFork();
+        centralCaches_.unlockAfterFork();
+    }
+
+    ThreadCache *Heap::threadCache()
+    {
+        if (id_ == 0)
+        {
+            return ThreadCache::getInstance();
+        }
+        // 返回nullptr时调用者改用ThreadCache::allocateUncached()等，见Heap::allocate()
+        if (heapCachesExiting)
+        {
+            return nullptr;
+        }
+        std::vector<HeapThreadCaches::Entry> &entries = heapThreadCaches.entries;
+        if (id_ < entries.size() && entries[id_].generation == generation_)
+        {
+            return entries[id_].cache;
+        }
+        return createThreadCache();
+    }
+
+    ThreadCache *Heap::createThreadCache()
+    {
+        std::vector<HeapThreadCaches::Entry> &entries = heapThreadCaches.entries;
+        if (id_ >= entries.size())
+        {
+            entries.resize(id_ + 1);
+        }
+
+        HeapThreadCaches::Entry &entry = entries[id_];
+        if (entry.cache != nullptr)
+        {
+            // 同一编号之前的堆已被销毁
+            ThreadCache::destroy(entry.cache);
+            entry = {};
+        }
+
+        entry.cache = ThreadCache::create(this);
+        if (entry.cache != nullptr)
+        {
+            entry.generation = generation_;
+        }
+        return entry.cache;
+    }
+} // namespace MyMemoryPool
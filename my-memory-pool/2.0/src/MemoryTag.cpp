@@ -0,0 +1,113 @@
+#include "../include/MemoryTag.hpp"
+
+namespace MyMemoryPool
+{
+    // 线程退出时交还分片，计数保留在其中，继续参与合并
+    struct MemoryTags::ShardReleaser
+    {
+        Shard *shard = nullptr;
+
+        ~ShardReleaser()
+        {
+            shardReleased_ = true;
+            shard_ = nullptr;
+            if (shard != nullptr)
+            {
+                shard->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    thread_local MemoryTags::ShardReleaser MemoryTags::shardReleaser_;
+
+    std::atomic<MemoryTags::Shard *> &MemoryTags::shards()
+    {
+        // 永不析构，线程退出时仍会访问
+        static std::atomic<Shard *> *head = new std::atomic<Shard *>(nullptr);
+        return *head;
+    }
+
+    MemoryTags::Shard *MemoryTags::acquireShard()
+    {
+        if (shardReleased_)
+        {
+            return nullptr;
+        }
+
+        std::atomic<Shard *> &list = shards();
+        Shard *shard = nullptr;
+        for (Shard *it = list.load(std::memory_order_acquire); it != nullptr; it = it->next)
+        {
+            bool expected = false;
+            if (!it->inUse.load(std::memory_order_relaxed) &&
+                it->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                shard = it;
+                break;
+            }
+        }
+
+        if (shard == nullptr)
+        {
+            shard = newShard();
+        }
+
+        shardReleaser_.shard = shard;
+        shard_ = shard;
+        return shard;
+    }
+
+    MemoryTags::Shard *MemoryTags::newShard()
+    {
+        std::atomic<Shard *> &list = shards();
+        Shard *shard = new Shard();
+        shard->inUse.store(true, std::memory_order_relaxed);
+        Shard *head = list.load(std::memory_order_relaxed);
+        do
+        {
+            shard->next = head;
+        } while (!list.compare_exchange_weak(head, shard, std::memory_order_release, std::memory_order_relaxed));
+        return shard;
+    }
+
+    void MemoryTags::countShared(MemoryTag tag, int64_t bytes, int64_t blocks)
+    {
+        // 永不交还，和其他分片一样挂在链表中参与合并
+        static Shard *shared = newShard();
+
+        Counter &counter = shared->counters[tag % MAX_TAGS];
+        counter.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        counter.liveBlocks.fetch_add(blocks, std::memory_order_relaxed);
+        if (blocks > 0)
+        {
+            counter.allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    MemoryTags::Usage MemoryTags::usage(MemoryTag tag)
+    {
+        Usage usage{0, 0, 0};
+        for (Shard *shard = shards().load(std::memory_order_acquire); shard != nullptr; shard = shard->next)
+        {
+            const Counter &counter = shard->counters[tag % MAX_TAGS];
+            usage.liveBytes += counter.liveBytes.load(std::memory_order_relaxed);
+            usage.liveBlocks += counter.liveBlocks.load(std::memory_order_relaxed);
+            usage.allocations += counter.allocations.load(std::memory_order_relaxed);
+        }
+        return usage;
+    }
+
+    std::vector<std::pair<MemoryTag, MemoryTags::Usage>> MemoryTags::snapshot()
+    {
+        std::vector<std::pair<MemoryTag, Usage>> result;
+        for (MemoryTag tag = 0; tag < MAX_TAGS; ++tag)
+        {
+            Usage tagUsage = usage(tag);
+            if (tagUsage.allocations > 0)
+            {
+                result.emplace_back(tag, tagUsage);
+            }
+        }
+        return result;
+    }
+} // namespace MyMemoryPool
@@ -0,0 +1,108 @@
+#include "../include/NumaTopology.hpp"
+#include <fstream>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace MyMemoryPool
+{
+    // 内存策略，与<numaif.h>中的定义一致
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+
+    NumaTopology::NumaTopology()
+        : systemNodeCount_(detectNodeCount()),
+          nodeCount_(systemNodeCount_)
+    {
+    }
+
+    size_t NumaTopology::currentNode() const
+    {
+        size_t numNodes = nodeCount();
+        if (numNodes <= 1)
+        {
+            return 0;
+        }
+
+        NodeResolver resolver = fakeResolver_.load(std::memory_order_acquire);
+        if (resolver != nullptr)
+        {
+            return resolver() % numNodes;
+        }
+
+        // getcpu(unsigned *cpu, unsigned *node, struct getcpu_cache *tcache)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+        {
+            return 0;
+        }
+        return node % numNodes;
+    }
+
+    void NumaTopology::bindMemory(void *addr, size_t size, size_t node) const
+    {
+        // 模拟拓扑中的节点并不真实存在，不做绑定
+        if (systemNodeCount_ <= 1 || fakeResolver_.load(std::memory_order_relaxed) != nullptr)
+        {
+            return;
+        }
+
+        // mbind(void *addr, unsigned long len, int mode,
+        //       const unsigned long *nodemask, unsigned long maxnode, unsigned flags)
+        // 使用PREFERRED而不是BIND，节点内存不足时允许回退到其他节点
+        unsigned long nodeMask = 1UL << node;
+        syscall(SYS_mbind, addr, size, MPOL_PREFERRED_MODE, &nodeMask,
+                sizeof(nodeMask) * 8, 0);
+    }
+
+    void NumaTopology::setFakeTopology(size_t numNodes, NodeResolver resolver)
+    {
+        assert(numNodes > 0 && resolver != nullptr);
+        fakeResolver_.store(resolver, std::memory_order_release);
+        nodeCount_.store(std::min(numNodes, MAX_NUMA_NODES), std::memory_order_relaxed);
+    }
+
+    void NumaTopology::resetTopology()
+    {
+        nodeCount_.store(systemNodeCount_, std::memory_order_relaxed);
+        fakeResolver_.store(nullptr, std::memory_order_release);
+    }
+
+    size_t NumaTopology::detectNodeCount()
+    {
+        // 文件内容形如"0"或"0-1"或"0,2-3"，取最大的节点编号
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string online;
+        if (!file || !std::getline(file, online))
+        {
+            return 1;
+        }
+
+        size_t maxNode = 0;
+        size_t value = 0;
+        bool hasDigit = false;
+        for (char c : online)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+                hasDigit = true;
+            }
+            else
+            {
+                if (hasDigit)
+                {
+                    maxNode = std::max(maxNode, value);
+                }
+                value = 0;
+                hasDigit = false;
+            }
+        }
+        if (hasDigit)
+        {
+            maxNode = std::max(maxNode, value);
+        }
+
+        return std::min(maxNode + 1, MAX_NUMA_NODES);
+    }
+} // namespace MyMemoryPool
@@ -1,161 +1,685 @@
 #include "../include/PageCache.hpp"
+#include "../include/Heap.hpp"
 #include <cstring>
 
 namespace MyMemoryPool
 {
-    void *PageCache::allocateSpan(size_t numPages)
-    {
-        std::lock_guard<std::mutex> lock(PageCache::mutex_);
+    std::atomic<size_t> PageCache::injectedMapFailures_{0};
 
-        // 查找合适的空闲span
-        // lower_bound函数返回第一个大于等于numPages的元素的迭代器
-        // 最小适配算法
-        auto it = PageCache::freeSpans_.lower_bound(numPages);
+    PageCache &PageCache::getInstance(size_t node)
+    {
+        return Heap::defaultHeap().pageCache(node);
+    }
 
-        if (it != freeSpans_.end())
+    PageCache::~PageCache()
+    {
+        PageMap &pageMap = PageMap::getInstance();
+        for (Stripe &stripe : stripes_)
         {
-            Span *span = it->second;
-
-            // 将取出的span从原有的空闲链表freeSpans_[it->first]中移除
-            if (span->next)
+            // 清除映射后再归还内存，之后对这些地址的查询都返回nullptr
+            for (const auto &[chunk, numPages] : stripe.chunks)
             {
-                freeSpans_[it->first] = span->next;
+                pageMap.set(chunk, numPages, nullptr);
+                heap_->pageSource().release(chunk, numPages * PAGE_SIZE);
             }
-            else
+            for (Span *slab : stripe.spanSlabs)
             {
-                freeSpans_.erase(it);
+                for (size_t i = 0; i < SPAN_SLAB_SIZE; ++i)
+                {
+                    delete[] slab[i].blockBits;
+                }
+                delete[] slab;
             }
+        }
+    }
 
-            // 如果span大于需要的numPages则进行分割
-            if (span->numPages > numPages)
-            {
-                Span *newSpan = new Span;
-                // 分割出来的新span起始地址
-                newSpan->pageAddr = static_cast<char *>(span->pageAddr) +
-                                    numPages * PAGE_SIZE;
-                // 分割出来的新span页数
-                newSpan->numPages = span->numPages - numPages;
-                newSpan->next = nullptr;
-
-                // 将超出部分放回空闲Span*列表头部
-                auto &list = freeSpans_[newSpan->numPages];
-                newSpan->next = list;
-                list = newSpan;
+    void *PageCache::allocateSpan(size_t numPages)
+    {
+        if (numPages == 0)
+        {
+            return nullptr;
+        }
 
-                // 更新先前取出的span的页数
-                span->numPages = numPages;
+        // 1. 单个span的申请最为常见，优先从无锁缓存获取
+        if (numPages == SPAN_PAGES)
+        {
+            if (Span *span = popSpanCache())
+            {
                 return span->pageAddr;
             }
+        }
 
-            // 记录span信息用于回收
-            spanMap_[span->pageAddr] = span;
+        // 2. 在当前线程优先使用的分段中查找
+        // 3. 尝试其他分段中已有的空闲内存，正被其他线程使用的分段直接跳过
+        size_t preferred = preferredStripe();
+        if (Span *span = allocateFromStripes(numPages, preferred, false))
+        {
             return span->pageAddr;
         }
 
-        // 没有合适的span，向系统申请
-        void *memory = systemAlloc(numPages);
-        if (memory == nullptr)
+        // 4. 没有合适的span，向系统申请一整块内存，在锁外执行
+        size_t chunkPages = std::max(numPages, CHUNK_PAGES);
+        void *memory = systemAlloc(chunkPages);
+        for (size_t attempt = 0; memory == nullptr; ++attempt)
         {
-            return nullptr;
+            // 超出内存上限或映射失败：先释放堆中各级缓存，仍然不足时交给OOM处理函数决定重试还是失败
+            if (!heap_->handleOutOfMemory(numPages * PAGE_SIZE, attempt))
+            {
+                return nullptr;
+            }
+            // 释放出的空闲span可能已经足够，这次等待所有分段的锁
+            if (Span *span = allocateFromStripes(numPages, preferred, true))
+            {
+                return span->pageAddr;
+            }
+            memory = systemAlloc(chunkPages);
         }
 
-        // 创建新的span
-        Span *span = new Span;
-        span->pageAddr = memory;
-        span->numPages = numPages;
-        span->next = nullptr;
+        Stripe &stripe = stripes_[preferred];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
 
-        // 记录span信息用于回收
-        spanMap_[memory] = span;
-        return memory;
+        // 新申请的内存作为空闲span放入本分段，再从中分割
+        Span *chunk = newSpanObject(preferred);
+        chunk->pageAddr = memory;
+        chunk->numPages = chunkPages;
+        chunk->isUse = false;
+        chunk->chunkBegin = static_cast<char *>(memory);
+        chunk->chunkEnd = chunk->chunkBegin + chunkPages * PAGE_SIZE;
+        stripe.chunks.emplace(chunk->chunkBegin, chunkPages);
+        setFreeSpanBoundary(chunk);
+        insertFreeSpan(stripe, chunk);
+
+        Span *span = allocateFromStripe(stripe, numPages);
+        assert(span != nullptr);
+        return span->pageAddr;
     }
 
     // 回收span
     void PageCache::deallocateSpan(void *ptr, size_t numPages)
     {
-        std::lock_guard<std::mutex> lock(PageCache::mutex_);
-
         // 查找对应的span，没找到代表不是PageCache分配的内存，直接返回
-        auto it = spanMap_.find(ptr);
-        if (it == spanMap_.end())
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr || span->pageAddr != ptr || !span->isUse || span->owner != this)
         {
             return;
         }
+        assert(span->numPages == numPages);
 
-        Span *span = it->second;
+        // 清理CentralCache使用过的字段
+        span->blockSize = 0;
+        span->useCount = 0;
+        span->freeList = nullptr;
+        span->bumpPtr = nullptr;
+        span->bumpEnd = nullptr;
 
-        void *nextAddr = static_cast<char *>(ptr) + numPages * PAGE_SIZE;
-        auto nextIt = spanMap_.find(nextAddr);
+        // 单个span优先放入无锁缓存，缓存已满时再放回分段
+        if (numPages == SPAN_PAGES && pushSpanCache(span))
+        {
+            return;
+        }
 
-        // 如果nextSpan存在且未被分配，则合并
-        if (nextIt != spanMap_.end())
+        Stripe &stripe = stripes_[span->stripe];
+        char *unmapChunk = nullptr;
+        size_t unmapPages = 0;
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            releaseToStripe(stripe, span, unmapChunk, unmapPages);
+        }
+        if (unmapChunk != nullptr)
         {
-            Span *nextSpan = nextIt->second;
+            systemFree(unmapChunk, unmapPages);
+        }
+    }
 
-            // 检查nextSpan是否在空闲链表中
-            // 在空闲链表中说明未被分配
-            bool found = false;
-            auto &nextList = freeSpans_[nextSpan->numPages];
+    void *PageCache::resizeSpan(void *ptr, size_t newPages)
+    {
+        PageMap &pageMap = PageMap::getInstance();
+        Span *span = pageMap.get(ptr);
+        if (span == nullptr || span->pageAddr != ptr || !span->isUse || span->owner != this ||
+            span->blockSize != 0 || newPages == 0)
+        {
+            return nullptr;
+        }
+        size_t oldPages = span->numPages;
+        if (newPages == oldPages)
+        {
+            return ptr;
+        }
 
-            // 检查是否是头结点
-            if (nextList == nextSpan)
+        // 专用内存块中只有这一个span，调整映射本身，不必复制内容
+        size_t chunkPages = (span->chunkEnd - span->chunkBegin) / PAGE_SIZE;
+        if (chunkPages > CHUNK_PAGES && oldPages == chunkPages && newPages > CHUNK_PAGES)
+        {
+            return resizeChunk(span, newPages);
+        }
+
+        Stripe &stripe = stripes_[span->stripe];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        char *end = static_cast<char *>(ptr) + oldPages * PAGE_SIZE;
+
+        if (newPages < oldPages)
+        {
+            // 尾部分割成新的span，与之后的空闲span合并后放回分段
+            Span *tail = newSpanObject(span->stripe);
+            tail->pageAddr = static_cast<char *>(ptr) + newPages * PAGE_SIZE;
+            tail->numPages = oldPages - newPages;
+            tail->chunkBegin = span->chunkBegin;
+            tail->chunkEnd = span->chunkEnd;
+            pageMap.set(tail->pageAddr, tail->numPages, tail);
+            span->numPages = newPages;
+
+            // span仍在使用，所在的内存块不会整体空闲
+            char *unmapChunk = nullptr;
+            size_t unmapPages = 0;
+            releaseToStripe(stripe, tail, unmapChunk, unmapPages);
+            assert(unmapChunk == nullptr);
+            return ptr;
+        }
+
+        // 紧随其后的页是下一个span的首页；无锁缓存中的span仍标记为isUse，不会被接管
+        size_t extraPages = newPages - oldPages;
+        Span *next = end < span->chunkEnd ? pageMap.get(end) : nullptr;
+        if (next == nullptr || next->isUse || next->numPages < extraPages)
+        {
+            return nullptr;
+        }
+        eraseFreeSpan(stripe, next);
+        if (next->numPages > extraPages)
+        {
+            next->pageAddr = static_cast<char *>(next->pageAddr) + extraPages * PAGE_SIZE;
+            next->numPages -= extraPages;
+            setFreeSpanBoundary(next);
+            insertFreeSpan(stripe, next);
+        }
+        else
+        {
+            deleteSpanObject(next);
+        }
+        pageMap.set(end, extraPages, span);
+        span->numPages = newPages;
+        return ptr;
+    }
+
+    void *PageCache::resizeChunk(Span *span, size_t newPages)
+    {
+        size_t oldPages = span->numPages;
+        char *oldAddr = static_cast<char *>(span->pageAddr);
+        PageSource &source = heap_->pageSource();
+        PageMap &pageMap = PageMap::getInstance();
+        Stripe &stripe = stripes_[span->stripe];
+
+        if (newPages < oldPages)
+        {
+            // 缩小总是原地完成
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            if (!source.resize(oldAddr, oldPages * PAGE_SIZE, newPages * PAGE_SIZE, nullptr))
+            {
+                return nullptr;
+            }
+            pageMap.set(oldAddr + newPages * PAGE_SIZE, oldPages - newPages, nullptr);
+            stripe.chunks[oldAddr] = newPages;
+            span->numPages = newPages;
+            span->chunkEnd = oldAddr + newPages * PAGE_SIZE;
+            heap_->unreserveMappedBytes((oldPages - newPages) * PAGE_SIZE);
+            return oldAddr;
+        }
+
+        // 扩大前在所属堆中登记，超过上限时由调用者改为复制，复制时的申请再走内存不足的处理
+        size_t extraBytes = (newPages - oldPages) * PAGE_SIZE;
+        if (!heap_->reserveMappedBytes(extraBytes))
+        {
+            return nullptr;
+        }
+
+        // 调整映射之前先创建新区间的叶子节点，之后在锁内记录span不会失败
+        // 先尝试在原地址之后扩展，不行时移动到新预留的区间
+        char *newAddr = nullptr;
+        if (pageMap.prepare(oldAddr + oldPages * PAGE_SIZE, newPages - oldPages))
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            if (source.resize(oldAddr, oldPages * PAGE_SIZE, newPages * PAGE_SIZE, nullptr))
+            {
+                pageMap.set(oldAddr + oldPages * PAGE_SIZE, newPages - oldPages, span);
+                stripe.chunks[oldAddr] = newPages;
+                newAddr = oldAddr;
+            }
+        }
+        if (newAddr == nullptr)
+        {
+            char *target = static_cast<char *>(source.reserve(newPages * PAGE_SIZE, node_));
+            if (target != nullptr &&
+                (!source.commit(target, newPages * PAGE_SIZE) || !pageMap.prepare(target, newPages)))
+            {
+                source.release(target, newPages * PAGE_SIZE);
+                target = nullptr;
+            }
+            if (target != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(stripe.mutex);
+                if (source.resize(oldAddr, oldPages * PAGE_SIZE, newPages * PAGE_SIZE, target))
+                {
+                    pageMap.set(oldAddr, oldPages, nullptr);
+                    pageMap.set(target, newPages, span);
+                    stripe.chunks.erase(oldAddr);
+                    stripe.chunks.emplace(target, newPages);
+                    newAddr = target;
+                }
+            }
+            if (target != nullptr && newAddr == nullptr)
+            {
+                source.release(target, newPages * PAGE_SIZE);
+            }
+        }
+        if (newAddr == nullptr)
+        {
+            heap_->unreserveMappedBytes(extraBytes);
+            return nullptr;
+        }
+
+        span->pageAddr = newAddr;
+        span->numPages = newPages;
+        span->chunkBegin = newAddr;
+        span->chunkEnd = newAddr + newPages * PAGE_SIZE;
+        return newAddr;
+    }
+
+    void PageCache::releaseToStripe(Stripe &stripe, Span *span, char *&unmapChunk, size_t &unmapPages)
+    {
+        span->isUse = false;
+        span = coalesce(stripe, span);
+
+        // 为单个大对象专门申请的内存块整体空闲时直接归还系统，不长期占用内存
+        size_t chunkPages = (span->chunkEnd - span->chunkBegin) / PAGE_SIZE;
+        if (chunkPages > CHUNK_PAGES && span->numPages == chunkPages)
+        {
+            unmapChunk = span->chunkBegin;
+            unmapPages = chunkPages;
+            stripe.chunks.erase(unmapChunk);
+            PageMap::getInstance().set(unmapChunk, chunkPages, nullptr);
+            deleteSpanObject(span);
+            return;
+        }
+
+        // 将span放回空闲链表
+        setFreeSpanBoundary(span);
+        insertFreeSpan(stripe, span);
+    }
+
+    void PageCache::releaseFreeMemory()
+    {
+        // 无锁缓存中的span放回分段，才能与相邻的空闲span合并成整块
+        for (std::atomic<Span *> &slot : spanCache_)
+        {
+            Span *span = slot.exchange(nullptr, std::memory_order_acquire);
+            if (span == nullptr)
+            {
+                continue;
+            }
+            Stripe &stripe = stripes_[span->stripe];
+            char *unmapChunk = nullptr;
+            size_t unmapPages = 0;
             {
-                nextList = nextSpan->next;
-                found = true;
+                std::lock_guard<std::mutex> lock(stripe.mutex);
+                releaseToStripe(stripe, span, unmapChunk, unmapPages);
             }
-            else if (nextList)
+            if (unmapChunk != nullptr)
             {
-                Span *prev = nextList;
-                while (prev->next)
+                systemFree(unmapChunk, unmapPages);
+            }
+        }
+
+        PageMap &pageMap = PageMap::getInstance();
+        std::vector<std::pair<char *, size_t>> unmapChunks;
+        for (Stripe &stripe : stripes_)
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+
+            std::vector<Span *> freeSpans;
+            for (const auto &entry : stripe.freeSpans)
+            {
+                for (Span *span = entry.second; span != nullptr; span = span->next)
                 {
-                    if (prev->next == nextSpan)
-                    {
-                        prev->next = nextSpan->next;
-                        found = true;
-                        break;
-                    }
-                    prev = prev->next;
+                    freeSpans.push_back(span);
                 }
             }
 
-            if (found)
+            for (Span *span : freeSpans)
             {
-                // 合并两个span
-                span->numPages += nextSpan->numPages;
-                spanMap_.erase(nextSpan->pageAddr);
-                delete nextSpan;
+                size_t chunkPages = (span->chunkEnd - span->chunkBegin) / PAGE_SIZE;
+                if (span->numPages == chunkPages)
+                {
+                    // 整个内存块都空闲，连同地址空间一起归还
+                    eraseFreeSpan(stripe, span);
+                    stripe.chunks.erase(span->chunkBegin);
+                    pageMap.set(span->chunkBegin, chunkPages, nullptr);
+                    unmapChunks.emplace_back(span->chunkBegin, chunkPages);
+                    deleteSpanObject(span);
+                }
+                else
+                {
+                    // 保留地址空间，物理页交还系统
+                    heap_->pageSource().decommit(span->pageAddr, span->numPages * PAGE_SIZE);
+                }
             }
+        }
 
-            // 将span放回空闲链表
-            auto &list = freeSpans_[span->numPages];
-            span->next = list;
-            list = span;
+        for (const auto &[chunk, numPages] : unmapChunks)
+        {
+            systemFree(chunk, numPages);
         }
     }
 
+    void PageCache::lockForFork()
+    {
+        for (Stripe &stripe : stripes_)
+        {
+            stripe.mutex.lock();
+        }
+    }
+
+    void PageCache::unlockAfterFork()
+    {
+        for (Stripe &stripe : stripes_)
+        {
+            stripe.mutex.unlock();
+        }
+    }
+
+    void PageCache::injectMapFailures(size_t count)
+    {
+        injectedMapFailures_.store(count, std::memory_order_relaxed);
+    }
+
+    size_t PageCache::preferredStripe()
+    {
+        static std::atomic<size_t> nextStripe{0};
+        static thread_local size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % STRIPE_NUM;
+        return stripe;
+    }
+
+    Span *PageCache::allocateFromStripes(size_t numPages, size_t preferred, bool blocking)
+    {
+        for (size_t i = 0; i < STRIPE_NUM; ++i)
+        {
+            Stripe &stripe = stripes_[(preferred + i) % STRIPE_NUM];
+            // 本线程优先使用的分段总是等待锁
+            std::unique_lock<std::mutex> lock(stripe.mutex, std::defer_lock);
+            if (i == 0 || blocking)
+            {
+                lock.lock();
+            }
+            else if (!lock.try_lock())
+            {
+                continue;
+            }
+            if (Span *span = allocateFromStripe(stripe, numPages))
+            {
+                return span;
+            }
+        }
+        return nullptr;
+    }
+
+    Span *PageCache::allocateFromStripe(Stripe &stripe, size_t numPages)
+    {
+        // 查找合适的空闲span
+        // lower_bound函数返回第一个大于等于numPages的元素的迭代器
+        // 最小适配算法
+        auto it = stripe.freeSpans.lower_bound(numPages);
+        if (it == stripe.freeSpans.end())
+        {
+            return nullptr;
+        }
+
+        Span *span = it->second;
+
+        // 将取出的span从原有的空闲链表freeSpans[it->first]中移除
+        eraseFreeSpan(stripe, span);
+
+        // 如果span大于需要的numPages则进行分割
+        if (span->numPages > numPages)
+        {
+            Span *newSpan = newSpanObject(span->stripe);
+            // 分割出来的新span起始地址
+            newSpan->pageAddr = static_cast<char *>(span->pageAddr) +
+                                numPages * PAGE_SIZE;
+            // 分割出来的新span页数
+            newSpan->numPages = span->numPages - numPages;
+            newSpan->isUse = false;
+            newSpan->chunkBegin = span->chunkBegin;
+            newSpan->chunkEnd = span->chunkEnd;
+
+            // 超出部分放回空闲Span*列表
+            setFreeSpanBoundary(newSpan);
+            insertFreeSpan(stripe, newSpan);
+
+            // 更新先前取出的span的页数
+            span->numPages = numPages;
+        }
+
+        // 空闲span只记录了首尾页，分配出去的span需要映射每一页，以便由块地址反查span
+        span->isUse = true;
+        PageMap::getInstance().set(span->pageAddr, span->numPages, span);
+        return span;
+    }
+
+    // 与同一内存块内前后相邻的空闲span合并，返回合并后的span，调用者需持有分段的锁
+    Span *PageCache::coalesce(Stripe &stripe, Span *span)
+    {
+        PageMap &pageMap = PageMap::getInstance();
+
+        // 内存块之外的相邻页可能属于其他分区、其他分段甚至其他堆，不去查询
+        // 同一内存块内的span都属于本分段，读取它们只需持有本分段的锁
+        auto neighbor = [&](char *addr) -> Span *
+        {
+            if (addr < span->chunkBegin || addr >= span->chunkEnd)
+            {
+                return nullptr;
+            }
+            Span *other = pageMap.get(addr);
+            assert(other == nullptr || (other->owner == this && other->stripe == span->stripe));
+            return other != nullptr && !other->isUse ? other : nullptr;
+        };
+
+        // 如果前一个span未被分配，则合并
+        Span *prevSpan = neighbor(static_cast<char *>(span->pageAddr) - PAGE_SIZE);
+        if (prevSpan != nullptr)
+        {
+            eraseFreeSpan(stripe, prevSpan);
+            prevSpan->numPages += span->numPages;
+            deleteSpanObject(span);
+            span = prevSpan;
+        }
+
+        // 如果后一个span未被分配，则合并
+        Span *nextSpan = neighbor(static_cast<char *>(span->pageAddr) + span->numPages * PAGE_SIZE);
+        if (nextSpan != nullptr)
+        {
+            eraseFreeSpan(stripe, nextSpan);
+            span->numPages += nextSpan->numPages;
+            deleteSpanObject(nextSpan);
+        }
+
+        return span;
+    }
+
+    Span *PageCache::popSpanCache()
+    {
+        // 不同分段的线程从不同位置开始查找，减少对同一槽位的争用
+        size_t start = preferredStripe() * (SPAN_CACHE_SIZE / STRIPE_NUM);
+        for (size_t i = 0; i < SPAN_CACHE_SIZE; ++i)
+        {
+            std::atomic<Span *> &slot = spanCache_[(start + i) % SPAN_CACHE_SIZE];
+            Span *span = slot.load(std::memory_order_relaxed);
+            // 每个槽位只做整体交换，不存在链表式无锁栈的ABA问题
+            if (span != nullptr && slot.compare_exchange_strong(span, nullptr,
+                                                                std::memory_order_acquire,
+                                                                std::memory_order_relaxed))
+            {
+                return span;
+            }
+        }
+        return nullptr;
+    }
+
+    bool PageCache::pushSpanCache(Span *span)
+    {
+        size_t start = preferredStripe() * (SPAN_CACHE_SIZE / STRIPE_NUM);
+        for (size_t i = 0; i < SPAN_CACHE_SIZE; ++i)
+        {
+            std::atomic<Span *> &slot = spanCache_[(start + i) % SPAN_CACHE_SIZE];
+            Span *expected = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr &&
+                slot.compare_exchange_strong(expected, span,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 空闲span只需映射首尾页，合并时通过相邻页即可找到它
+    // 这样分割和合并大span时不必逐页更新PageMap
+    void PageCache::setFreeSpanBoundary(Span *span)
+    {
+        PageMap &pageMap = PageMap::getInstance();
+        pageMap.set(span->pageAddr, 1, span);
+        if (span->numPages > 1)
+        {
+            pageMap.set(static_cast<char *>(span->pageAddr) + (span->numPages - 1) * PAGE_SIZE, 1, span);
+        }
+    }
+
+    // span元数据对象在所属分段内复用，PageCache销毁前不会释放
+    // PageMap中空闲span内部的页可能仍指向已合并掉的span，保证它们始终指向有效的对象
+    Span *PageCache::newSpanObject(size_t stripeIndex)
+    {
+        Stripe &stripe = stripes_[stripeIndex];
+        if (stripe.spanObjectFreeList == nullptr)
+        {
+            // 批量创建，减少小对象分配的次数
+            Span *slab = new Span[SPAN_SLAB_SIZE]();
+            stripe.spanSlabs.push_back(slab);
+            for (size_t i = 0; i < SPAN_SLAB_SIZE; ++i)
+            {
+                slab[i].owner = this;
+                slab[i].node = node_;
+                slab[i].stripe = stripeIndex;
+                slab[i].next = i + 1 < SPAN_SLAB_SIZE ? &slab[i + 1] : nullptr;
+            }
+            stripe.spanObjectFreeList = slab;
+        }
+
+        Span *span = stripe.spanObjectFreeList;
+        stripe.spanObjectFreeList = span->next;
+        span->next = nullptr;
+        return span;
+    }
+
+    void PageCache::deleteSpanObject(Span *span)
+    {
+        // owner、node和stripe字段保持不变
+        span->pageAddr = nullptr;
+        span->numPages = 0;
+        span->prev = nullptr;
+        span->isUse = false;
+        span->blockSize = 0;
+        span->useCount = 0;
+        span->freeList = nullptr;
+        span->bumpPtr = nullptr;
+        span->bumpEnd = nullptr;
+
+        Stripe &stripe = stripes_[span->stripe];
+        span->next = stripe.spanObjectFreeList;
+        stripe.spanObjectFreeList = span;
+    }
+
+    void PageCache::insertFreeSpan(Stripe &stripe, Span *span)
+    {
+        Span *&list = stripe.freeSpans[span->numPages];
+        span->prev = nullptr;
+        span->next = list;
+        if (list != nullptr)
+        {
+            list->prev = span;
+        }
+        list = span;
+    }
+
+    void PageCache::eraseFreeSpan(Stripe &stripe, Span *span)
+    {
+        if (span->prev != nullptr)
+        {
+            span->prev->next = span->next;
+        }
+        else
+        {
+            // span是链表头结点
+            auto it = stripe.freeSpans.find(span->numPages);
+            assert(it != stripe.freeSpans.end() && it->second == span);
+            if (span->next != nullptr)
+            {
+                it->second = span->next;
+            }
+            else
+            {
+                stripe.freeSpans.erase(it);
+            }
+        }
+
+        if (span->next != nullptr)
+        {
+            span->next->prev = span->prev;
+        }
+        span->next = nullptr;
+        span->prev = nullptr;
+    }
+
     // 向系统申请内存
     void *PageCache::systemAlloc(size_t numPages)
     {
         size_t size = numPages * PAGE_SIZE;
 
-        // 使用mmap向系统申请内存
-        // mmap函数原型：void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
-        // addr：期望映射的地址，一般为nullptr，由系统自动分配
-        // length：映射的内存大小
-        // prot：内存保护标志，PROT_READ | PROT_WRITE表示可读可写
-        // flags：映射选项，MAP_PRIVATE | MAP_ANONYMOUS表示映射的是匿名内存
-        // fd：文件描述符，一般为-1
-        // offset：文件映射的偏移量，一般为0
-        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
-                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-
-        // 申请失败
-        if (ptr == MAP_FAILED)
+        // 先在所属堆中登记，超过硬上限时不映射
+        if (!heap_->reserveMappedBytes(size))
         {
             return nullptr;
         }
 
-        memset(ptr, 0, size);
+        // 模拟映射失败
+        size_t failures = injectedMapFailures_.load(std::memory_order_relaxed);
+        while (failures > 0)
+        {
+            if (injectedMapFailures_.compare_exchange_weak(failures, failures - 1, std::memory_order_relaxed))
+            {
+                heap_->unreserveMappedBytes(size);
+                return nullptr;
+            }
+        }
+
+        // 从所属堆的来源预留并提交内存
+        // 同时创建内存块在PageMap中的叶子节点，之后在分段锁内分割、合并span时记录映射不会失败
+        PageSource &source = heap_->pageSource();
+        void *ptr = source.reserve(size, node_);
+        if (ptr != nullptr && (!source.commit(ptr, size) || !PageMap::getInstance().prepare(ptr, numPages)))
+        {
+            source.release(ptr, size);
+            ptr = nullptr;
+        }
+
+        // 申请失败
+        if (ptr == nullptr)
+        {
+            heap_->unreserveMappedBytes(size);
+        }
         return ptr;
     }
+
+    void PageCache::systemFree(char *chunk, size_t numPages)
+    {
+        heap_->pageSource().release(chunk, numPages * PAGE_SIZE);
+        heap_->unreserveMappedBytes(numPages * PAGE_SIZE);
+    }
 } // namespace MyMemoryPool
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "../include/PageMap.hpp"
+
+namespace MyMemoryPool
+{
+    bool PageMap::set(void *pageAddr, size_t numPages, Span *span)
+    {
+        size_t pageId = reinterpret_cast<uintptr_t>(pageAddr) >> PAGE_SHIFT;
+        for (size_t i = 0; i < numPages; ++i)
+        {
+            size_t id = pageId + i;
+            Leaf *leaf = ensureLeaf(id >> LEAF_BITS);
+            if (leaf == nullptr)
+            {
+                return false;
+            }
+            leaf->spans[id & (LEAF_LENGTH - 1)].store(span, std::memory_order_release);
+        }
+        return true;
+    }
+
+    bool PageMap::prepare(void *pageAddr, size_t numPages)
+    {
+        if (numPages == 0)
+        {
+            return true;
+        }
+        size_t pageId = reinterpret_cast<uintptr_t>(pageAddr) >> PAGE_SHIFT;
+        for (size_t rootIndex = pageId >> LEAF_BITS; rootIndex <= (pageId + numPages - 1) >> LEAF_BITS; ++rootIndex)
+        {
+            if (ensureLeaf(rootIndex) == nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    PageMap::Leaf *PageMap::ensureLeaf(size_t rootIndex)
+    {
+        if (rootIndex >= ROOT_LENGTH)
+        {
+            return nullptr;
+        }
+        Leaf *leaf = root_[rootIndex].load(std::memory_order_acquire);
+        if (leaf != nullptr)
+        {
+            return leaf;
+        }
+
+        std::lock_guard<std::mutex> lock(leafMutex_);
+        leaf = root_[rootIndex].load(std::memory_order_relaxed);
+        if (leaf == nullptr)
+        {
+            // 模拟创建失败
+            size_t failures = injectedLeafFailures_.load(std::memory_order_relaxed);
+            if (failures > 0)
+            {
+                injectedLeafFailures_.store(failures - 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            // 匿名映射的内存已清零，即所有指针初始为nullptr
+            void *ptr = mmap(nullptr, sizeof(Leaf), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            leaf = static_cast<Leaf *>(ptr);
+            root_[rootIndex].store(leaf, std::memory_order_release);
+        }
+        return leaf;
+    }
+} // namespace MyMemoryPool
@@ -0,0 +1,266 @@
+#include "../include/PageSource.hpp"
+#include "../include/NumaTopology.hpp"
+#include "../include/PageCache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+namespace MyMemoryPool
+{
+    void *MmapPageSource::reserve(size_t size, size_t node)
+    {
+        // 使用mmap向系统申请内存
+        // mmap函数原型：void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+        // addr：期望映射的地址，一般为nullptr，由系统自动分配
+        // length：映射的内存大小
+        // prot：内存保护标志，PROT_READ | PROT_WRITE表示可读可写
+        // flags：映射选项，MAP_PRIVATE | MAP_ANONYMOUS表示映射的是匿名内存
+        //        MAP_NORESERVE表示只预留地址空间，页面在首次访问时才真正分配
+        // fd：文件描述符，一般为-1
+        // offset：文件映射的偏移量，一般为0
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        // 多节点时将物理页绑定到期望的节点
+        NumaTopology::getInstance().bindMemory(ptr, size, node);
+
+        // 匿名映射的内存本身就是清零的，无需memset，避免提前触碰所有页面
+        return ptr;
+    }
+
+    void MmapPageSource::decommit(void *addr, size_t size)
+    {
+        // 再次访问时得到清零的页面
+        madvise(addr, size, MADV_DONTNEED);
+    }
+
+    void MmapPageSource::release(void *addr, size_t size)
+    {
+        munmap(addr, size);
+    }
+
+    bool MmapPageSource::resize(void *addr, size_t size, size_t newSize, void *target)
+    {
+        // 原地扩展出的部分属于同一映射，沿用其NUMA绑定
+        if (target == nullptr)
+        {
+            return mremap(addr, size, newSize, 0) != MAP_FAILED;
+        }
+        // 替换target处预留的映射，不会覆盖其他线程新建的映射
+        return mremap(addr, size, newSize, MREMAP_MAYMOVE | MREMAP_FIXED, target) == target;
+    }
+
+    PageSource &systemPageSource()
+    {
+        static MmapPageSource *source = new MmapPageSource();
+        return *source;
+    }
+
+    FixedBufferPageSource::FixedBufferPageSource(void *buffer, size_t size)
+    {
+        constexpr size_t PAGE_SIZE = PageCache::PAGE_SIZE;
+        uintptr_t begin = (reinterpret_cast<uintptr_t>(buffer) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uintptr_t end = (reinterpret_cast<uintptr_t>(buffer) + size) & ~(PAGE_SIZE - 1);
+        if (end <= begin)
+        {
+            return;
+        }
+
+        // PageCache每次至少预留CHUNK_PAGES页，空闲区间之间至少隔着一个被预留的内存块
+        size_t numPages = (end - begin) / PAGE_SIZE;
+        freeRanges_.reserve(numPages / PageCache::CHUNK_PAGES + 2);
+        freeRanges_.emplace_back(reinterpret_cast<char *>(begin), end - begin);
+
+        // 提前建好PageMap中覆盖缓冲区的节点，之后记录span时不再映射内存
+        PageMap::getInstance().prepare(reinterpret_cast<void *>(begin), numPages);
+    }
+
+    void *FixedBufferPageSource::reserve(size_t size, size_t)
+    {
+        SpinLockGuard guard(lock_);
+        for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it)
+        {
+            if (it->second < size)
+            {
+                continue;
+            }
+            char *ptr = it->first;
+            it->first += size;
+            it->second -= size;
+            if (it->second == 0)
+            {
+                freeRanges_.erase(it);
+            }
+            return ptr;
+        }
+        return nullptr;
+    }
+
+    void FixedBufferPageSource::release(void *addr, size_t size)
+    {
+        char *begin = static_cast<char *>(addr);
+        SpinLockGuard guard(lock_);
+        auto next = std::lower_bound(freeRanges_.begin(), freeRanges_.end(), begin,
+                                     [](const std::pair<char *, size_t> &range, char *ptr)
+                                     { return range.first < ptr; });
+
+        bool mergePrev = next != freeRanges_.begin() && std::prev(next)->first + std::prev(next)->second == begin;
+        bool mergeNext = next != freeRanges_.end() && begin + size == next->first;
+        if (mergePrev && mergeNext)
+        {
+            std::prev(next)->second += size + next->second;
+            freeRanges_.erase(next);
+        }
+        else if (mergePrev)
+        {
+            std::prev(next)->second += size;
+        }
+        else if (mergeNext)
+        {
+            next->first = begin;
+            next->second += size;
+        }
+        else
+        {
+            freeRanges_.emplace(next, begin, size);
+        }
+    }
+
+    size_t FixedBufferPageSource::available() const
+    {
+        SpinLockGuard guard(lock_);
+        size_t bytes = 0;
+        for (const auto &range : freeRanges_)
+        {
+            bytes += range.second;
+        }
+        return bytes;
+    }
+
+    FilePageSource::FilePageSource(const std::string &directory, bool requireHugetlbfs)
+    {
+        std::string path = directory + "/MyMemoryPool.XXXXXX";
+        int fd = mkostemp(path.data(), O_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        // 文件只通过fd访问，立即删除
+        unlink(path.c_str());
+
+        struct statfs fs;
+        if (fstatfs(fd, &fs) != 0 || (requireHugetlbfs && static_cast<unsigned long>(fs.f_type) != HUGETLBFS_MAGIC))
+        {
+            close(fd);
+            return;
+        }
+        // hugetlbfs的块大小就是大页大小
+        granularity_ = std::max<size_t>(fs.f_bsize, PageCache::PAGE_SIZE);
+        fd_ = fd;
+    }
+
+    FilePageSource::~FilePageSource()
+    {
+        for (const auto &[addr, region] : regions_)
+        {
+            munmap(addr, region.length);
+        }
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    void *FilePageSource::reserve(size_t size, size_t)
+    {
+        if (fd_ < 0)
+        {
+            return nullptr;
+        }
+        size_t length = (size + granularity_ - 1) / granularity_ * granularity_;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        off_t offset = fileSize_;
+        if (ftruncate(fd_, offset + length) != 0)
+        {
+            return nullptr;
+        }
+        void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd_, offset);
+        if (ptr == MAP_FAILED)
+        {
+            ftruncate(fd_, offset);
+            return nullptr;
+        }
+        fileSize_ += length;
+        regions_.emplace(static_cast<char *>(ptr), Region{offset, length});
+        return ptr;
+    }
+
+    bool FilePageSource::commit(void *addr, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = findRegion(addr);
+        if (it == regions_.end())
+        {
+            return false;
+        }
+        off_t offset = it->second.offset + (static_cast<char *>(addr) - it->first);
+        size_t length = (size + granularity_ - 1) / granularity_ * granularity_;
+        // 不支持预分配的文件系统只能在访问时分配
+        return fallocate(fd_, 0, offset, length) == 0 || errno == EOPNOTSUPP;
+    }
+
+    void FilePageSource::decommit(void *addr, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = findRegion(addr);
+        if (it != regions_.end())
+        {
+            punchHole(it->second.offset + (static_cast<char *>(addr) - it->first), size);
+        }
+    }
+
+    void FilePageSource::release(void *addr, size_t)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = regions_.find(static_cast<char *>(addr));
+        if (it == regions_.end())
+        {
+            return;
+        }
+        munmap(it->first, it->second.length);
+        punchHole(it->second.offset, it->second.length);
+        regions_.erase(it);
+    }
+
+    std::map<char *, FilePageSource::Region>::iterator FilePageSource::findRegion(void *addr)
+    {
+        char *ptr = static_cast<char *>(addr);
+        auto it = regions_.upper_bound(ptr);
+        if (it == regions_.begin())
+        {
+            return regions_.end();
+        }
+        --it;
+        return ptr < it->first + it->second.length ? it : regions_.end();
+    }
+
+    void FilePageSource::punchHole(off_t offset, size_t size)
+    {
+        // 只能归还完整的分配单元，区间按粒度向内取整
+        off_t unit = static_cast<off_t>(granularity_);
+        off_t begin = (offset + unit - 1) / unit * unit;
+        off_t end = (offset + static_cast<off_t>(size)) / unit * unit;
+        if (end > begin)
+        {
+            fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, begin, end - begin);
+        }
+    }
+} // namespace MyMemoryPool
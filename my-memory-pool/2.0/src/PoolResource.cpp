@@ -0,0 +1,84 @@
+#include "../include/PoolResource.hpp"
+#include "../include/MemoryPool.hpp"
+
+namespace MyMemoryPool
+{
+    bool PoolResource::alignedBySizeClass(size_t bytes, size_t align)
+    {
+        // 加固模式下块大小包含金丝雀，标记模式下包含标签，不再是对齐数的倍数
+        return !HARDENED && !TAGGED && align <= PageCache::PAGE_SIZE &&
+               SizeClass::roundUp((bytes + align - 1) / align * align) <= MAX_BYTES;
+    }
+
+    void *PoolResource::do_allocate(size_t bytes, size_t align)
+    {
+        // 0字节按1字节处理，保证向上取整到对齐数后不为0
+        bytes = std::max<size_t>(bytes, 1);
+        void *ptr;
+        if (align <= ALIGNMENT)
+        {
+            ptr = MemoryPool::allocate(bytes);
+        }
+        else if (alignedBySizeClass(bytes, align))
+        {
+            ptr = MemoryPool::allocate((bytes + align - 1) / align * align);
+        }
+        else
+        {
+            // 多申请align加一个指针的空间，对齐后的地址之前保存原始地址
+            void *raw = MemoryPool::allocate(bytes + align + sizeof(void *));
+            if (raw == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void *) + align - 1) & ~(uintptr_t(align) - 1);
+            reinterpret_cast<void **>(aligned)[-1] = raw;
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        if (ptr == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void PoolResource::do_deallocate(void *ptr, size_t bytes, size_t align)
+    {
+        bytes = std::max<size_t>(bytes, 1);
+        if (align <= ALIGNMENT)
+        {
+            MemoryPool::deallocate(ptr, bytes);
+        }
+        else if (alignedBySizeClass(bytes, align))
+        {
+            MemoryPool::deallocate(ptr, (bytes + align - 1) / align * align);
+        }
+        else
+        {
+            MemoryPool::deallocate(static_cast<void **>(ptr)[-1], bytes + align + sizeof(void *));
+        }
+    }
+
+    bool PoolResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    {
+        return dynamic_cast<const PoolResource *>(&other) != nullptr;
+    }
+
+    PoolResource *poolResource()
+    {
+        // 永不析构，静态对象析构之后仍可能有容器通过它释放内存
+        static PoolResource *resource = new PoolResource();
+        return resource;
+    }
+
+    void *MonotonicResource::do_allocate(size_t bytes, size_t align)
+    {
+        void *ptr = arena_.allocate(bytes, align);
+        if (ptr == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+} // namespace MyMemoryPool
@@ -0,0 +1,233 @@
+#include "../include/RealtimePool.hpp"
+#include "../include/Hardening.hpp"
+#include <map>
+
+namespace MyMemoryPool
+{
+    namespace
+    {
+        constexpr size_t PAGE_SIZE = PageCache::PAGE_SIZE;
+
+        size_t alignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    } // namespace
+
+    // 大小类的状态，各占一个缓存行
+    // head的低32位是栈顶内存块的偏移（0表示空），高32位是每次成功修改都加一的版本号，防止ABA
+    struct alignas(64) RealtimePool::ClassState
+    {
+        std::atomic<uint64_t> head;
+        uint32_t blockSize;
+        uint32_t capacity;
+        char *begin; // 本大小类区域的起始地址
+    };
+
+    RealtimePool *RealtimePool::create(const WarmupProfile &capacity, bool requireLocked)
+    {
+        // 按块大小合并、排序
+        std::map<size_t, size_t> classes;
+        for (const WarmupProfile::Entry &entry : capacity.entries)
+        {
+            if (entry.count > 0)
+            {
+                classes[SizeClass::roundUp(std::max(entry.blockSize, ALIGNMENT))] += entry.count;
+            }
+        }
+        if (classes.empty() || classes.size() > MAX_CLASSES)
+        {
+            return nullptr;
+        }
+        size_t maxBlockSize = classes.rbegin()->first;
+
+        // 布局：本对象、各大小类的状态、大小查找表、页查找表，之后从页边界开始是内存块区域
+        size_t classesOffset = alignUp(sizeof(RealtimePool), 64);
+        size_t sizeTableOffset = classesOffset + classes.size() * sizeof(ClassState);
+        size_t pageTableOffset = alignUp(sizeTableOffset + maxBlockSize / ALIGNMENT * sizeof(uint16_t), 8);
+        size_t blockPages = 0;
+        for (const auto &[blockSize, count] : classes)
+        {
+            if (count > UINT32_MAX)
+            {
+                return nullptr;
+            }
+            blockPages += alignUp(blockSize * count, PAGE_SIZE) / PAGE_SIZE;
+        }
+        size_t blocksOffset = alignUp(pageTableOffset + blockPages * sizeof(uint16_t), PAGE_SIZE);
+        size_t size = blocksOffset + blockPages * PAGE_SIZE;
+        // 偏移以ALIGNMENT为单位存放在32位中
+        if (size / ALIGNMENT > UINT32_MAX)
+        {
+            return nullptr;
+        }
+
+        // MAP_POPULATE在映射时就分配全部物理页，mlock保证之后不会被换出
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        bool locked = mlock(memory, size) == 0;
+        if (!locked && requireLocked)
+        {
+            munmap(memory, size);
+            return nullptr;
+        }
+
+        char *base = static_cast<char *>(memory);
+        RealtimePool *pool = new (base) RealtimePool();
+        pool->base_ = base;
+        pool->size_ = size;
+        pool->locked_ = locked;
+        pool->classes_ = reinterpret_cast<ClassState *>(base + classesOffset);
+        pool->numClasses_ = classes.size();
+        pool->sizeTable_ = reinterpret_cast<uint16_t *>(base + sizeTableOffset);
+        pool->maxBlockSize_ = maxBlockSize;
+        pool->pageClass_ = reinterpret_cast<uint16_t *>(base + pageTableOffset);
+        pool->blocks_ = base + blocksOffset;
+        pool->blocksEnd_ = base + size;
+
+        // 切分每个大小类的区域，内存块按地址顺序串成栈
+        char *begin = pool->blocks_;
+        size_t index = 0;
+        size_t smallest = 0;
+        for (const auto &[blockSize, count] : classes)
+        {
+            ClassState *state = new (&pool->classes_[index]) ClassState();
+            state->blockSize = static_cast<uint32_t>(blockSize);
+            state->capacity = static_cast<uint32_t>(count);
+            state->begin = begin;
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                char *block = begin + i * blockSize;
+                uint32_t next = i + 1 < count ? static_cast<uint32_t>((block + blockSize - base) / ALIGNMENT) : 0;
+                *reinterpret_cast<uint32_t *>(block) = next;
+            }
+            state->head.store((begin - base) / ALIGNMENT, std::memory_order_relaxed);
+
+            size_t pages = alignUp(blockSize * count, PAGE_SIZE) / PAGE_SIZE;
+            size_t firstPage = (begin - pool->blocks_) / PAGE_SIZE;
+            for (size_t page = firstPage; page < firstPage + pages; ++page)
+            {
+                pool->pageClass_[page] = static_cast<uint16_t>(index);
+            }
+            for (; smallest < blockSize / ALIGNMENT; ++smallest)
+            {
+                pool->sizeTable_[smallest] = static_cast<uint16_t>(index);
+            }
+
+            begin += pages * PAGE_SIZE;
+            ++index;
+        }
+
+        // 其他线程通过之后的同步（例如创建线程）看到初始化的结果
+        std::atomic_thread_fence(std::memory_order_release);
+        return pool;
+    }
+
+    void RealtimePool::destroy()
+    {
+        // 本对象位于映射之中
+        char *base = base_;
+        size_t size = size_;
+        this->~RealtimePool();
+        munmap(base, size);
+    }
+
+    void *RealtimePool::allocate(size_t size)
+    {
+        if (size == 0)
+        {
+            size = 1;
+        }
+        if (size > maxBlockSize_)
+        {
+            return nullptr;
+        }
+        return pop(classes_[sizeTable_[(size - 1) / ALIGNMENT]]);
+    }
+
+    void RealtimePool::deallocate(void *ptr)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+        char *block = static_cast<char *>(ptr);
+        if constexpr (HARDENED)
+        {
+            if (!contains(ptr))
+            {
+                Hardening::reportError("freed pointer does not belong to the real-time pool", ptr);
+            }
+        }
+        ClassState &state = classes_[pageClass_[(block - blocks_) / PAGE_SIZE]];
+        if constexpr (HARDENED)
+        {
+            // 块的起始地址到所在区域起始的距离是块大小的倍数
+            if (static_cast<size_t>(block - state.begin) % state.blockSize != 0 ||
+                block >= state.begin + size_t(state.blockSize) * state.capacity)
+            {
+                Hardening::reportError("freed pointer is not the start of a real-time pool block", ptr);
+            }
+        }
+        push(state, block);
+    }
+
+    bool RealtimePool::contains(const void *ptr) const
+    {
+        const char *p = static_cast<const char *>(ptr);
+        return p >= blocks_ && p < blocksEnd_;
+    }
+
+    size_t RealtimePool::classBlockSize(size_t index) const
+    {
+        return index < numClasses_ ? classes_[index].blockSize : 0;
+    }
+
+    size_t RealtimePool::classCapacity(size_t index) const
+    {
+        return index < numClasses_ ? classes_[index].capacity : 0;
+    }
+
+    void *RealtimePool::pop(ClassState &state)
+    {
+        uint64_t head = state.head.load(std::memory_order_acquire);
+        while (true)
+        {
+            uint32_t offset = static_cast<uint32_t>(head);
+            if (offset == 0)
+            {
+                return nullptr;
+            }
+            char *block = base_ + size_t(offset) * ALIGNMENT;
+            // 内存块可能刚被其他线程取走并写入，读到的值无效时版本号必然已经改变，下面的CAS会失败
+            uint32_t next = __atomic_load_n(reinterpret_cast<uint32_t *>(block), __ATOMIC_RELAXED);
+            uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+            if (state.head.compare_exchange_weak(head, newHead, std::memory_order_acquire,
+                                                 std::memory_order_acquire))
+            {
+                return block;
+            }
+        }
+    }
+
+    void RealtimePool::push(ClassState &state, void *block)
+    {
+        uint32_t offset = static_cast<uint32_t>((static_cast<char *>(block) - base_) / ALIGNMENT);
+        uint64_t head = state.head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            __atomic_store_n(static_cast<uint32_t *>(block), static_cast<uint32_t>(head), __ATOMIC_RELAXED);
+            uint64_t newHead = (((head >> 32) + 1) << 32) | offset;
+            if (state.head.compare_exchange_weak(head, newHead, std::memory_order_release,
+                                                 std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+    }
+} // namespace MyMemoryPool
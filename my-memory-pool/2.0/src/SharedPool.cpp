@@ -0,0 +1,546 @@
+#include "../include/SharedPool.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace MyMemoryPool
+{
+    namespace
+    {
+        constexpr uint64_t SEGMENT_MAGIC = 0x4d594d504f4f4c31; // "MYMPOOL1"
+
+        // 页描述符的状态
+        constexpr uint8_t SPAN_FREE = 1;  // 位于页堆的空闲链表中
+        constexpr uint8_t SPAN_LARGE = 2; // 整体分配出去的大对象
+        constexpr uint8_t SPAN_SMALL = 3; // 按大小类切分
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be address-free");
+
+        // 大小类的状态，各占一个缓存行
+        struct alignas(64) ClassState
+        {
+            pthread_mutex_t mutex;
+            uint32_t partial; // 还有空闲块的span组成的链表，0表示空
+        };
+
+        void initSharedMutex(pthread_mutex_t &mutex)
+        {
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(&mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+        }
+
+        // 持锁进程崩溃后由下一个加锁者恢复锁的可用状态
+        class SharedLockGuard
+        {
+        public:
+            explicit SharedLockGuard(pthread_mutex_t &mutex) : mutex_(mutex)
+            {
+                if (pthread_mutex_lock(&mutex_) == EOWNERDEAD)
+                {
+                    pthread_mutex_consistent(&mutex_);
+                }
+            }
+            ~SharedLockGuard() { pthread_mutex_unlock(&mutex_); }
+
+            SharedLockGuard(const SharedLockGuard &) = delete;
+            SharedLockGuard &operator=(const SharedLockGuard &) = delete;
+
+        private:
+            pthread_mutex_t &mutex_;
+        };
+    } // namespace
+
+    // 段起始处的头部，其后是每页一个的描述符数组，再之后是数据页
+    struct SharedPool::Header
+    {
+        std::atomic<uint64_t> magic; // 初始化完成后写入
+        uint64_t size;
+        uint32_t numPages;      // 段的总页数，包括头部和描述符占用的页
+        uint32_t firstDataPage; // 第一个可分配的页号，因此页号0可以表示空
+        std::atomic<uint64_t> root;
+        pthread_mutex_t pageMutex; // 保护页堆：freeLists、freePages和空闲span的描述符
+        uint64_t freePages;
+        uint32_t freeLists[MAX_BUCKET_PAGES + 1]; // 下标为页数，0号链表存放更大的span
+        ClassState classes[NUM_CLASSES];
+    };
+
+    // 页描述符：已分配span的每一页都记录首页号，空闲span只保证首尾两页有效（用于合并）
+    // 其余字段只在span的首页有效
+    struct SharedPool::SpanDesc
+    {
+        uint32_t start;
+        uint32_t numPages;
+        uint32_t next; // 空闲链表或大小类部分空闲链表中的前后span，使用首页号
+        uint32_t prev;
+        uint32_t useCount; // 已分配出去的内存块数量
+        uint8_t state;
+        uint8_t sizeClass;
+        uint64_t freeList;   // 被回收的内存块组成的链表，块内保存下一块的偏移
+        uint64_t bumpOffset; // 从未使用过的内存的起始偏移，按需切分
+        uint64_t bumpEnd;
+    };
+
+    const size_t SharedPool::DESC_OFFSET = (sizeof(Header) + 63) / 64 * 64;
+
+    SharedPool *SharedPool::create(size_t size)
+    {
+        int fd = memfd_create("MyMemoryPool.SharedPool", MFD_CLOEXEC);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        return createFromFd(fd, size);
+    }
+
+    SharedPool *SharedPool::create(const char *name, size_t size)
+    {
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        SharedPool *pool = createFromFd(fd, size);
+        if (pool == nullptr)
+        {
+            shm_unlink(name);
+        }
+        return pool;
+    }
+
+    SharedPool *SharedPool::attach(int fd)
+    {
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (copy < 0)
+        {
+            return nullptr;
+        }
+        return mapExisting(copy);
+    }
+
+    SharedPool *SharedPool::open(const char *name)
+    {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        return mapExisting(fd);
+    }
+
+    bool SharedPool::unlink(const char *name)
+    {
+        return shm_unlink(name) == 0;
+    }
+
+    void SharedPool::detach()
+    {
+        delete this;
+    }
+
+    SharedPool::~SharedPool()
+    {
+        munmap(base_, size_);
+        close(fd_);
+    }
+
+    SharedPool *SharedPool::createFromFd(int fd, size_t size)
+    {
+        size = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        size_t numPages = size / PAGE_SIZE;
+        size_t firstDataPage = (DESC_OFFSET + numPages * sizeof(SpanDesc) + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (numPages > UINT32_MAX || numPages < firstDataPage + MIN_CLASS_PAGES || ftruncate(fd, size) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        // 新扩展的段全部为0，没有写入的描述符不占用物理内存
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        SharedPool *pool = new SharedPool(fd, static_cast<char *>(memory), size);
+        Header *header = new (memory) Header();
+        header->size = size;
+        header->numPages = static_cast<uint32_t>(numPages);
+        header->firstDataPage = static_cast<uint32_t>(firstDataPage);
+        initSharedMutex(header->pageMutex);
+        for (ClassState &cls : header->classes)
+        {
+            initSharedMutex(cls.mutex);
+        }
+
+        // 全部数据页组成一个空闲span
+        uint32_t start = header->firstDataPage;
+        uint32_t count = header->numPages - start;
+        SpanDesc &first = pool->desc(start);
+        SpanDesc &last = pool->desc(start + count - 1);
+        first.start = last.start = start;
+        first.numPages = last.numPages = count;
+        first.state = last.state = SPAN_FREE;
+        pool->insertFree(start);
+        header->freePages = count;
+
+        header->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+        return pool;
+    }
+
+    SharedPool *SharedPool::mapExisting(int fd)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        {
+            close(fd);
+            return nullptr;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        // 尚未初始化完成或不是本内存池创建的段
+        Header *header = static_cast<Header *>(memory);
+        if (header->magic.load(std::memory_order_acquire) != SEGMENT_MAGIC || header->size != size)
+        {
+            munmap(memory, size);
+            close(fd);
+            return nullptr;
+        }
+        return new SharedPool(fd, static_cast<char *>(memory), size);
+    }
+
+    void *SharedPool::allocate(size_t size)
+    {
+        Header *h = header();
+        if (size <= MAX_SMALL)
+        {
+            size_t index = classIndex(size);
+            SharedLockGuard lock(h->classes[index].mutex);
+            return allocateSmall(index);
+        }
+
+        if (size > capacity())
+        {
+            return nullptr;
+        }
+        size_t numPages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        SharedLockGuard lock(h->pageMutex);
+        uint32_t start = allocatePages(numPages, SPAN_LARGE);
+        if (start == 0)
+        {
+            return nullptr;
+        }
+        return base_ + size_t(start) * PAGE_SIZE;
+    }
+
+    void SharedPool::deallocate(void *ptr)
+    {
+        Header *h = header();
+        uint64_t offset = offsetOf(ptr);
+        if (offset < size_t(h->firstDataPage) * PAGE_SIZE || offset >= size_)
+        {
+            return;
+        }
+
+        // 内存块尚未释放，所在span不会被回收，描述符可以不加锁读取
+        SpanDesc &pageDesc = desc(static_cast<uint32_t>(offset / PAGE_SIZE));
+        uint32_t start = pageDesc.start;
+        if (pageDesc.state == SPAN_LARGE)
+        {
+            SharedLockGuard lock(h->pageMutex);
+            if (desc(start).state == SPAN_LARGE && offset == size_t(start) * PAGE_SIZE)
+            {
+                freePages(start);
+            }
+            return;
+        }
+        if (pageDesc.state != SPAN_SMALL)
+        {
+            return;
+        }
+
+        SpanDesc &span = desc(start);
+        size_t index = span.sizeClass;
+        ClassState &cls = h->classes[index];
+        SharedLockGuard lock(cls.mutex);
+        bool wasFull = span.freeList == 0 && span.bumpOffset == span.bumpEnd;
+        *reinterpret_cast<uint64_t *>(ptr) = span.freeList;
+        span.freeList = offset;
+        --span.useCount;
+        if (wasFull)
+        {
+            insertPartial(index, start);
+        }
+
+        // 保留最后一个空span，避免单个内存块反复分配释放时每次都访问页堆
+        if (span.useCount == 0 && (cls.partial != start || span.next != 0))
+        {
+            removePartial(index, start);
+            SharedLockGuard pageLock(h->pageMutex);
+            freePages(start);
+        }
+    }
+
+    uint64_t SharedPool::offsetOf(const void *ptr) const
+    {
+        return ptr != nullptr ? static_cast<uint64_t>(static_cast<const char *>(ptr) - base_) : 0;
+    }
+
+    void *SharedPool::pointerAt(uint64_t offset) const
+    {
+        return offset != 0 ? base_ + offset : nullptr;
+    }
+
+    void SharedPool::setRoot(void *ptr)
+    {
+        header()->root.store(offsetOf(ptr), std::memory_order_release);
+    }
+
+    void *SharedPool::root() const
+    {
+        return pointerAt(header()->root.load(std::memory_order_acquire));
+    }
+
+    size_t SharedPool::capacity() const
+    {
+        return size_t(header()->numPages - header()->firstDataPage) * PAGE_SIZE;
+    }
+
+    size_t SharedPool::freeBytes() const
+    {
+        Header *h = header();
+        SharedLockGuard lock(h->pageMutex);
+        return h->freePages * PAGE_SIZE;
+    }
+
+    SharedPool::SpanDesc &SharedPool::desc(uint32_t page) const
+    {
+        return reinterpret_cast<SpanDesc *>(base_ + DESC_OFFSET)[page];
+    }
+
+    uint32_t SharedPool::allocatePages(size_t numPages, uint8_t state)
+    {
+        Header *h = header();
+        uint32_t start = 0;
+        for (size_t bucket = numPages; bucket <= MAX_BUCKET_PAGES && start == 0; ++bucket)
+        {
+            start = h->freeLists[bucket];
+        }
+        if (start == 0)
+        {
+            // 大span链表中取最合适的
+            for (uint32_t span = h->freeLists[0]; span != 0; span = desc(span).next)
+            {
+                if (desc(span).numPages >= numPages && (start == 0 || desc(span).numPages < desc(start).numPages))
+                {
+                    start = span;
+                }
+            }
+            if (start == 0)
+            {
+                return 0;
+            }
+        }
+        removeFree(start);
+
+        SpanDesc &span = desc(start);
+        if (span.numPages > numPages)
+        {
+            uint32_t rest = start + static_cast<uint32_t>(numPages);
+            uint32_t restPages = span.numPages - static_cast<uint32_t>(numPages);
+            SpanDesc &first = desc(rest);
+            SpanDesc &last = desc(rest + restPages - 1);
+            first.start = last.start = rest;
+            first.numPages = last.numPages = restPages;
+            first.state = last.state = SPAN_FREE;
+            insertFree(rest);
+            span.numPages = static_cast<uint32_t>(numPages);
+        }
+        h->freePages -= numPages;
+
+        // 每一页都指向首页，并覆盖空闲时留下的边界标记
+        for (uint32_t page = start; page < start + numPages; ++page)
+        {
+            desc(page).start = start;
+            desc(page).state = state;
+        }
+        return start;
+    }
+
+    void SharedPool::freePages(uint32_t start)
+    {
+        Header *h = header();
+        uint32_t numPages = desc(start).numPages;
+        for (uint32_t page = start; page < start + numPages; ++page)
+        {
+            desc(page).state = SPAN_FREE;
+        }
+        h->freePages += numPages;
+
+        // 相邻页一定是相邻span的边界页，空闲时其中的首页号有效
+        if (start > h->firstDataPage && desc(start - 1).state == SPAN_FREE)
+        {
+            uint32_t prev = desc(start - 1).start;
+            removeFree(prev);
+            numPages += desc(prev).numPages;
+            start = prev;
+        }
+        uint32_t end = start + numPages;
+        if (end < h->numPages && desc(end).state == SPAN_FREE)
+        {
+            removeFree(end);
+            numPages += desc(end).numPages;
+        }
+
+        SpanDesc &first = desc(start);
+        SpanDesc &last = desc(start + numPages - 1);
+        first.start = last.start = start;
+        first.numPages = last.numPages = numPages;
+        insertFree(start);
+    }
+
+    void SharedPool::insertFree(uint32_t start)
+    {
+        SpanDesc &span = desc(start);
+        uint32_t &head = header()->freeLists[span.numPages <= MAX_BUCKET_PAGES ? span.numPages : 0];
+        span.prev = 0;
+        span.next = head;
+        if (head != 0)
+        {
+            desc(head).prev = start;
+        }
+        head = start;
+    }
+
+    void SharedPool::removeFree(uint32_t start)
+    {
+        SpanDesc &span = desc(start);
+        uint32_t &head = header()->freeLists[span.numPages <= MAX_BUCKET_PAGES ? span.numPages : 0];
+        if (span.prev != 0)
+        {
+            desc(span.prev).next = span.next;
+        }
+        else
+        {
+            head = span.next;
+        }
+        if (span.next != 0)
+        {
+            desc(span.next).prev = span.prev;
+        }
+    }
+
+    void *SharedPool::allocateSmall(size_t index)
+    {
+        Header *h = header();
+        ClassState &cls = h->classes[index];
+        size_t size = classSize(index);
+        uint32_t start = cls.partial;
+        if (start == 0)
+        {
+            // 每个span至少能切出8个内存块
+            size_t numPages = std::max(MIN_CLASS_PAGES, (size * 8 + PAGE_SIZE - 1) / PAGE_SIZE);
+            {
+                SharedLockGuard lock(h->pageMutex);
+                start = allocatePages(numPages, SPAN_SMALL);
+            }
+            if (start == 0)
+            {
+                return nullptr;
+            }
+
+            SpanDesc &span = desc(start);
+            span.sizeClass = static_cast<uint8_t>(index);
+            span.useCount = 0;
+            span.freeList = 0;
+            span.bumpOffset = size_t(start) * PAGE_SIZE;
+            span.bumpEnd = span.bumpOffset + numPages * PAGE_SIZE / size * size;
+            insertPartial(index, start);
+        }
+
+        SpanDesc &span = desc(start);
+        uint64_t block;
+        if (span.freeList != 0)
+        {
+            block = span.freeList;
+            span.freeList = *reinterpret_cast<uint64_t *>(base_ + block);
+        }
+        else
+        {
+            block = span.bumpOffset;
+            span.bumpOffset += size;
+        }
+        ++span.useCount;
+        if (span.freeList == 0 && span.bumpOffset == span.bumpEnd)
+        {
+            removePartial(index, start);
+        }
+        return base_ + block;
+    }
+
+    void SharedPool::insertPartial(size_t index, uint32_t start)
+    {
+        uint32_t &head = header()->classes[index].partial;
+        SpanDesc &span = desc(start);
+        span.prev = 0;
+        span.next = head;
+        if (head != 0)
+        {
+            desc(head).prev = start;
+        }
+        head = start;
+    }
+
+    void SharedPool::removePartial(size_t index, uint32_t start)
+    {
+        SpanDesc &span = desc(start);
+        if (span.prev != 0)
+        {
+            desc(span.prev).next = span.next;
+        }
+        else
+        {
+            header()->classes[index].partial = span.next;
+        }
+        if (span.next != 0)
+        {
+            desc(span.next).prev = span.prev;
+        }
+    }
+
+    size_t SharedPool::classIndex(size_t size)
+    {
+        size = std::max<size_t>(size, 1);
+        if (size <= 256)
+        {
+            return (size + 15) / 16 - 1;
+        }
+        // size位于(2^shift, 2^(shift+1)]，该区间分为4档
+        size_t shift = 63 - __builtin_clzll(size - 1);
+        size_t step = size_t(1) << (shift - 2);
+        return 16 + (shift - 8) * 4 + (size - (size_t(1) << shift) + step - 1) / step - 1;
+    }
+
+    size_t SharedPool::classSize(size_t index)
+    {
+        if (index < 16)
+        {
+            return (index + 1) * 16;
+        }
+        size_t shift = 8 + (index - 16) / 4;
+        return (size_t(1) << shift) + ((index - 16) % 4 + 1) * (size_t(1) << (shift - 2));
+    }
+} // namespace MyMemoryPool
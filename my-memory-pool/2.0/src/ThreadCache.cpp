@@ -1,8 +1,312 @@
 #include "../include/ThreadCache.hpp"
 #include "../include/CentralCache.hpp"
+#include "../include/Hardening.hpp"
+#include "../include/Heap.hpp"
+#include "../include/NumaTopology.hpp"
+#include "../include/PageCache.hpp"
+#include <algorithm>
 
 namespace MyMemoryPool
 {
+    // 所有存在的ThreadCache，永不析构，线程退出时仍会访问
+    struct ThreadCacheList
+    {
+        std::mutex mutex;
+        ThreadCache *head = nullptr;
+    };
+
+    static ThreadCacheList &threadCacheList()
+    {
+        static ThreadCacheList *list = new ThreadCacheList();
+        return *list;
+    }
+
+    // 已退出线程停放的默认堆缓存，按NUMA节点分开
+    // 与PageCache的span缓存相同，每个槽位用一次CAS放入、一次exchange取出，取出前不访问缓存对象本身
+    static std::array<std::array<std::atomic<ThreadCache *>, ThreadCache::PARKED_CACHES>, MAX_NUMA_NODES> parkedCaches;
+
+    // 当前线程的默认堆缓存，普通指针，快速路径上没有线程局部对象的初始化检查
+    static thread_local ThreadCache *localCache = nullptr;
+
+    // LocalCacheOwner已析构：之后析构的线程局部对象仍可能分配和释放，不能再接管或创建缓存
+    static thread_local bool threadExiting = false;
+
+    // 线程退出时停放localCache，留给之后的新线程；第一次装上缓存时访问，由此注册析构
+    struct LocalCacheOwner
+    {
+        bool armed = false;
+
+        ~LocalCacheOwner()
+        {
+            threadExiting = true;
+            if (armed)
+            {
+                ThreadCache::attach(nullptr);
+            }
+        }
+    };
+    static thread_local LocalCacheOwner localCacheOwner;
+
+    ThreadCache *ThreadCache::getInstance()
+    {
+        ThreadCache *cache = localCache;
+        if (cache == nullptr)
+        {
+            if (threadExiting)
+            {
+                return nullptr;
+            }
+            cache = adoptParked(NumaTopology::getInstance().currentNode());
+            if (cache == nullptr)
+            {
+                cache = create(&Heap::defaultHeap());
+                if (cache == nullptr)
+                {
+                    throw std::bad_alloc();
+                }
+            }
+            localCacheOwner.armed = true;
+            localCache = cache;
+        }
+        return cache;
+    }
+
+    ThreadCache *ThreadCache::create(Heap *heap)
+    {
+        void *memory = mmap(nullptr, sizeof(ThreadCache), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        return new (memory) ThreadCache(heap);
+    }
+
+    void ThreadCache::destroy(ThreadCache *cache)
+    {
+        cache->~ThreadCache();
+        munmap(cache, sizeof(ThreadCache));
+    }
+
+    void ThreadCache::park(ThreadCache *cache)
+    {
+        for (std::atomic<ThreadCache *> &slot : parkedCaches[cache->node_])
+        {
+            ThreadCache *expected = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr &&
+                slot.compare_exchange_strong(expected, cache, std::memory_order_release, std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+        destroy(cache);
+    }
+
+    ThreadCache *ThreadCache::adoptParked(size_t node)
+    {
+        for (std::atomic<ThreadCache *> &slot : parkedCaches[node])
+        {
+            if (slot.load(std::memory_order_relaxed) == nullptr)
+            {
+                continue;
+            }
+            ThreadCache *cache = slot.exchange(nullptr, std::memory_order_acquire);
+            if (cache != nullptr)
+            {
+                cache->setOwner();
+                return cache;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t ThreadCache::parkedCount()
+    {
+        size_t count = 0;
+        for (auto &slots : parkedCaches)
+        {
+            for (std::atomic<ThreadCache *> &slot : slots)
+            {
+                count += slot.load(std::memory_order_relaxed) != nullptr;
+            }
+        }
+        return count;
+    }
+
+    void ThreadCache::setOwner()
+    {
+        std::lock_guard<std::mutex> lock(threadCacheList().mutex);
+        owner_ = pthread_self();
+    }
+
+    ThreadCache *ThreadCache::detach()
+    {
+        ThreadCache *cache = localCache;
+        localCache = nullptr;
+        return cache;
+    }
+
+    void ThreadCache::attach(ThreadCache *cache)
+    {
+        if (cache == localCache)
+        {
+            return;
+        }
+        if (localCache != nullptr)
+        {
+            park(localCache);
+        }
+        if (cache != nullptr)
+        {
+            cache->setOwner();
+            localCacheOwner.armed = true;
+        }
+        localCache = cache;
+    }
+
+    void ThreadCache::releaseParked()
+    {
+        for (auto &slots : parkedCaches)
+        {
+            for (std::atomic<ThreadCache *> &slot : slots)
+            {
+                if (ThreadCache *cache = slot.exchange(nullptr, std::memory_order_acquire))
+                {
+                    destroy(cache);
+                }
+            }
+        }
+    }
+
+    ThreadCache::ThreadCache(Heap *heap)
+        : heap_(heap), node_(NumaTopology::getInstance().currentNode()),
+          central_(&heap->centralCache(node_)), releaseEpoch_(heap->releaseEpoch()),
+          owner_(pthread_self()), prevCache_(nullptr)
+    {
+        ThreadCacheList &list = threadCacheList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        nextCache_ = list.head;
+        if (list.head != nullptr)
+        {
+            list.head->prevCache_ = this;
+        }
+        list.head = this;
+    }
+
+    // 线程退出时把缓存的内存块还给中心缓存（所属的堆已销毁时除外），再从链表中移除
+    ThreadCache::~ThreadCache()
+    {
+        if (heap_ != nullptr)
+        {
+            releaseAll();
+        }
+        ThreadCacheList &list = threadCacheList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        if (prevCache_ != nullptr)
+        {
+            prevCache_->nextCache_ = nextCache_;
+        }
+        else
+        {
+            list.head = nextCache_;
+        }
+        if (nextCache_ != nullptr)
+        {
+            nextCache_->prevCache_ = prevCache_;
+        }
+    }
+
+    void ThreadCache::collectCachedBlocks(const Heap *heap, std::vector<void *> &blocks)
+    {
+        ThreadCacheList &list = threadCacheList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        for (ThreadCache *cache = list.head; cache != nullptr; cache = cache->nextCache_)
+        {
+            if (cache->heap_ != heap)
+            {
+                continue;
+            }
+            for (const FreeList &freeList : cache->freeLists_)
+            {
+                void *block = freeList.head;
+                for (uint32_t i = 0; i < freeList.length && block != nullptr; ++i)
+                {
+                    blocks.push_back(block);
+                    block = nextBlock(block);
+                }
+            }
+        }
+    }
+
+    void ThreadCache::detachHeap(Heap *heap)
+    {
+        ThreadCacheList &list = threadCacheList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        for (ThreadCache *cache = list.head; cache != nullptr; cache = cache->nextCache_)
+        {
+            if (cache->heap_ == heap)
+            {
+                cache->heap_ = nullptr;
+            }
+        }
+    }
+
+    void ThreadCache::lockForFork()
+    {
+        threadCacheList().mutex.lock();
+    }
+
+    void ThreadCache::unlockAfterFork()
+    {
+        threadCacheList().mutex.unlock();
+    }
+
+    void ThreadCache::reclaimAfterFork()
+    {
+        ThreadCacheList &list = threadCacheList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        // 停放的缓存不属于任何线程，即使owner_恰好等于当前线程也一并回收
+        std::vector<ThreadCache *> parked;
+        for (auto &slots : parkedCaches)
+        {
+            for (std::atomic<ThreadCache *> &slot : slots)
+            {
+                if (ThreadCache *cache = slot.exchange(nullptr, std::memory_order_relaxed))
+                {
+                    parked.push_back(cache);
+                }
+            }
+        }
+        pthread_t self = pthread_self();
+        ThreadCache *cache = list.head;
+        while (cache != nullptr)
+        {
+            ThreadCache *next = cache->nextCache_;
+            bool isParked = std::find(parked.begin(), parked.end(), cache) != parked.end();
+            if (isParked || !pthread_equal(cache->owner_, self))
+            {
+                // 所属的线程在子进程中不存在，缓存对象本身随之废弃，不会再被访问
+                if (cache->heap_ != nullptr)
+                {
+                    cache->releaseAll();
+                }
+                if (cache->prevCache_ != nullptr)
+                {
+                    cache->prevCache_->nextCache_ = next;
+                }
+                else
+                {
+                    list.head = next;
+                }
+                if (next != nullptr)
+                {
+                    next->prevCache_ = cache->prevCache_;
+                }
+            }
+            cache = next;
+        }
+    }
+
     void *ThreadCache::allocate(size_t size)
     {
         assert(size >= 0);
@@ -11,82 +315,553 @@ namespace MyMemoryPool
             size = ALIGNMENT;
         }
 
-        if (size > MAX_BYTES) // 256KB
+        // 加固模式下在用户数据之后预留金丝雀的空间，标记模式下在内存块末尾预留标签的空间
+        size_t blockSize = blockSizeFor(size);
+
+        if (blockSize > MAX_BYTES) // 256KB
         {
-            // 大对象直接从系统分配
-            return malloc(size);
+            if constexpr (HARDENED)
+            {
+                // 加固模式下大对象带保护页
+                return Hardening::allocateLarge(size);
+            }
+            return allocateLarge(heap_->pageCache(node_), size);
         }
 
-        size_t index = SizeClass::getIndex(size);
+        size_t index = SizeClass::getIndex(blockSize);
 
         // 从自由链表中获取
-        freeListSize_[index]--;
-
-        if (void *ptr = freeList_[index])
+        FreeList &list = freeLists_[index];
+        void *ptr = list.head;
+        if (ptr != nullptr)
         {
-            // freeList_[index] = freeList_[index]->next
-            freeList_[index] = *reinterpret_cast<void **>(ptr);
-            return ptr;
+            // list.head = list.head->next
+            list.head = nextBlock(ptr);
+            // 下次分配读取的是新链表头中的next，提前载入
+            __builtin_prefetch(list.head);
+            list.length--;
+            list.lowWater = static_cast<uint16_t>(std::min<uint32_t>(list.lowWater, list.length));
+            if constexpr (HARDENED)
+            {
+                Hardening::checkFreeBlock(list.head, SizeClass::roundUp(blockSize));
+            }
         }
+        else
+        {
+            // 从中心缓存获取
+            ptr = fetchFromCentralCache(index);
+        }
+        return onAllocate(ptr, size, SizeClass::roundUp(blockSize));
+    }
 
-        // 从中心缓存获取
-        return fetchFromCentralCache(index);
+    void *ThreadCache::onAllocate(void *ptr, size_t size, size_t blockSize)
+    {
+        if constexpr (HARDENED)
+        {
+            if (ptr != nullptr)
+            {
+                Hardening::onAllocate(ptr, size, blockSize);
+            }
+        }
+        if constexpr (TAGGED)
+        {
+            if (ptr != nullptr)
+            {
+                MemoryTags::onAllocateBlock(ptr, blockSize);
+            }
+        }
+        return ptr;
     }
 
     void ThreadCache::deallocate(void *ptr, size_t size)
     {
-        if (size > MAX_BYTES)
+        if (size == 0)
+        {
+            size = ALIGNMENT;
+        }
+
+        size_t blockSize = blockSizeFor(size);
+
+        if (blockSize > MAX_BYTES)
         {
-            // 大对象是由malloc分配的 用free释放
-            free(ptr);
+            deallocateLarge(ptr, size);
             return;
         }
 
         // 确定内存块在哪条自由链表
-        size_t index = SizeClass::getIndex(size);
+        size_t index = SizeClass::getIndex(blockSize);
+
+        // 加固模式下检查重复释放、非法释放和越界写入
+        if constexpr (HARDENED)
+        {
+            Hardening::onDeallocate(ptr, size, SizeClass::roundUp(blockSize));
+        }
+        if constexpr (TAGGED)
+        {
+            MemoryTags::onDeallocateBlock(ptr, SizeClass::roundUp(blockSize));
+        }
+
+        cacheBlock(ptr, index, SizeClass::roundUp(blockSize));
+    }
+
+    void ThreadCache::deallocate(void *ptr)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr)
+        {
+            // 加固模式下的大对象使用独立映射，不在PageMap中
+            if constexpr (HARDENED)
+            {
+                Hardening::deallocateLarge(ptr);
+            }
+            return;
+        }
+
+        if (&span->owner->heap() != heap_)
+        {
+            span->owner->heap().deallocate(ptr);
+            return;
+        }
+
+        // 未切分的span是大对象
+        if (span->blockSize == 0)
+        {
+            deallocateSpan(span, ptr);
+            return;
+        }
+
+        size_t blockSize = span->blockSize;
+        size_t index = SizeClass::getIndex(blockSize);
+        if constexpr (HARDENED)
+        {
+            Hardening::onDeallocate(ptr, 0, blockSize, false);
+        }
+        if constexpr (TAGGED)
+        {
+            MemoryTags::onDeallocateBlock(ptr, blockSize);
+        }
+        cacheBlock(ptr, index, blockSize);
+    }
+
+    void *ThreadCache::reallocate(void *ptr, size_t oldSize, size_t newSize)
+    {
+        if (ptr == nullptr)
+        {
+            return allocate(newSize);
+        }
+        if (newSize == 0)
+        {
+            deallocate(ptr, oldSize);
+            return nullptr;
+        }
+        if (oldSize == 0)
+        {
+            oldSize = ALIGNMENT;
+        }
+        if (void *resized = reallocateInPlace(ptr, oldSize, newSize))
+        {
+            return resized;
+        }
+
+        void *newPtr = nullptr;
+        if constexpr (TAGGED)
+        {
+            // 复制出的内存仍计入原来的标签
+            MemoryTagScope scope(tagOf(ptr, oldSize));
+            newPtr = allocate(newSize);
+        }
+        else
+        {
+            newPtr = allocate(newSize);
+        }
+        if (newPtr == nullptr)
+        {
+            return nullptr;
+        }
+        memcpy(newPtr, ptr, std::min(oldSize, newSize));
+        deallocate(ptr, oldSize);
+        return newPtr;
+    }
+
+    void *ThreadCache::reallocateInPlace(void *ptr, size_t oldSize, size_t newSize)
+    {
+        size_t oldBlockSize = blockSizeFor(oldSize);
+        size_t newBlockSize = blockSizeFor(newSize);
+        if (oldBlockSize <= MAX_BYTES && newBlockSize <= MAX_BYTES)
+        {
+            // 同一大小类：内存块已经足够大，标签记录在块末尾，也不需要改变
+            size_t blockSize = SizeClass::roundUp(oldBlockSize);
+            if (blockSize == SizeClass::roundUp(newBlockSize))
+            {
+                if constexpr (HARDENED)
+                {
+                    // 按原来的大小检查金丝雀，再写到新的大小之后
+                    Hardening::onDeallocate(ptr, oldSize, blockSize);
+                    Hardening::onAllocate(ptr, newSize, blockSize);
+                }
+                return ptr;
+            }
+        }
+        else if (oldBlockSize > MAX_BYTES && newBlockSize > MAX_BYTES)
+        {
+            // 加固模式下的大对象紧贴保护页，大小改变时起始地址必然改变，只能复制
+            if constexpr (!HARDENED)
+            {
+                return resizeLarge(ptr, newSize);
+            }
+        }
+        return nullptr;
+    }
+
+    // 不经过线程缓存，把一个内存块直接还给所属节点的中心缓存
+    static void returnBlock(Heap &heap, void *ptr, size_t index)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        size_t node = span != nullptr ? span->node : NumaTopology::getInstance().currentNode();
+        setNextBlock(ptr, nullptr);
+        heap.centralCache(node).returnRange(ptr, 1, index);
+    }
+
+    void *ThreadCache::allocateUncached(Heap &heap, size_t size)
+    {
+        if (size == 0)
+        {
+            size = ALIGNMENT;
+        }
+
+        size_t blockSize = blockSizeFor(size);
+        size_t node = NumaTopology::getInstance().currentNode();
+        if (blockSize > MAX_BYTES)
+        {
+            if constexpr (HARDENED)
+            {
+                return Hardening::allocateLarge(size);
+            }
+            return allocateLarge(heap.pageCache(node), size);
+        }
+
+        void *ptr = nullptr;
+        if (heap.centralCache(node).fetchRange(ptr, SizeClass::getIndex(blockSize), 1) == 0)
+        {
+            return nullptr;
+        }
+        return onAllocate(ptr, size, SizeClass::roundUp(blockSize));
+    }
+
+    void ThreadCache::deallocateUncached(Heap &heap, void *ptr, size_t size)
+    {
+        if (size == 0)
+        {
+            size = ALIGNMENT;
+        }
+
+        size_t blockSize = blockSizeFor(size);
+        if (blockSize > MAX_BYTES)
+        {
+            deallocateLarge(ptr, size);
+            return;
+        }
+
+        if constexpr (HARDENED)
+        {
+            Hardening::onDeallocate(ptr, size, SizeClass::roundUp(blockSize));
+        }
+        if constexpr (TAGGED)
+        {
+            MemoryTags::onDeallocateBlock(ptr, SizeClass::roundUp(blockSize));
+        }
+        returnBlock(heap, ptr, SizeClass::getIndex(blockSize));
+    }
+
+    void ThreadCache::deallocateUncached(void *ptr)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr)
+        {
+            if constexpr (HARDENED)
+            {
+                Hardening::deallocateLarge(ptr);
+            }
+            return;
+        }
+        if (span->blockSize == 0)
+        {
+            deallocateSpan(span, ptr);
+            return;
+        }
+
+        size_t blockSize = span->blockSize;
+        if constexpr (HARDENED)
+        {
+            Hardening::onDeallocate(ptr, 0, blockSize, false);
+        }
+        if constexpr (TAGGED)
+        {
+            MemoryTags::onDeallocateBlock(ptr, blockSize);
+        }
+        returnBlock(span->owner->heap(), ptr, SizeClass::getIndex(blockSize));
+    }
+
+    void *ThreadCache::reallocateUncached(Heap &heap, void *ptr, size_t oldSize, size_t newSize)
+    {
+        if (ptr == nullptr)
+        {
+            return allocateUncached(heap, newSize);
+        }
+        if (newSize == 0)
+        {
+            deallocateUncached(heap, ptr, oldSize);
+            return nullptr;
+        }
+        if (oldSize == 0)
+        {
+            oldSize = ALIGNMENT;
+        }
+        if (void *resized = reallocateInPlace(ptr, oldSize, newSize))
+        {
+            return resized;
+        }
+
+        void *newPtr = nullptr;
+        if constexpr (TAGGED)
+        {
+            MemoryTagScope scope(tagOf(ptr, oldSize));
+            newPtr = allocateUncached(heap, newSize);
+        }
+        else
+        {
+            newPtr = allocateUncached(heap, newSize);
+        }
+        if (newPtr == nullptr)
+        {
+            return nullptr;
+        }
+        memcpy(newPtr, ptr, std::min(oldSize, newSize));
+        deallocateUncached(heap, ptr, oldSize);
+        return newPtr;
+    }
+
+    void ThreadCache::releaseAll()
+    {
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            FreeList &list = freeLists_[index];
+            if (list.head != nullptr)
+            {
+                central_->returnRange(list.head, list.length, index);
+                list.head = nullptr;
+                list.length = 0;
+                list.lowWater = 0;
+            }
+        }
+    }
+
+    void *ThreadCache::allocateLarge(PageCache &pageCache, size_t size)
+    {
+        size_t numPages = (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+        void *ptr = pageCache.allocateSpan(numPages);
+        if constexpr (TAGGED)
+        {
+            if (ptr != nullptr)
+            {
+                PageMap::getInstance().get(ptr)->tag = MemoryTags::onAllocateLarge(numPages * PageCache::PAGE_SIZE);
+            }
+        }
+        return ptr;
+    }
+
+    void ThreadCache::deallocateLarge(void *ptr, size_t size)
+    {
+        if constexpr (HARDENED)
+        {
+            Hardening::deallocateLarge(ptr, size);
+            return;
+        }
+        // 大对象是整个span，归还给分配它的PageCache
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span != nullptr)
+        {
+            if constexpr (TAGGED)
+            {
+                MemoryTags::onDeallocateLarge(span->tag, span->numPages * PageCache::PAGE_SIZE);
+            }
+            span->owner->deallocateSpan(ptr, span->numPages);
+        }
+    }
+
+    void ThreadCache::deallocateSpan(Span *span, void *ptr)
+    {
+        if (span->isUse && span->pageAddr == ptr)
+        {
+            if constexpr (TAGGED)
+            {
+                MemoryTags::onDeallocateLarge(span->tag, span->numPages * PageCache::PAGE_SIZE);
+            }
+            span->owner->deallocateSpan(ptr, span->numPages);
+        }
+    }
+
+    void *ThreadCache::resizeLarge(void *ptr, size_t size)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        if (span == nullptr)
+        {
+            return nullptr;
+        }
+        size_t oldPages = span->numPages;
+        size_t newPages = (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+        void *resized = span->owner->resizeSpan(ptr, newPages);
+        if constexpr (TAGGED)
+        {
+            if (resized != nullptr)
+            {
+                MemoryTags::onResizeLarge(span->tag, oldPages * PageCache::PAGE_SIZE, newPages * PageCache::PAGE_SIZE);
+            }
+        }
+        return resized;
+    }
+
+    MemoryTag ThreadCache::tagOf(void *ptr, size_t size)
+    {
+        size_t blockSize = blockSizeFor(size);
+        if (blockSize <= MAX_BYTES)
+        {
+            return MemoryTags::blockTag(ptr, SizeClass::roundUp(blockSize));
+        }
+        if constexpr (HARDENED)
+        {
+            return static_cast<MemoryTag>(reinterpret_cast<size_t *>(ptr)[-2]);
+        }
+        Span *span = PageMap::getInstance().get(ptr);
+        return span != nullptr ? span->tag : 0;
+    }
+
+    void ThreadCache::cacheBlock(void *ptr, size_t index, size_t blockSize)
+    {
+        // 多节点时，其他节点的内存块直接送回所属节点，不在本线程复用
+        if (NumaTopology::getInstance().nodeCount() > 1)
+        {
+            Span *span = PageMap::getInstance().get(ptr);
+            if (span != nullptr && span->node != node_)
+            {
+                setNextBlock(ptr, nullptr);
+                heap_->centralCache(span->node).returnRange(ptr, 1, index);
+                return;
+            }
+        }
+
         // 插入到线程本地自由链表
-        // ptr->next = freeList_[index]
-        *reinterpret_cast<void **>(ptr) = freeList_[index];
-        freeList_[index] = ptr;
+        // ptr->next = list.head
+        FreeList &list = freeLists_[index];
+        setNextBlock(ptr, list.head);
+        list.head = ptr;
         // 更新自由链表的大小
-        freeListSize_[index]++;
+        list.length++;
 
         // 判断是否需要将部分内存回收给中心缓存
-        if (shouldReturnToCentralCache(index))
+        if (shouldReturnToCentralCache(list))
         {
-            returnToCentralCache(freeList_[index], size);
+            // 只释放其他线程分配的内存块的线程（如生产者/消费者中的消费者）从不向中心缓存取块，
+            // 上限在这里同样逐步增长，否则之后每次释放都要归还一块并获取中心缓存的锁
+            if (list.maxLength < THREAD_MAX_SIZE)
+            {
+                list.maxLength = static_cast<uint16_t>(
+                    std::min(THREAD_MAX_SIZE, list.maxLength + getBatchNum(blockSize)));
+            }
+            else if (!checkReleaseEpoch())
+            {
+                returnToCentralCache(list.head, blockSize);
+            }
         }
     }
 
-    bool ThreadCache::shouldReturnToCentralCache(size_t index)
+    bool ThreadCache::reserve(size_t index, size_t count, bool fillCache)
     {
-        // 设置自由链表大小的最大值
-        return freeListSize_[index] > THREAD_MAX_SIZE;
+        if (!central_->reserve(index, count))
+        {
+            return false;
+        }
+        if (!fillCache)
+        {
+            return true;
+        }
+
+        FreeList &list = freeLists_[index];
+        size_t wanted = std::min(count, THREAD_MAX_SIZE);
+        if (list.length >= wanted)
+        {
+            return true;
+        }
+        void *start = nullptr;
+        size_t fetchNum = central_->fetchRange(start, index, wanted - list.length);
+        if (fetchNum == 0)
+        {
+            return false;
+        }
+
+        // 接在现有链表之前，预热的大小类不再需要慢启动
+        void *tail = start;
+        for (size_t i = 1; i < fetchNum; ++i)
+        {
+            tail = nextBlock(tail);
+        }
+        setNextBlock(tail, list.head);
+        list.head = start;
+        list.length += static_cast<uint32_t>(fetchNum);
+        list.maxLength = static_cast<uint16_t>(std::max<size_t>(list.maxLength, list.length));
+        return true;
+    }
+
+    bool ThreadCache::checkReleaseEpoch()
+    {
+        uint64_t epoch = heap_->releaseEpoch();
+        if (epoch == releaseEpoch_)
+        {
+            return false;
+        }
+        releaseEpoch_ = epoch;
+        releaseAll();
+        return true;
     }
 
     // 当线程本地自由链表不足时，从中心缓存获取内存
     void *ThreadCache::fetchFromCentralCache(size_t index)
     {
+        checkReleaseEpoch();
+
         // 计算单个内存块的大小
         size_t size = (index + 1) * ALIGNMENT;
         // 根据内存块大小确定需要获取的数量
         size_t batchNum = getBatchNum(size);
-        // 从中心缓存获取内存
-        void *start = CentralCache::getInstance().fetchRange(index, batchNum);
-        if (start == nullptr)
+        // 从中心缓存获取内存，实际获取的数量可能少于batchNum
+        void *start = nullptr;
+        size_t fetchNum = central_->fetchRange(start, index, batchNum);
+        if (fetchNum == 0)
         {
             return nullptr;
         }
 
-        // 更新自由链表大小
-        freeListSize_[index] += batchNum;
-
-        // 取出一个内存块用于分配
+        // 取出一个内存块用于分配，其余的放入自由链表
         void *result = start;
-        if (batchNum > 1)
-        {
-            freeList_[index] = *reinterpret_cast<void **>(start);
-        }
+        FreeList &list = freeLists_[index];
+        list.head = nextBlock(start);
+
+        // 更新自由链表大小，链表刚被取空，最小值为0
+        list.length += fetchNum - 1;
+        list.lowWater = 0;
+
+        // 慢启动：需要从中心缓存取块的大小类逐步允许缓存更多内存块，很少使用的大小类只缓存少量
+        list.maxLength = static_cast<uint16_t>(std::min(THREAD_MAX_SIZE, list.maxLength + batchNum));
 
         return result;
     }
@@ -95,15 +870,17 @@ namespace MyMemoryPool
     void ThreadCache::returnToCentralCache(void *start, size_t size)
     {
         size_t index = SizeClass::getIndex(size);
+        FreeList &list = freeLists_[index];
         // 计算要归还内存块数量
-        size_t batchNum = freeListSize_[index];
+        size_t batchNum = list.length;
         if (batchNum <= 1)
         {
             return; // 如果只有一个块，则不归还
         }
 
         // 保留一部分在ThreadCache中 (1/4)
-        size_t keepNum = std::max(batchNum / 4, size_t(1));
+        // 链表底部的lowWater个内存块自上次归还以来从未被使用，它们超过3/4时全部归还
+        size_t keepNum = std::max(std::min(batchNum / 4, batchNum - std::min<size_t>(list.lowWater, batchNum)), size_t(1));
         size_t returnNum = batchNum - keepNum;
 
         // 得出分割点
@@ -111,7 +888,7 @@ namespace MyMemoryPool
         char *splitNode = current;
         for (size_t i = 0; i < keepNum - 1; ++i)
         {
-            splitNode = reinterpret_cast<char *>(*reinterpret_cast<void **>(splitNode));
+            splitNode = static_cast<char *>(nextBlock(splitNode));
             if (splitNode == nullptr)
             {
                 // 如果链表提前结束，更新实际的返回数量
@@ -124,18 +901,19 @@ namespace MyMemoryPool
         if (splitNode != nullptr)
         {
             // 将返回部分与保留部分分开
-            void *nextNode = *reinterpret_cast<void **>(splitNode);
-            *reinterpret_cast<void **>(splitNode) = nullptr;
+            void *nextNode = nextBlock(splitNode);
+            setNextBlock(splitNode, nullptr);
 
             // 更新自由链表的状态
-            freeList_[index] = start;
-            // 更新自由链表大小
-            freeListSize_[index] = keepNum;
+            list.head = start;
+            // 更新自由链表大小，保留的内存块作为下一轮的起点
+            list.length = static_cast<uint32_t>(keepNum);
+            list.lowWater = static_cast<uint16_t>(keepNum);
 
             if (returnNum > 0 && nextNode != nullptr)
             {
                 // 归还给中心缓存
-                CentralCache::getInstance().returnRange(nextNode, returnNum, index);
+                central_->returnRange(nextNode, returnNum, index);
             }
         }
     }
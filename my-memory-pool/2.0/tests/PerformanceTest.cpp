@@ -1,10 +1,30 @@
 #include "../include/MemoryPool.hpp"
+#include "../include/Arena.hpp"
+#include "../include/CentralCache.hpp"
+#include "../include/Heap.hpp"
+#include "../include/PoolResource.hpp"
+#include "../include/RealtimePool.hpp"
+#include "../include/SharedPool.hpp"
+#include "../include/ThreadCache.hpp"
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <random>
 #include <iomanip>
 #include <thread>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace MyMemoryPool;
 using namespace std::chrono;
@@ -24,6 +44,92 @@ public:
     }
 };
 
+// 本线程的L1数据缓存读缺失计数，内核不允许使用perf_event_open时不可用
+class L1MissCounter
+{
+    int fd_;
+
+public:
+    L1MissCounter()
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~L1MissCounter()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    void start()
+    {
+        if (fd_ >= 0)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // 返回start()以来的缺失次数，不可用时返回-1
+    long long stop()
+    {
+        long long count = -1;
+        if (fd_ >= 0)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count))
+            {
+                count = -1;
+            }
+        }
+        return count;
+    }
+};
+
+// 共享内存段中的单生产者单消费者环形队列，传递消息的段内偏移
+struct MessageRing
+{
+    static constexpr size_t SIZE = 1024;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    uint64_t slots[SIZE];
+
+    void push(uint64_t offset)
+    {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (pos - head.load(std::memory_order_acquire) == SIZE)
+        {
+            std::this_thread::yield();
+        }
+        slots[pos % SIZE] = offset;
+        tail.store(pos + 1, std::memory_order_release);
+    }
+
+    uint64_t pop()
+    {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (tail.load(std::memory_order_acquire) == pos)
+        {
+            std::this_thread::yield();
+        }
+        uint64_t offset = slots[pos % SIZE];
+        head.store(pos + 1, std::memory_order_release);
+        return offset;
+    }
+};
+
 // 性能测试类
 class PerformanceTest
 {
@@ -297,6 +403,1409 @@ public:
                       << t.elapsed() << " ms" << std::endl;
         }
     }
+
+    // 5. span周转测试
+    // 每轮分配足够多的内存块迫使CentralCache不断获取新span，全部释放后span归还PageCache
+    // 只写入每个块的首字节，模拟分配后只使用部分内存的场景
+    static void testSpanChurn()
+    {
+        constexpr size_t ROUNDS = 50;
+        constexpr size_t BLOCKS_PER_ROUND = 10000;
+        const size_t SIZES[] = {64, 256, 1024, 4096};
+
+        std::cout << "\nTesting span churn (" << ROUNDS << " rounds, "
+                  << BLOCKS_PER_ROUND << " blocks per size per round):" << std::endl;
+
+        // 新span创建开销：从大量未使用过的大小类中各分配一个块
+        {
+            constexpr size_t FIRST_SIZE = 4096 + 8;
+            constexpr size_t NUM_CLASSES = 2048;
+            std::vector<std::pair<void *, size_t>> ptrs;
+            ptrs.reserve(NUM_CLASSES);
+
+            Timer t;
+            for (size_t i = 0; i < NUM_CLASSES; ++i)
+            {
+                size_t size = FIRST_SIZE + i * ALIGNMENT;
+                ptrs.emplace_back(MemoryPool::allocate(size), size);
+            }
+            std::cout << "Fresh spans (" << NUM_CLASSES << " size classes): "
+                      << std::fixed << std::setprecision(3) << t.elapsed() << " ms" << std::endl;
+
+            for (const auto &[ptr, size] : ptrs)
+            {
+                MemoryPool::deallocate(ptr, size);
+            }
+        }
+
+        // 测试内存池
+        {
+            Timer t;
+            std::vector<void *> ptrs;
+            ptrs.reserve(BLOCKS_PER_ROUND);
+
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                for (size_t size : SIZES)
+                {
+                    for (size_t i = 0; i < BLOCKS_PER_ROUND; ++i)
+                    {
+                        char *p = static_cast<char *>(MemoryPool::allocate(size));
+                        p[0] = static_cast<char>(i);
+                        ptrs.push_back(p);
+                    }
+                    for (void *ptr : ptrs)
+                    {
+                        MemoryPool::deallocate(ptr, size);
+                    }
+                    ptrs.clear();
+                }
+            }
+
+            std::cout << "Memory Pool: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+
+        // 测试new/delete
+        {
+            Timer t;
+            std::vector<void *> ptrs;
+            ptrs.reserve(BLOCKS_PER_ROUND);
+
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                for (size_t size : SIZES)
+                {
+                    for (size_t i = 0; i < BLOCKS_PER_ROUND; ++i)
+                    {
+                        char *p = new char[size];
+                        p[0] = static_cast<char>(i);
+                        ptrs.push_back(p);
+                    }
+                    for (void *ptr : ptrs)
+                    {
+                        delete[] static_cast<char *>(ptr);
+                    }
+                    ptrs.clear();
+                }
+            }
+
+            std::cout << "New/Delete: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 6. PageCache扩展性测试
+    // 每个线程使用不同的大小类，分配的内存块足以跨越多个span，使请求集中落到PageCache
+    static void testPageCacheScaling()
+    {
+        constexpr size_t ROUNDS = 20;
+        constexpr size_t BLOCKS_PER_ROUND = 256;
+
+        std::cout << "\nTesting PageCache scaling (" << ROUNDS << " rounds, "
+                  << BLOCKS_PER_ROUND << " blocks per thread per round):" << std::endl;
+
+        for (size_t numThreads : {1, 4, 16, 64})
+        {
+            Timer t;
+            std::vector<std::thread> threads;
+
+            for (size_t i = 0; i < numThreads; ++i)
+            {
+                threads.emplace_back([i]()
+                                     {
+                    const size_t size = 1024 + i * 64;
+                    std::vector<void *> ptrs;
+                    ptrs.reserve(BLOCKS_PER_ROUND);
+
+                    for (size_t round = 0; round < ROUNDS; ++round)
+                    {
+                        for (size_t j = 0; j < BLOCKS_PER_ROUND; ++j)
+                        {
+                            ptrs.push_back(MemoryPool::allocate(size));
+                        }
+                        for (void *ptr : ptrs)
+                        {
+                            MemoryPool::deallocate(ptr, size);
+                        }
+                        ptrs.clear();
+                    } });
+            }
+
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+
+            std::cout << numThreads << " threads: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 7. 请求作用域测试
+    // 每个请求分配大量小对象，请求结束时全部失效：Arena整体reset，内存池和new/delete逐个释放
+    static void testArenaRequests()
+    {
+        constexpr size_t NUM_REQUESTS = 2000;
+        constexpr size_t OBJECTS_PER_REQUEST = 1000;
+
+        std::cout << "\nTesting request-scoped allocations (" << NUM_REQUESTS << " requests, "
+                  << OBJECTS_PER_REQUEST << " objects per request):" << std::endl;
+
+        std::vector<std::pair<void *, size_t>> ptrs;
+        ptrs.reserve(OBJECTS_PER_REQUEST);
+        auto objectSize = [](size_t i)
+        { return 16 + (i * 37) % 240; };
+
+        // 测试Arena
+        {
+            Timer t;
+            for (size_t request = 0; request < NUM_REQUESTS; ++request)
+            {
+                Arena arena;
+                for (size_t i = 0; i < OBJECTS_PER_REQUEST; ++i)
+                {
+                    char *p = static_cast<char *>(arena.allocate(objectSize(i)));
+                    p[0] = static_cast<char>(i);
+                }
+            }
+            std::cout << "Arena: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+
+        // 测试内存池
+        {
+            Timer t;
+            for (size_t request = 0; request < NUM_REQUESTS; ++request)
+            {
+                for (size_t i = 0; i < OBJECTS_PER_REQUEST; ++i)
+                {
+                    size_t size = objectSize(i);
+                    char *p = static_cast<char *>(MemoryPool::allocate(size));
+                    p[0] = static_cast<char>(i);
+                    ptrs.emplace_back(p, size);
+                }
+                for (const auto &[ptr, size] : ptrs)
+                {
+                    MemoryPool::deallocate(ptr, size);
+                }
+                ptrs.clear();
+            }
+            std::cout << "Memory Pool: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+
+        // 测试new/delete
+        {
+            Timer t;
+            for (size_t request = 0; request < NUM_REQUESTS; ++request)
+            {
+                for (size_t i = 0; i < OBJECTS_PER_REQUEST; ++i)
+                {
+                    size_t size = objectSize(i);
+                    char *p = new char[size];
+                    p[0] = static_cast<char>(i);
+                    ptrs.emplace_back(p, size);
+                }
+                for (const auto &[ptr, size] : ptrs)
+                {
+                    delete[] static_cast<char *>(ptr);
+                }
+                ptrs.clear();
+            }
+            std::cout << "New/Delete: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 独立堆测试：每个租户使用自己的堆，结束时整体销毁，对比逐个释放
+    static void testHeapTeardown()
+    {
+        constexpr size_t NUM_TENANTS = 200;
+        constexpr size_t OBJECTS_PER_TENANT = 10000;
+
+        std::cout << "\nTesting per-tenant heaps (" << NUM_TENANTS << " tenants, "
+                  << OBJECTS_PER_TENANT << " objects per tenant):" << std::endl;
+
+        std::vector<std::pair<void *, size_t>> ptrs;
+        ptrs.reserve(OBJECTS_PER_TENANT);
+        auto objectSize = [](size_t i)
+        { return 16 + (i * 37) % 240; };
+
+        // 测试独立堆：不逐个释放，destroy()一次性归还
+        {
+            Timer t;
+            for (size_t tenant = 0; tenant < NUM_TENANTS; ++tenant)
+            {
+                Heap *heap = Heap::create();
+                for (size_t i = 0; i < OBJECTS_PER_TENANT; ++i)
+                {
+                    char *p = static_cast<char *>(heap->allocate(objectSize(i)));
+                    p[0] = static_cast<char>(i);
+                }
+                heap->destroy();
+            }
+            std::cout << "Heap + destroy: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+
+        // 测试默认堆：逐个释放
+        {
+            Timer t;
+            for (size_t tenant = 0; tenant < NUM_TENANTS; ++tenant)
+            {
+                for (size_t i = 0; i < OBJECTS_PER_TENANT; ++i)
+                {
+                    size_t size = objectSize(i);
+                    char *p = static_cast<char *>(MemoryPool::allocate(size));
+                    p[0] = static_cast<char>(i);
+                    ptrs.emplace_back(p, size);
+                }
+                for (const auto &[ptr, size] : ptrs)
+                {
+                    MemoryPool::deallocate(ptr, size);
+                }
+                ptrs.clear();
+            }
+            std::cout << "Default heap: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 8. pmr容器测试
+    // 同一组容器操作分别运行在不同的memory_resource上
+    static void testPmrContainers()
+    {
+        constexpr size_t ROUNDS = 20;
+        constexpr size_t NUM_ELEMENTS = 20000;
+
+        std::cout << "\nTesting pmr containers (" << ROUNDS << " rounds, "
+                  << NUM_ELEMENTS << " elements per container):" << std::endl;
+
+        auto vectorWorkload = [](std::pmr::memory_resource *resource)
+        {
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                std::pmr::vector<std::pmr::vector<int>> vectors(resource);
+                for (size_t i = 0; i < NUM_ELEMENTS / 100; ++i)
+                {
+                    vectors.emplace_back();
+                    for (int j = 0; j < 100; ++j)
+                    {
+                        vectors.back().push_back(j);
+                    }
+                }
+            }
+        };
+        auto mapWorkload = [](std::pmr::memory_resource *resource)
+        {
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                std::pmr::unordered_map<size_t, size_t> map(resource);
+                for (size_t i = 0; i < NUM_ELEMENTS; ++i)
+                {
+                    map.emplace(i, i);
+                }
+                for (size_t i = 0; i < NUM_ELEMENTS; i += 2)
+                {
+                    map.erase(i);
+                }
+            }
+        };
+        auto stringWorkload = [](std::pmr::memory_resource *resource)
+        {
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                std::pmr::vector<std::pmr::string> strings(resource);
+                for (size_t i = 0; i < NUM_ELEMENTS; ++i)
+                {
+                    strings.emplace_back(20 + i % 80, 'x');
+                }
+            }
+        };
+
+        // 每次测试使用新的资源对象，单调资源在测试结束时整体释放
+        auto run = [](const char *name, auto workload)
+        {
+            std::cout << name << ":" << std::endl;
+            auto report = [](const char *resourceName, double ms)
+            {
+                std::cout << "  " << std::left << std::setw(40) << resourceName << std::right
+                          << std::fixed << std::setprecision(3) << ms << " ms" << std::endl;
+            };
+            {
+                Timer t;
+                workload(poolResource());
+                report("PoolResource", t.elapsed());
+            }
+            {
+                Timer t;
+                UnsynchronizedPoolResource resource;
+                workload(&resource);
+                report("UnsynchronizedPoolResource", t.elapsed());
+            }
+            {
+                Timer t;
+                std::pmr::unsynchronized_pool_resource resource;
+                workload(&resource);
+                report("std::pmr::unsynchronized_pool_resource", t.elapsed());
+            }
+            {
+                Timer t;
+                MonotonicResource resource;
+                workload(&resource);
+                report("MonotonicResource", t.elapsed());
+            }
+            {
+                Timer t;
+                std::pmr::monotonic_buffer_resource resource;
+                workload(&resource);
+                report("std::pmr::monotonic_buffer_resource", t.elapsed());
+            }
+            {
+                Timer t;
+                workload(std::pmr::new_delete_resource());
+                report("std::pmr::new_delete_resource", t.elapsed());
+            }
+        };
+
+        run("pmr::vector", vectorWorkload);
+        run("pmr::unordered_map", mapWorkload);
+        run("pmr::string", stringWorkload);
+    }
+    // 9. 跨进程消息传递测试
+    // 父进程生产消息，子进程读取全部内容后丢弃
+    // 共享内存池：消息直接在共享段中构造，只传递偏移，由子进程释放；管道：消息经内核复制两次
+    static void testSharedMemoryMessages()
+    {
+        constexpr size_t NUM_MESSAGES = 200000;
+
+        std::cout << "\nTesting cross-process messages (" << NUM_MESSAGES << " messages, 64B-1KB):" << std::endl;
+
+        auto messageSize = [](size_t i)
+        { return 64 + (i * 37) % 960; };
+        auto fill = [](char *msg, size_t i, size_t size)
+        {
+            memcpy(msg, &size, sizeof(size));
+            memset(msg + sizeof(size), static_cast<int>(i), size - sizeof(size));
+        };
+        auto checksum = [](const char *msg, size_t size)
+        {
+            uint64_t sum = 0;
+            for (size_t j = 0; j < size; ++j)
+            {
+                sum += static_cast<unsigned char>(msg[j]);
+            }
+            return sum;
+        };
+
+        // 测试共享内存池
+        {
+            SharedPool *pool = SharedPool::create(256 * 1024 * 1024);
+            auto *ring = new (pool->allocate(sizeof(MessageRing))) MessageRing();
+            pool->setRoot(ring);
+
+            Timer t;
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                SharedPool *consumer = SharedPool::attach(pool->fd());
+                auto *consumerRing = static_cast<MessageRing *>(consumer->root());
+                volatile uint64_t sum = 0;
+                for (size_t i = 0; i < NUM_MESSAGES; ++i)
+                {
+                    char *msg = static_cast<char *>(consumer->pointerAt(consumerRing->pop()));
+                    size_t size;
+                    memcpy(&size, msg, sizeof(size));
+                    sum += checksum(msg, size);
+                    consumer->deallocate(msg);
+                }
+                _exit(0);
+            }
+            for (size_t i = 0; i < NUM_MESSAGES; ++i)
+            {
+                size_t size = messageSize(i);
+                char *msg = static_cast<char *>(pool->allocate(size));
+                fill(msg, i, size);
+                ring->push(pool->offsetOf(msg));
+            }
+            waitpid(pid, nullptr, 0);
+            std::cout << "Shared pool (zero copy): " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+            pool->detach();
+        }
+
+        // 测试管道
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                return;
+            }
+            Timer t;
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[1]);
+                std::vector<char> buffer(1024);
+                volatile uint64_t sum = 0;
+                for (size_t i = 0; i < NUM_MESSAGES; ++i)
+                {
+                    size_t size;
+                    if (read(fds[0], &size, sizeof(size)) != sizeof(size))
+                    {
+                        _exit(1);
+                    }
+                    memcpy(buffer.data(), &size, sizeof(size));
+                    for (size_t got = sizeof(size); got < size;)
+                    {
+                        ssize_t n = read(fds[0], buffer.data() + got, size - got);
+                        if (n <= 0)
+                        {
+                            _exit(1);
+                        }
+                        got += n;
+                    }
+                    sum += checksum(buffer.data(), size);
+                }
+                _exit(0);
+            }
+            close(fds[0]);
+            std::vector<char> buffer(1024);
+            for (size_t i = 0; i < NUM_MESSAGES; ++i)
+            {
+                size_t size = messageSize(i);
+                fill(buffer.data(), i, size);
+                if (write(fds[1], buffer.data(), size) != static_cast<ssize_t>(size))
+                {
+                    break;
+                }
+            }
+            close(fds[1]);
+            waitpid(pid, nullptr, 0);
+            std::cout << "Pipe (copy): " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+    // 10. 自由链表布局测试
+    // 模拟ThreadCache在随机大小类上的取块/放块，比较两种元数据布局：
+    // 链表头与长度分别存放在两个数组中（每次操作访问两个缓存行），与每个大小类一个FreeList结构体（一个缓存行）
+    static void testFreeListLayout()
+    {
+        constexpr size_t NUM_OPS = 4000000;
+        constexpr size_t BLOCKS_PER_CLASS = 2;
+
+        std::cout << "\nTesting free list layout (" << NUM_OPS << " ops on random size classes):" << std::endl;
+
+        // 原来的布局
+        struct SplitLayout
+        {
+            std::array<void *, FREE_LIST_SIZE> freeList;
+            std::array<size_t, FREE_LIST_SIZE> freeListSize;
+
+            void *pop(size_t index)
+            {
+                void *ptr = freeList[index];
+                if (ptr != nullptr)
+                {
+                    freeList[index] = *static_cast<void **>(ptr);
+                    freeListSize[index]--;
+                }
+                return ptr;
+            }
+
+            bool push(size_t index, void *ptr)
+            {
+                *static_cast<void **>(ptr) = freeList[index];
+                freeList[index] = ptr;
+                return ++freeListSize[index] > THREAD_MAX_SIZE;
+            }
+        };
+
+        // ThreadCache现在的布局
+        struct InterleavedLayout
+        {
+            std::array<FreeList, FREE_LIST_SIZE> lists;
+
+            void *pop(size_t index)
+            {
+                FreeList &list = lists[index];
+                void *ptr = list.head;
+                if (ptr != nullptr)
+                {
+                    list.head = *static_cast<void **>(ptr);
+                    __builtin_prefetch(list.head);
+                    list.length--;
+                    list.lowWater = static_cast<uint16_t>(std::min<uint32_t>(list.lowWater, list.length));
+                }
+                return ptr;
+            }
+
+            bool push(size_t index, void *ptr)
+            {
+                FreeList &list = lists[index];
+                *static_cast<void **>(ptr) = list.head;
+                list.head = ptr;
+                return ++list.length > list.maxLength;
+            }
+        };
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<uint32_t> dist(0, FREE_LIST_SIZE - 1);
+        std::vector<uint32_t> from(NUM_OPS);
+        std::vector<uint32_t> to(NUM_OPS);
+        for (size_t i = 0; i < NUM_OPS; ++i)
+        {
+            from[i] = dist(rng);
+            to[i] = dist(rng);
+        }
+        std::vector<char> blocks(FREE_LIST_SIZE * BLOCKS_PER_CLASS * 16);
+
+        L1MissCounter counter;
+        if (!counter.available())
+        {
+            std::cout << "perf_event_open unavailable, reporting time only" << std::endl;
+        }
+
+        // 每次从一个随机大小类取出内存块，放入另一个随机大小类
+        auto run = [&](const char *name, auto &layout)
+        {
+            for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+            {
+                for (size_t j = 0; j < BLOCKS_PER_CLASS; ++j)
+                {
+                    layout.push(index, &blocks[(index * BLOCKS_PER_CLASS + j) * 16]);
+                }
+            }
+
+            size_t overflows = 0;
+            counter.start();
+            Timer t;
+            for (size_t i = 0; i < NUM_OPS; ++i)
+            {
+                if (void *ptr = layout.pop(from[i]))
+                {
+                    overflows += layout.push(to[i], ptr);
+                }
+            }
+            double elapsed = t.elapsed();
+            long long misses = counter.stop();
+
+            std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(10) << elapsed << " ms";
+            if (misses >= 0)
+            {
+                std::cout << std::setw(14) << misses << " L1D misses (" << std::setprecision(2)
+                          << static_cast<double>(misses) / NUM_OPS << "/op)";
+            }
+            std::cout << "  [" << overflows << " overflows]" << std::endl;
+        };
+
+        auto split = std::make_unique<SplitLayout>();
+        run("Split", *split);
+        auto interleaved = std::make_unique<InterleavedLayout>();
+        for (FreeList &list : interleaved->lists)
+        {
+            list.maxLength = THREAD_MAX_SIZE;
+        }
+        run("FreeList", *interleaved);
+    }
+    static void testNeighbourClassContention()
+    {
+        constexpr size_t NUM_THREADS = 4;
+        constexpr size_t ROUNDS = 200000;
+        constexpr size_t BATCH = 16;
+
+        std::cout << "\nTesting neighbouring size classes in CentralCache (" << ROUNDS
+                  << " fetch/return rounds per thread):" << std::endl;
+
+        // 每个线程只访问自己的大小类，大小类彼此相邻（8B、16B、24B、32B）
+        // 各大小类的状态位于不同的缓存行，线程数增加时每轮耗时应基本不变
+        CentralCache &central = CentralCache::getInstance();
+        auto run = [&](size_t numThreads)
+        {
+            std::vector<CentralCache::ClassStats> before(numThreads);
+            for (size_t i = 0; i < numThreads; ++i)
+            {
+                before[i] = central.classStats(i);
+            }
+
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < numThreads; ++i)
+            {
+                threads.emplace_back([&central, i]()
+                                     {
+                    for (size_t round = 0; round < ROUNDS; ++round)
+                    {
+                        void *start = nullptr;
+                        size_t count = central.fetchRange(start, i, BATCH);
+                        if (count > 0)
+                        {
+                            central.returnRange(start, count, i);
+                        }
+                    } });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            double elapsed = t.elapsed();
+
+            uint64_t contended = 0;
+            uint64_t misses = 0;
+            for (size_t i = 0; i < numThreads; ++i)
+            {
+                CentralCache::ClassStats stats = central.classStats(i);
+                contended += stats.contended - before[i].contended;
+                misses += stats.misses - before[i].misses;
+            }
+            std::cout << std::setw(2) << numThreads << " thread(s): " << std::fixed << std::setprecision(3)
+                      << std::setw(10) << elapsed << " ms (" << std::setprecision(1)
+                      << elapsed * 1e6 / (ROUNDS * numThreads) << " ns/round)  contended: " << contended
+                      << "  misses: " << misses << std::endl;
+        };
+
+        run(1);
+        run(NUM_THREADS);
+    }
+    static void testRefillLatency()
+    {
+        constexpr size_t BURSTS = 200;
+        constexpr size_t BURST_SIZE = 500;
+        const std::array<size_t, 6> sizes = {32, 64, 128, 256, 1024, 4096};
+        const std::array<uint64_t, 6> bounds = {250, 1000, 4000, 16000, 64000, UINT64_MAX};
+
+        std::cout << "\nTesting allocation latency with background refill (" << BURSTS << " bursts of "
+                  << BURST_SIZE << " allocations, 1ms apart):" << std::endl;
+
+        // 请求线程分批分配，批次之间空闲；统计每次分配的耗时分布
+        auto run = [&](const char *name, bool refill)
+        {
+            Heap *heap = Heap::create();
+            if (refill)
+            {
+                heap->startRefillWorker(std::chrono::microseconds(200));
+            }
+
+            std::vector<void *> blocks;
+            blocks.reserve(BURSTS * BURST_SIZE);
+            std::vector<uint64_t> latencies;
+            latencies.reserve(BURSTS * BURST_SIZE);
+            for (size_t burst = 0; burst < BURSTS; ++burst)
+            {
+                for (size_t i = 0; i < BURST_SIZE; ++i)
+                {
+                    size_t size = sizes[(burst * BURST_SIZE + i) % sizes.size()];
+                    auto begin = std::chrono::steady_clock::now();
+                    void *ptr = heap->allocate(size);
+                    auto end = std::chrono::steady_clock::now();
+                    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+                    blocks.push_back(ptr);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            for (void *ptr : blocks)
+            {
+                heap->deallocate(ptr);
+            }
+            heap->destroy();
+
+            std::array<size_t, 6> histogram{};
+            for (uint64_t latency : latencies)
+            {
+                histogram[std::lower_bound(bounds.begin(), bounds.end(), latency + 1) - bounds.begin()]++;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&](double p)
+            {
+                return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+            };
+
+            std::cout << std::left << std::setw(12) << name << std::right
+                      << "p50 " << std::setw(6) << percentile(0.5) << " ns  p99 " << std::setw(6) << percentile(0.99)
+                      << " ns  p99.9 " << std::setw(7) << percentile(0.999) << " ns  max " << std::setw(8)
+                      << latencies.back() << " ns" << std::endl;
+            std::cout << std::setw(12) << "" << "<250ns " << histogram[0] << "  <1us " << histogram[1]
+                      << "  <4us " << histogram[2] << "  <16us " << histogram[3] << "  <64us " << histogram[4]
+                      << "  >=64us " << histogram[5] << std::endl;
+        };
+
+        run("Refill off", false);
+        run("Refill on", true);
+    }
+    static void testColdStart()
+    {
+        constexpr size_t LIVE = 60000;
+        constexpr size_t WINDOW = 10000;
+        constexpr size_t WINDOWS = 40;
+
+        std::cout << "\nTesting cold start (" << LIVE << " live objects, " << WINDOWS << " windows of "
+                  << WINDOW << " ops):" << std::endl;
+
+        std::mt19937 rng(7);
+        std::discrete_distribution<size_t> pick({40, 25, 15, 10, 6, 4});
+        const std::array<size_t, 6> sizes = {16, 48, 128, 256, 1024, 2048};
+        std::vector<size_t> sequence(WINDOW * WINDOWS);
+        for (size_t &size : sequence)
+        {
+            size = sizes[pick(rng)];
+        }
+
+        // 启动后对象数逐渐增长到LIVE个，之后每次分配都释放最早的对象；返回每个窗口的耗时
+        auto run = [&](Heap *heap)
+        {
+            std::vector<std::pair<void *, size_t>> ring(LIVE, {nullptr, 0});
+            std::vector<double> windows;
+            for (size_t w = 0; w < WINDOWS; ++w)
+            {
+                Timer t;
+                for (size_t i = w * WINDOW; i < (w + 1) * WINDOW; ++i)
+                {
+                    auto &slot = ring[i % LIVE];
+                    if (slot.first != nullptr)
+                    {
+                        heap->deallocate(slot.first, slot.second);
+                    }
+                    slot = {heap->allocate(sequence[i]), sequence[i]};
+                    static_cast<char *>(slot.first)[0] = 1;
+                }
+                windows.push_back(t.elapsed());
+            }
+            for (auto &slot : ring)
+            {
+                heap->deallocate(slot.first, slot.second);
+            }
+            return windows;
+        };
+
+        // 稳态取后一半窗口耗时的中位数，报告第一个窗口和达到稳态（窗口耗时不超过稳态的1.2倍）之前的累计时间
+        auto report = [](const char *name, const std::vector<double> &windows, double setup)
+        {
+            std::vector<double> tail(windows.begin() + windows.size() / 2, windows.end());
+            std::sort(tail.begin(), tail.end());
+            double steady = tail[tail.size() / 2];
+            double untilSteady = 0;
+            for (double window : windows)
+            {
+                if (window <= steady * 1.2)
+                {
+                    break;
+                }
+                untilSteady += window;
+            }
+            std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(3)
+                      << "setup " << std::setw(8) << setup << " ms  first window " << std::setw(8) << windows[0]
+                      << " ms  until steady " << std::setw(8) << untilSteady << " ms  steady window "
+                      << std::setw(7) << steady << " ms" << std::endl;
+        };
+
+        // 冷启动，结束时记录预热配置
+        Heap *heap = Heap::create();
+        std::vector<double> cold = run(heap);
+        WarmupProfile profile = heap->captureProfile();
+        heap->destroy();
+        report("Cold", cold, 0);
+
+        // 用上一次运行的配置预热后再开始
+        heap = Heap::create();
+        Timer t;
+        heap->warmup(profile, true);
+        double setup = t.elapsed();
+        std::vector<double> warm = run(heap);
+        heap->destroy();
+        report("Warm", warm, setup);
+    }
+    static void testRealtimeWorstCase()
+    {
+        constexpr size_t NUM_THREADS = 2;
+        constexpr size_t OPS = 200000;
+        constexpr size_t LIVE = 256;
+        const std::array<size_t, 4> sizes = {24, 96, 480, 2000};
+
+        std::cout << "\nTesting worst-case latency (" << NUM_THREADS << " SCHED_FIFO threads, " << OPS
+                  << " allocate+free pairs each):" << std::endl;
+
+        // 每个线程保留LIVE个对象，每次分配一个新对象并释放最早的对象，记录每一对操作的耗时
+        std::atomic<bool> fifo{true};
+        auto run = [&](const char *name, auto allocate, auto deallocate)
+        {
+            std::vector<std::vector<uint64_t>> latencies(NUM_THREADS);
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < NUM_THREADS; ++t)
+            {
+                threads.emplace_back([&, t]()
+                                     {
+                    sched_param param{};
+                    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+                    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+                    {
+                        fifo = false;
+                    }
+                    std::vector<uint64_t> &result = latencies[t];
+                    result.reserve(OPS);
+                    std::vector<void *> ring(LIVE, nullptr);
+                    for (size_t i = 0; i < OPS; ++i)
+                    {
+                        size_t size = sizes[(i * 7 + t) % sizes.size()];
+                        auto begin = std::chrono::steady_clock::now();
+                        void *ptr = allocate(size);
+                        deallocate(ring[i % LIVE]);
+                        auto end = std::chrono::steady_clock::now();
+                        ring[i % LIVE] = ptr;
+                        result.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+                    }
+                    for (void *ptr : ring)
+                    {
+                        deallocate(ptr);
+                    } });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+
+            std::vector<uint64_t> all;
+            for (auto &result : latencies)
+            {
+                all.insert(all.end(), result.begin(), result.end());
+            }
+            std::sort(all.begin(), all.end());
+            std::cout << std::left << std::setw(14) << name << std::right << "p50 " << std::setw(6)
+                      << all[all.size() / 2] << " ns  p99.99 " << std::setw(7) << all[all.size() * 9999 / 10000]
+                      << " ns  max " << std::setw(8) << all.back() << " ns" << std::endl;
+        };
+
+        // 新建的堆：首批请求需要映射内存、触发缺页
+        Heap *heap = Heap::create();
+        run(
+            "Heap", [heap](size_t size)
+            { return heap->allocate(size); },
+            [heap](void *ptr)
+            {
+                if (ptr != nullptr)
+                {
+                    heap->deallocate(ptr);
+                }
+            });
+        heap->destroy();
+
+        WarmupProfile capacity;
+        for (size_t size : sizes)
+        {
+            capacity.entries.push_back({size, NUM_THREADS * LIVE});
+        }
+        RealtimePool *pool = RealtimePool::create(capacity);
+        run(
+            "RealtimePool", [pool](size_t size)
+            { return pool->allocate(size); },
+            [pool](void *ptr)
+            { pool->deallocate(ptr); });
+        std::cout << "memory " << (pool->locked() ? "locked" : "not locked (RLIMIT_MEMLOCK)") << ", "
+                  << (fifo ? "SCHED_FIFO" : "SCHED_FIFO unavailable, default policy") << std::endl;
+        pool->destroy();
+    }
+    static void testEpochStructures()
+    {
+        constexpr size_t NUM_THREADS = 4;
+        constexpr size_t OPS = 200000;
+        constexpr size_t KEYS = 4096;
+
+        std::cout << "\nTesting lock-free structures with epoch reclamation (" << NUM_THREADS << " threads, "
+                  << OPS << " ops each):" << std::endl;
+
+        struct Node
+        {
+            Node *next;
+            uint64_t key;
+            uint64_t value;
+        };
+
+        // reclaim为false时摘除的节点直接泄漏，作为没有回收开销的上限
+        auto runStack = [&](bool reclaim)
+        {
+            std::atomic<Node *> head{nullptr};
+            std::vector<std::vector<Node *>> leaked(NUM_THREADS);
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < NUM_THREADS; ++i)
+            {
+                threads.emplace_back([&, i]()
+                                     {
+                    for (size_t op = 0; op < OPS; ++op)
+                    {
+                        Node *node = static_cast<Node *>(MemoryPool::allocate(sizeof(Node)));
+                        node->value = op;
+                        node->next = head.load(std::memory_order_relaxed);
+                        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                        {
+                        }
+
+                        EpochGuard guard;
+                        Node *top = head.load(std::memory_order_acquire);
+                        while (top != nullptr && !head.compare_exchange_weak(top, top->next, std::memory_order_acquire, std::memory_order_acquire))
+                        {
+                        }
+                        if (top != nullptr)
+                        {
+                            if (reclaim)
+                            {
+                                MemoryPool::retire(top, sizeof(Node));
+                            }
+                            else
+                            {
+                                leaked[i].push_back(top);
+                            }
+                        }
+                    }
+                    Epoch::drain(); });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            double elapsed = t.elapsed();
+            for (auto &nodes : leaked)
+            {
+                for (Node *node : nodes)
+                {
+                    MemoryPool::deallocate(node, sizeof(Node));
+                }
+            }
+            return elapsed;
+        };
+
+        // 每个键一个槽位，更新时换上新节点并retire旧节点，读者在临界区内读取（读多写少：每8次操作一次更新）
+        auto runMap = [&](bool reclaim)
+        {
+            std::vector<std::atomic<Node *>> slots(KEYS);
+            for (size_t key = 0; key < KEYS; ++key)
+            {
+                Node *node = static_cast<Node *>(MemoryPool::allocate(sizeof(Node)));
+                *node = {nullptr, key, 0};
+                slots[key].store(node);
+            }
+            std::vector<std::vector<Node *>> leaked(NUM_THREADS);
+            std::atomic<uint64_t> checksum{0};
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < NUM_THREADS; ++i)
+            {
+                threads.emplace_back([&, i]()
+                                     {
+                    std::mt19937 rng(static_cast<unsigned>(i));
+                    uint64_t sum = 0;
+                    for (size_t op = 0; op < OPS; ++op)
+                    {
+                        size_t key = rng() % KEYS;
+                        EpochGuard guard;
+                        if (op % 8 != 0)
+                        {
+                            sum += slots[key].load(std::memory_order_acquire)->value;
+                            continue;
+                        }
+                        Node *node = static_cast<Node *>(MemoryPool::allocate(sizeof(Node)));
+                        *node = {nullptr, key, op};
+                        Node *old = slots[key].exchange(node, std::memory_order_acq_rel);
+                        if (reclaim)
+                        {
+                            MemoryPool::retire(old, sizeof(Node));
+                        }
+                        else
+                        {
+                            leaked[i].push_back(old);
+                        }
+                    }
+                    checksum += sum;
+                    Epoch::drain(); });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            double elapsed = t.elapsed();
+            for (auto &slot : slots)
+            {
+                MemoryPool::deallocate(slot.load(), sizeof(Node));
+            }
+            for (auto &nodes : leaked)
+            {
+                for (Node *node : nodes)
+                {
+                    MemoryPool::deallocate(node, sizeof(Node));
+                }
+            }
+            return elapsed;
+        };
+
+        auto print = [](const char *name, double leak, double epoch)
+        {
+            double ops = static_cast<double>(NUM_THREADS * OPS);
+            std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(2)
+                      << "no reclamation " << std::setw(6) << ops / leak / 1000 << " Mops/s   epoch "
+                      << std::setw(6) << ops / epoch / 1000 << " Mops/s" << std::endl;
+        };
+        print("Stack", runStack(false), runStack(true));
+        print("Map", runMap(false), runMap(true));
+    }
+
+    static void testHeapWalk()
+    {
+        constexpr size_t BLOCK_SIZE = 64;
+        constexpr size_t HEAP_BYTES = 256ull * 1024 * 1024;
+        constexpr size_t NUM_BLOCKS = HEAP_BYTES / BLOCK_SIZE;
+
+        std::cout << "\nTesting heap walk (" << HEAP_BYTES / (1024 * 1024) << " MB of " << BLOCK_SIZE
+                  << "-byte blocks, every 4th freed):" << std::endl;
+
+        Heap *heap = Heap::create();
+        std::vector<void *> blocks(NUM_BLOCKS);
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            blocks[i] = heap->allocate(BLOCK_SIZE);
+        }
+        for (size_t i = 0; i < NUM_BLOCKS; i += 4)
+        {
+            heap->deallocate(blocks[i], BLOCK_SIZE);
+        }
+
+        Timer summarizeTimer;
+        HeapSummary summary = heap->summarize();
+        double summarizeTime = summarizeTimer.elapsed();
+
+        size_t live = 0;
+        auto visit = [&live](void *, size_t, BlockState state)
+        {
+            live += state == BlockState::Live;
+        };
+        Timer walkTimer;
+        heap->walk(visit);
+        double walkTime = walkTimer.elapsed();
+
+        // 两种方式的代价都与堆的大小成正比，按比例换算到32GB
+        double scale = 32.0 * 1024 * 1024 * 1024 / HEAP_BYTES;
+        std::cout << std::fixed << std::setprecision(2) << "summarize: " << std::setw(8) << summarizeTime
+                  << " ms (" << summary.liveBlocks() << " live, ~" << summarizeTime * scale / 1000
+                  << " s per 32 GB)" << std::endl;
+        std::cout << "walk:      " << std::setw(8) << walkTime << " ms (" << live << " live, ~"
+                  << walkTime * scale / 1000 << " s per 32 GB)" << std::endl;
+        heap->destroy();
+    }
+
+    // 与未开启标记模式的perf_test对比这里的结果，得到标记的开销
+    static void testTaggedAllocations()
+    {
+        constexpr size_t NUM_THREADS = 4;
+        constexpr size_t OPS = 1000000;
+        constexpr size_t WINDOW = 64;
+
+        std::cout << "\nTesting tagged allocations (" << (TAGGED ? "tagging compiled in" : "tagging compiled out")
+                  << ", " << NUM_THREADS << " threads, " << OPS << " ops each):" << std::endl;
+
+        // 每个线程保持最近WINDOW个随机大小的内存块，tagged为true时每个线程使用自己的标签
+        auto run = [&](bool tagged)
+        {
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < NUM_THREADS; ++i)
+            {
+                threads.emplace_back([i, tagged]()
+                                     {
+                    std::mt19937 rng(static_cast<unsigned>(i));
+                    MemoryTag tag = static_cast<MemoryTag>(i + 1);
+                    std::array<void *, WINDOW> blocks{};
+                    std::array<size_t, WINDOW> sizes{};
+                    for (size_t op = 0; op < OPS; ++op)
+                    {
+                        size_t slot = op % WINDOW;
+                        if (blocks[slot] != nullptr)
+                        {
+                            MemoryPool::deallocate(blocks[slot], sizes[slot]);
+                        }
+                        sizes[slot] = 16 + rng() % 512;
+                        blocks[slot] = tagged ? MemoryPool::allocate(sizes[slot], tag) : MemoryPool::allocate(sizes[slot]);
+                    }
+                    for (size_t slot = 0; slot < WINDOW; ++slot)
+                    {
+                        MemoryPool::deallocate(blocks[slot], sizes[slot]);
+                    } });
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            return t.elapsed();
+        };
+
+        double ops = static_cast<double>(NUM_THREADS * OPS);
+        double plain = run(false);
+        double tagged = run(true);
+        std::cout << std::fixed << std::setprecision(1) << "allocate(size):      " << std::setw(6)
+                  << plain * 1e6 / ops << " ns/op" << std::endl;
+        std::cout << "allocate(size, tag): " << std::setw(6) << tagged * 1e6 / ops << " ns/op" << std::endl;
+        if constexpr (TAGGED)
+        {
+            // 全部释放后每个标签的存活字节数回到0
+            for (size_t i = 0; i < NUM_THREADS; ++i)
+            {
+                MemoryTags::Usage usage = MemoryPool::tagUsage(static_cast<MemoryTag>(i + 1));
+                std::cout << "tag " << i + 1 << ": " << usage.allocations << " allocations, " << usage.liveBytes
+                          << " live bytes" << std::endl;
+            }
+        }
+    }
+
+    // 长时间运行的混合负载：每轮处理一批短寿命的请求对象，其间替换一部分长期存活的缓存条目
+    // 每轮结束后归还空闲内存，最后比较进程常驻内存（RSS）的增长与缓存条目的存活字节数
+    static void testLifetimeFragmentation()
+    {
+        constexpr size_t CACHE_ENTRIES = 20000;
+        constexpr size_t REQUESTS = 100000;
+        constexpr size_t REPLACE_EVERY = 50;
+        constexpr size_t ROUNDS = 30;
+
+        std::cout << "\nTesting lifetime-segregated fragmentation (" << CACHE_ENTRIES << " cache entries, "
+                  << ROUNDS << " rounds of " << REQUESTS << " requests):" << std::endl;
+
+        auto residentBytes = []()
+        {
+            std::ifstream statm("/proc/self/statm");
+            size_t pages = 0;
+            size_t resident = 0;
+            statm >> pages >> resident;
+            return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        };
+
+        // 在子进程中使用新建的堆运行，RSS的增长只来自本负载；返回RSS增长与存活字节数
+        // 与MemoryPool::allocate(size, Lifetime)的路由相同：分开时缓存条目使用另一个堆
+        auto run = [&](bool segregated)
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                return std::make_pair(size_t(0), size_t(0));
+            }
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                std::mt19937 rng(42);
+                std::vector<std::pair<void *, size_t>> cache(CACHE_ENTRIES, {nullptr, 0});
+                std::vector<std::pair<void *, size_t>> requests(REQUESTS);
+                Heap *shortHeap = Heap::create();
+                Heap *longHeap = segregated ? Heap::create() : shortHeap;
+                size_t baseline = residentBytes();
+
+                for (auto &entry : cache)
+                {
+                    entry.second = 256 + rng() % 769;
+                    entry.first = longHeap->allocate(entry.second);
+                }
+                for (size_t round = 0; round < ROUNDS; ++round)
+                {
+                    for (size_t i = 0; i < REQUESTS; ++i)
+                    {
+                        size_t size = 64 + rng() % 961;
+                        requests[i] = {shortHeap->allocate(size), size};
+                        memset(requests[i].first, 0, size);
+                        if (i % REPLACE_EVERY == 0)
+                        {
+                            auto &entry = cache[rng() % CACHE_ENTRIES];
+                            longHeap->deallocate(entry.first, entry.second);
+                            entry.second = 256 + rng() % 769;
+                            entry.first = longHeap->allocate(entry.second);
+                        }
+                    }
+                    for (auto &[ptr, size] : requests)
+                    {
+                        shortHeap->deallocate(ptr, size);
+                    }
+                    shortHeap->releaseMemory();
+                    longHeap->releaseMemory();
+                }
+
+                size_t resident = residentBytes();
+                size_t result[2] = {resident > baseline ? resident - baseline : 0, 0};
+                for (auto &entry : cache)
+                {
+                    result[1] += entry.second;
+                }
+                ssize_t written = write(fds[1], result, sizeof(result));
+                _exit(written == sizeof(result) ? 0 : 1);
+            }
+            close(fds[1]);
+            size_t result[2] = {0, 0};
+            ssize_t received = read(fds[0], result, sizeof(result));
+            close(fds[0]);
+            waitpid(pid, nullptr, 0);
+            return received == sizeof(result) ? std::make_pair(result[0], result[1]) : std::make_pair(size_t(0), size_t(0));
+        };
+
+        auto print = [](const char *name, std::pair<size_t, size_t> usage)
+        {
+            double rss = usage.first / (1024.0 * 1024.0);
+            double live = usage.second / (1024.0 * 1024.0);
+            std::cout << std::left << std::setw(11) << name << std::right << std::fixed << std::setprecision(1)
+                      << "RSS " << std::setw(6) << rss << " MB, live " << std::setw(5) << live
+                      << " MB, RSS/live " << std::setprecision(2) << (live > 0 ? rss / live : 0.0) << std::endl;
+        };
+        print("Mixed", run(false));
+        print("Segregated", run(true));
+    }
+
+    // 线程池不断用新线程替换退出的工作线程，每个工作线程只处理少量请求
+    // 默认堆中新线程接管停放的缓存；独立的堆仍是线程退出时清空缓存，新线程从空缓存开始逐个大小类取块
+    static void testWorkerReplacement()
+    {
+        constexpr size_t WORKERS = 500;
+        constexpr size_t CLASSES = 64;
+        constexpr size_t BLOCKS = 8;
+
+        std::cout << "\nTesting thread pool worker replacement (" << WORKERS << " short-lived workers, " << CLASSES
+                  << " size classes each):" << std::endl;
+
+        auto sizeOf = [](size_t c)
+        {
+            return (c + 1) * 64;
+        };
+        auto run = [&](Heap &heap)
+        {
+            auto fetches = [&]()
+            {
+                uint64_t total = 0;
+                for (size_t c = 0; c < CLASSES; ++c)
+                {
+                    size_t index = SizeClass::getIndex(ThreadCache::blockSizeFor(sizeOf(c)));
+                    total += heap.centralCache(0).classStats(index).fetches;
+                }
+                return total;
+            };
+            uint64_t before = fetches();
+            Timer t;
+            for (size_t w = 0; w < WORKERS; ++w)
+            {
+                std::thread([&]()
+                            {
+                    std::array<void *, BLOCKS> blocks;
+                    for (size_t c = 0; c < CLASSES; ++c)
+                    {
+                        for (size_t i = 0; i < BLOCKS; ++i)
+                        {
+                            blocks[i] = heap.allocate(sizeOf(c));
+                        }
+                        for (size_t i = 0; i < BLOCKS; ++i)
+                        {
+                            heap.deallocate(blocks[i], sizeOf(c));
+                        }
+                    } })
+                    .join();
+            }
+            double elapsed = t.elapsed();
+            return std::make_pair(elapsed * 1000 / WORKERS, static_cast<double>(fetches() - before) / WORKERS);
+        };
+
+        auto print = [](const char *name, std::pair<double, double> result)
+        {
+            std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(8) << result.first << " us/worker, " << std::setw(6) << result.second
+                      << " central fetches/worker" << std::endl;
+        };
+        Heap *heap = Heap::create();
+        print("Adopt parked cache", run(Heap::defaultHeap()));
+        print("Flush and refill", run(*heap));
+        heap->destroy();
+    }
+    static void testVectorGrowth()
+    {
+        constexpr size_t ROUNDS = 10;
+        constexpr size_t MAX_SIZE = 64 << 20;
+        constexpr size_t LINEAR_MAX = 4 << 20;
+        constexpr size_t LINEAR_STEP = 16 << 10;
+
+        std::cout << "\nTesting vector-like growth (" << ROUNDS << " buffers grown from 64 B, new bytes written):"
+                  << std::endl;
+
+        // resize(ptr, oldSize, newSize)返回新的指针，缓冲区按next(size)增长，每次写满新增的部分
+        auto run = [&](auto &&resize, auto &&release, auto &&next, size_t maxSize)
+        {
+            size_t steps = 0;
+            size_t moves = 0;
+            Timer t;
+            for (size_t round = 0; round < ROUNDS; ++round)
+            {
+                size_t size = 64;
+                char *buffer = static_cast<char *>(resize(nullptr, 0, size));
+                memset(buffer, 1, size);
+                while (size < maxSize)
+                {
+                    size_t newSize = std::min(next(size), maxSize);
+                    char *grown = static_cast<char *>(resize(buffer, size, newSize));
+                    moves += grown != buffer;
+                    memset(grown + size, 1, newSize - size);
+                    buffer = grown;
+                    size = newSize;
+                    ++steps;
+                }
+                release(buffer, size);
+            }
+            return std::make_pair(t.elapsed() / ROUNDS, 100.0 * moves / steps);
+        };
+
+        auto copyResize = [](void *ptr, size_t oldSize, size_t newSize)
+        {
+            void *grown = MemoryPool::allocate(newSize);
+            if (ptr != nullptr)
+            {
+                memcpy(grown, ptr, oldSize);
+                MemoryPool::deallocate(ptr, oldSize);
+            }
+            return grown;
+        };
+        auto poolResize = [](void *ptr, size_t oldSize, size_t newSize)
+        {
+            return MemoryPool::reallocate(ptr, oldSize, newSize);
+        };
+        auto poolRelease = [](void *ptr, size_t size)
+        {
+            MemoryPool::deallocate(ptr, size);
+        };
+        auto systemResize = [](void *ptr, size_t, size_t newSize)
+        {
+            return realloc(ptr, newSize);
+        };
+        auto systemRelease = [](void *ptr, size_t)
+        {
+            free(ptr);
+        };
+
+        auto print = [](const char *name, std::pair<double, double> result)
+        {
+            std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(9) << result.first << " ms/buffer, " << std::setw(5) << std::setprecision(1)
+                      << result.second << "% of steps moved" << std::endl;
+        };
+        struct Pattern
+        {
+            const char *name;
+            size_t (*next)(size_t);
+            size_t maxSize;
+        };
+        const Pattern patterns[] = {
+            {"x2 to 64 MB", [](size_t size) { return size * 2; }, MAX_SIZE},
+            {"x1.5 to 64 MB", [](size_t size) { return (size + size / 2 + 7) / 8 * 8; }, MAX_SIZE},
+            {"+16 KB to 4 MB", [](size_t size) { return size + LINEAR_STEP; }, LINEAR_MAX},
+        };
+        for (const Pattern &pattern : patterns)
+        {
+            std::cout << "Growth " << pattern.name << ":" << std::endl;
+            print("  Allocate + copy + free", run(copyResize, poolRelease, pattern.next, pattern.maxSize));
+            print("  MemoryPool::reallocate", run(poolResize, poolRelease, pattern.next, pattern.maxSize));
+            print("  realloc", run(systemResize, systemRelease, pattern.next, pattern.maxSize));
+        }
+    }
 };
 
 int main()
@@ -310,6 +1819,23 @@ int main()
     PerformanceTest::testSmallAllocation();
     PerformanceTest::testMultiThreaded();
     PerformanceTest::testMixedSizes();
+    PerformanceTest::testSpanChurn();
+    PerformanceTest::testPageCacheScaling();
+    PerformanceTest::testArenaRequests();
+    PerformanceTest::testHeapTeardown();
+    PerformanceTest::testPmrContainers();
+    PerformanceTest::testSharedMemoryMessages();
+    PerformanceTest::testFreeListLayout();
+    PerformanceTest::testNeighbourClassContention();
+    PerformanceTest::testRefillLatency();
+    PerformanceTest::testColdStart();
+    PerformanceTest::testRealtimeWorstCase();
+    PerformanceTest::testEpochStructures();
+    PerformanceTest::testHeapWalk();
+    PerformanceTest::testTaggedAllocations();
+    PerformanceTest::testLifetimeFragmentation();
+    PerformanceTest::testWorkerReplacement();
+    PerformanceTest::testVectorGrowth();
 
     return 0;
 }
\ No newline at end of file
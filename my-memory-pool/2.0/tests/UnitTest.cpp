@@ -1,4 +1,14 @@
 #include "../include/MemoryPool.hpp"
+#include "../include/Arena.hpp"
+#include "../include/CentralCache.hpp"
+#include "../include/Hardening.hpp"
+#include "../include/Heap.hpp"
+#include "../include/NumaTopology.hpp"
+#include "../include/PageCache.hpp"
+#include "../include/PageSource.hpp"
+#include "../include/PoolResource.hpp"
+#include "../include/RealtimePool.hpp"
+#include "../include/SharedPool.hpp"
 #include <iostream>
 #include <vector>
 #include <thread>
@@ -7,6 +17,17 @@
 #include <random>
 #include <algorithm>
 #include <atomic>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <csignal>
+#include <fstream>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace MyMemoryPool;
 
@@ -182,6 +203,2241 @@ void testStress()
     std::cout << "Stress test passed!" << std::endl;
 }
 
+// span按需切分与回收测试
+void testSpanReuse()
+{
+    std::cout << "Running span reuse test..." << std::endl;
+
+    // 分配足够多的块以跨越多个span，每个块写入自己的编号
+    const size_t size = 24;
+    const size_t NUM_BLOCKS = 5000;
+    std::vector<size_t *> blocks;
+    blocks.reserve(NUM_BLOCKS);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            size_t *ptr = static_cast<size_t *>(MemoryPool::allocate(size));
+            assert(ptr != nullptr);
+            ptr[0] = i;
+            ptr[2] = ~i;
+            blocks.push_back(ptr);
+        }
+
+        // 块之间不能重叠
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            assert(blocks[i][0] == i);
+            assert(blocks[i][2] == ~i);
+        }
+
+        for (size_t *ptr : blocks)
+        {
+            MemoryPool::deallocate(ptr, size);
+        }
+        blocks.clear();
+    }
+
+    std::cout << "Span reuse test passed!" << std::endl;
+}
+
+// 模拟拓扑中当前线程所在的节点
+thread_local size_t fakeNode = 0;
+
+size_t fakeNodeResolver()
+{
+    return fakeNode;
+}
+
+// NUMA分区测试：在单节点机器上模拟两个节点
+void testNumaPartitioning()
+{
+    std::cout << "Running NUMA partitioning test..." << std::endl;
+
+    NumaTopology &topology = NumaTopology::getInstance();
+    topology.setFakeTopology(2, fakeNodeResolver);
+
+    const size_t size = 40;
+    const size_t NUM_BLOCKS = 200;
+    std::vector<void *> remoteBlocks;
+
+    // 节点1上的线程从节点1的分区获取内存
+    std::thread([&]()
+                {
+        fakeNode = 1;
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            void *ptr = MemoryPool::allocate(size);
+            assert(ptr != nullptr);
+            assert(PageMap::getInstance().get(ptr)->node == 1);
+            remoteBlocks.push_back(ptr);
+        } })
+        .join();
+
+    std::set<void *> remoteSet(remoteBlocks.begin(), remoteBlocks.end());
+
+    // 节点0上的线程释放节点1的内存，这些块应送回节点1，而不是在节点0复用
+    std::thread([&]()
+                {
+        fakeNode = 0;
+        for (void *ptr : remoteBlocks)
+        {
+            MemoryPool::deallocate(ptr, size);
+        }
+
+        std::vector<void *> localBlocks;
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            void *ptr = MemoryPool::allocate(size);
+            assert(ptr != nullptr);
+            assert(PageMap::getInstance().get(ptr)->node == 0);
+            assert(remoteSet.count(ptr) == 0);
+            localBlocks.push_back(ptr);
+        }
+        for (void *ptr : localBlocks)
+        {
+            MemoryPool::deallocate(ptr, size);
+        } })
+        .join();
+
+    // 节点1上的新线程可以复用送回的内存块
+    std::thread([&]()
+                {
+        fakeNode = 1;
+        std::vector<void *> blocks;
+        size_t reused = 0;
+        for (size_t i = 0; i < NUM_BLOCKS; ++i)
+        {
+            void *ptr = MemoryPool::allocate(size);
+            assert(ptr != nullptr);
+            assert(PageMap::getInstance().get(ptr)->node == 1);
+            reused += remoteSet.count(ptr);
+            blocks.push_back(ptr);
+        }
+        assert(reused > 0);
+        (void)reused;
+        for (void *ptr : blocks)
+        {
+            MemoryPool::deallocate(ptr, size);
+        } })
+        .join();
+
+    topology.resetTopology();
+    std::cout << "NUMA partitioning test passed!" << std::endl;
+}
+
+// 多线程各自使用不同大小类的测试，大量span的申请与归还并发进入PageCache
+void testConcurrentSizeClasses()
+{
+    std::cout << "Running concurrent size classes test..." << std::endl;
+
+    const size_t NUM_THREADS = 64;
+    const size_t NUM_BLOCKS = 300;
+    const int ROUNDS = 5;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < NUM_THREADS; ++t)
+    {
+        threads.emplace_back([t]()
+                             {
+            const size_t size = 512 + t * 64;
+            std::vector<unsigned char *> blocks;
+            blocks.reserve(NUM_BLOCKS);
+
+            for (int round = 0; round < ROUNDS; ++round)
+            {
+                for (size_t i = 0; i < NUM_BLOCKS; ++i)
+                {
+                    unsigned char *ptr = static_cast<unsigned char *>(MemoryPool::allocate(size));
+                    assert(ptr != nullptr);
+                    memset(ptr, static_cast<int>(t), size);
+                    blocks.push_back(ptr);
+                }
+
+                // 其他线程不能写入本线程持有的内存块
+                for (unsigned char *ptr : blocks)
+                {
+                    assert(ptr[0] == static_cast<unsigned char>(t));
+                    assert(ptr[size - 1] == static_cast<unsigned char>(t));
+                }
+
+                for (unsigned char *ptr : blocks)
+                {
+                    MemoryPool::deallocate(ptr, size);
+                }
+                blocks.clear();
+            } });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // 每个用到的大小类都有自己的统计，线程可能运行在任意节点上
+    for (size_t t = 0; t < NUM_THREADS; ++t)
+    {
+        uint64_t fetches = 0;
+        for (size_t node = 0; node < NumaTopology::getInstance().nodeCount(); ++node)
+        {
+            CentralCache::ClassStats stats = CentralCache::getInstance(node).classStats(SizeClass::getIndex(512 + t * 64));
+            assert(stats.misses <= stats.fetches);
+            fetches += stats.fetches;
+        }
+        assert(fetches > 0);
+    }
+
+    std::cout << "Concurrent size classes test passed!" << std::endl;
+}
+
+// 在子进程中执行func，返回子进程是否被signal信号终止
+template <typename Func>
+bool diesWithSignal(Func func, int signal)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // 屏蔽子进程中预期的错误输出
+        if (freopen("/dev/null", "w", stderr) == nullptr)
+        {
+            _exit(1);
+        }
+        func();
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == signal;
+}
+
+// 加固模式测试，只在定义MEMORY_POOL_HARDENED时运行
+void testHardening()
+{
+    if constexpr (!HARDENED)
+    {
+        std::cout << "Hardening test skipped (MEMORY_POOL_HARDENED not defined)" << std::endl;
+        return;
+    }
+
+    std::cout << "Running hardening test..." << std::endl;
+
+    // 正常使用整个请求大小不会触发检查
+    for (size_t size : {size_t(1), size_t(8), size_t(100), size_t(4096), MAX_BYTES, MAX_BYTES + 64})
+    {
+        char *ptr = static_cast<char *>(MemoryPool::allocate(size));
+        assert(ptr != nullptr);
+        memset(ptr, 0x5a, size);
+        MemoryPool::deallocate(ptr, size);
+    }
+
+    // 重复释放
+    assert(diesWithSignal([]()
+                          {
+        void *ptr = MemoryPool::allocate(32);
+        MemoryPool::deallocate(ptr, 32);
+        MemoryPool::deallocate(ptr, 32); },
+                          SIGABRT));
+
+    // 越界写入一个字节，破坏金丝雀
+    assert(diesWithSignal([]()
+                          {
+        char *ptr = static_cast<char *>(MemoryPool::allocate(32));
+        ptr[32] = 'x';
+        MemoryPool::deallocate(ptr, 32); },
+                          SIGABRT));
+
+    // 释放时的大小与分配时不符
+    assert(diesWithSignal([]()
+                          {
+        void *ptr = MemoryPool::allocate(32);
+        MemoryPool::deallocate(ptr, 200); },
+                          SIGABRT));
+
+    // 释放后写入，破坏空闲链表中的next指针
+    assert(diesWithSignal([]()
+                          {
+        void *a = MemoryPool::allocate(48);
+        void *b = MemoryPool::allocate(48);
+        MemoryPool::deallocate(b, 48);
+        MemoryPool::deallocate(a, 48);
+        memset(a, 0x41, sizeof(void *));
+        MemoryPool::allocate(48);
+        MemoryPool::allocate(48); },
+                          SIGABRT));
+
+    // 大对象越界访问保护页
+    assert(diesWithSignal([]()
+                          {
+        const size_t size = MAX_BYTES + 64;
+        char *ptr = static_cast<char *>(MemoryPool::allocate(size));
+        ptr[size] = 'x'; },
+                          SIGSEGV));
+
+    // 隔离区中的大对象被释放后访问
+    assert(diesWithSignal([]()
+                          {
+        Hardening::setQuarantineLimit(16 * 1024 * 1024);
+        const size_t size = MAX_BYTES * 2;
+        char *ptr = static_cast<char *>(MemoryPool::allocate(size));
+        MemoryPool::deallocate(ptr, size);
+        ptr[0] = 'x'; },
+                          SIGSEGV));
+
+    std::cout << "Hardening test passed!" << std::endl;
+}
+
+// Arena测试
+void testArena()
+{
+    std::cout << "Running arena test..." << std::endl;
+
+    Arena arena;
+    assert(arena.bytesReserved() == 0);
+
+    // 对齐以及分配出的内存互不重叠
+    std::vector<std::pair<char *, size_t>> blocks;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        size_t size = 1 + i % 200;
+        size_t align = size_t(1) << (i % 7);
+        char *ptr = static_cast<char *>(arena.allocate(size, align));
+        assert(ptr != nullptr);
+        assert(reinterpret_cast<uintptr_t>(ptr) % align == 0);
+        memset(ptr, static_cast<int>(i & 0xFF), size);
+        blocks.emplace_back(ptr, size);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        for (size_t j = 0; j < blocks[i].second; ++j)
+        {
+            assert(static_cast<unsigned char>(blocks[i].first[j]) == (i & 0xFF));
+        }
+    }
+    assert(arena.bytesReserved() > 0);
+
+    // 回退后重新分配得到相同的地址，检查点之后获取的span被归还
+    size_t reservedBefore = arena.bytesReserved();
+    Arena::Checkpoint checkpoint = arena.checkpoint();
+    void *first = arena.allocate(64);
+    for (int i = 0; i < 1000; ++i)
+    {
+        arena.allocate(256);
+    }
+    assert(arena.bytesReserved() > reservedBefore);
+    arena.rewind(checkpoint);
+    assert(arena.bytesReserved() == reservedBefore);
+    assert(arena.allocate(64) == first);
+
+    // 嵌套作用域
+    {
+        Arena::Scope outer(arena);
+        void *a = arena.allocate(32);
+        {
+            Arena::Scope inner(arena);
+            arena.allocate(100000); // 超过单个span的分配
+        }
+        assert(arena.allocate(32) == static_cast<char *>(a) + 32);
+    }
+    assert(arena.bytesReserved() == reservedBefore);
+
+    // 构造对象
+    struct Point
+    {
+        double x, y;
+        Point(double px, double py) : x(px), y(py) {}
+    };
+    Point *p = arena.create<Point>(1.0, 2.0);
+    assert(p->x == 1.0 && p->y == 2.0);
+    assert(reinterpret_cast<uintptr_t>(p) % alignof(Point) == 0);
+
+    arena.reset();
+    assert(arena.bytesReserved() == 0);
+
+    // 每个线程使用自己的Arena
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t]()
+                             {
+            for (int round = 0; round < 50; ++round)
+            {
+                Arena local;
+                for (int i = 0; i < 500; ++i)
+                {
+                    int *value = local.create<int>(t * 1000 + i);
+                    assert(*value == t * 1000 + i);
+                }
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::cout << "Arena test passed!" << std::endl;
+}
+
+// 检查memory_resource的对齐和内存独立性
+void checkResource(std::pmr::memory_resource &resource)
+{
+    struct Allocation
+    {
+        void *ptr;
+        size_t bytes;
+        size_t align;
+    };
+    std::vector<Allocation> allocations;
+    const size_t SIZES[] = {0, 1, 7, 24, 100, 4096, 40000, 300000};
+    for (size_t align = 1; align <= 8192; align *= 2)
+    {
+        for (size_t bytes : SIZES)
+        {
+            void *ptr = resource.allocate(bytes, align);
+            assert(reinterpret_cast<uintptr_t>(ptr) % align == 0);
+            memset(ptr, static_cast<int>(allocations.size() & 0xFF), bytes);
+            allocations.push_back({ptr, bytes, align});
+        }
+    }
+    for (size_t i = 0; i < allocations.size(); ++i)
+    {
+        const Allocation &a = allocations[i];
+        for (size_t j = 0; j < a.bytes; ++j)
+        {
+            assert(static_cast<unsigned char *>(a.ptr)[j] == (i & 0xFF));
+        }
+        resource.deallocate(a.ptr, a.bytes, a.align);
+    }
+}
+
+// pmr资源测试
+void testPoolResource()
+{
+    std::cout << "Running pmr resource test..." << std::endl;
+
+    PoolResource pool;
+    MonotonicResource monotonic;
+    UnsynchronizedPoolResource unsyncPool;
+    SynchronizedPoolResource syncPool;
+
+    checkResource(pool);
+    checkResource(monotonic);
+    checkResource(unsyncPool);
+    checkResource(syncPool);
+
+    // 所有PoolResource共享同一个内存池
+    PoolResource other;
+    assert(pool == other);
+    assert(*poolResource() == pool);
+    assert(!(unsyncPool == syncPool));
+
+    // 各种资源上的容器
+    std::pmr::memory_resource *resources[] = {&pool, &monotonic, &unsyncPool, &syncPool};
+    for (std::pmr::memory_resource *resource : resources)
+    {
+        std::pmr::vector<int> vec(resource);
+        std::pmr::unordered_map<int, std::pmr::string> map(resource);
+        for (int i = 0; i < 10000; ++i)
+        {
+            vec.push_back(i);
+            map.emplace(i, std::pmr::string(static_cast<size_t>(i % 100), 'a' + i % 26, resource));
+        }
+        for (int i = 0; i < 10000; ++i)
+        {
+            assert(vec[i] == i);
+            assert(map[i].size() == static_cast<size_t>(i % 100));
+        }
+    }
+
+    // 池资源释放的内存块会被同一档的请求复用，release()之后可以继续使用
+    void *a = unsyncPool.allocate(48);
+    unsyncPool.deallocate(a, 48);
+    assert(unsyncPool.allocate(40) == a);
+    void *large = unsyncPool.allocate(1 << 20); // 交给上游分配，由release()归还
+    assert(large != nullptr);
+    unsyncPool.release();
+    assert(unsyncPool.allocate(64) != nullptr);
+    assert(unsyncPool.options().largest_required_pool_block == UnsynchronizedPoolResource::MAX_POOL_BLOCK);
+
+    // 同步版本可以被多个线程共享
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&syncPool, t]()
+                             {
+            std::pmr::vector<std::pmr::string> strings(&syncPool);
+            for (int i = 0; i < 2000; ++i)
+            {
+                strings.emplace_back(static_cast<size_t>(20 + i % 50), 'a' + t);
+            }
+            for (const auto &str : strings)
+            {
+                assert(str[0] == 'a' + t);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::cout << "Pmr resource test passed!" << std::endl;
+}
+
+// 独立堆测试
+void testHeap()
+{
+    std::cout << "Running heap test..." << std::endl;
+
+    Heap *a = Heap::create();
+    Heap *b = Heap::create();
+    auto ownerOf = [](void *ptr)
+    {
+        return &PageMap::getInstance().get(ptr)->owner->heap();
+    };
+
+    // 各个堆的内存互相独立，不带大小的释放可以找回大小
+    std::vector<char *> blocksA;
+    std::vector<char *> blocksB;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        size_t size = 8 + i % 500;
+        char *pa = static_cast<char *>(a->allocate(size));
+        char *pb = static_cast<char *>(b->allocate(size));
+        assert(pa != nullptr && pb != nullptr);
+        assert(ownerOf(pa) == a && ownerOf(pb) == b);
+        memset(pa, 'a', size);
+        memset(pb, 'b', size);
+        blocksA.push_back(pa);
+        blocksB.push_back(pb);
+    }
+    for (size_t i = 0; i < blocksA.size(); ++i)
+    {
+        assert(blocksA[i][0] == 'a' && blocksB[i][0] == 'b');
+        a->deallocate(blocksA[i]);
+        b->deallocate(blocksB[i], 8 + i % 500);
+    }
+
+    // 大对象也来自所属的堆，超过一个内存块的大对象释放后直接归还系统
+    if constexpr (!HARDENED)
+    {
+        char *medium = static_cast<char *>(a->allocate(MAX_BYTES * 2));
+        char *huge = static_cast<char *>(a->allocate(8 * 1024 * 1024));
+        assert(medium != nullptr && huge != nullptr);
+        assert(ownerOf(medium) == a && ownerOf(huge) == a);
+        memset(huge, 1, 8 * 1024 * 1024);
+        a->deallocate(medium);
+        a->deallocate(huge);
+        assert(PageMap::getInstance().get(huge) == nullptr);
+    }
+
+    // 通过错误的堆释放时交给所属的堆
+    void *stray = b->allocate(64);
+    a->deallocate(stray);
+    assert(b->allocate(64) == stray);
+    b->deallocate(stray);
+
+    // 多个线程共享一个堆，线程退出时缓存的内存块还给堆
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([a, t]()
+                             {
+            std::vector<int *> values;
+            for (int i = 0; i < 2000; ++i)
+            {
+                int *value = static_cast<int *>(a->allocate(sizeof(int) * (1 + i % 16)));
+                *value = t * 10000 + i;
+                values.push_back(value);
+            }
+            for (int i = 0; i < 2000; ++i)
+            {
+                assert(*values[i] == t * 10000 + i);
+                a->deallocate(values[i]);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // 以堆为后端的Arena
+    {
+        Arena arena(*b);
+        void *ptr = arena.allocate(1000);
+        assert(ownerOf(ptr) == b);
+    }
+
+    // 销毁时归还堆的全部内存，未释放的内存一并失效
+    char *leaked = static_cast<char *>(a->allocate(128));
+    a->destroy();
+    assert(PageMap::getInstance().get(leaked) == nullptr);
+
+    // 新的堆复用编号，当前线程中旧的缓存不会被误用
+    Heap *c = Heap::create();
+    void *ptr = c->allocate(128);
+    assert(ptr != nullptr && ownerOf(ptr) == c);
+    c->deallocate(ptr);
+
+    b->destroy();
+    c->destroy();
+
+    // 默认堆不受影响
+    void *defaultPtr = MemoryPool::allocate(128);
+    assert(ownerOf(defaultPtr) == &Heap::defaultHeap());
+    MemoryPool::deallocate(defaultPtr, 128);
+
+    std::cout << "Heap test passed!" << std::endl;
+}
+
+// OOM处理函数被调用的次数
+static std::atomic<int> oomCalls{0};
+
+bool failingOomHandler(Heap &, size_t)
+{
+    ++oomCalls;
+    return false;
+}
+
+bool recoveringOomHandler(Heap &, size_t)
+{
+    ++oomCalls;
+    PageCache::injectMapFailures(0);
+    return true;
+}
+
+bool throwingOomHandler(Heap &, size_t)
+{
+    throw std::bad_alloc();
+}
+
+// 每个内存块映射到此前没有用过的1GB区域，PageMap必须为它创建新的叶子节点
+class FarPageSource : public MmapPageSource
+{
+public:
+    void *reserve(size_t size, size_t) override
+    {
+        static char *next = reinterpret_cast<char *>(uintptr_t(0x3f0000000000));
+        void *ptr = mmap(next, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+        next += size_t(1) << 30;
+        return ptr != MAP_FAILED ? ptr : nullptr;
+    }
+};
+
+// 内存上限与OOM处理测试
+void testMemoryLimits()
+{
+    std::cout << "Running memory limits test..." << std::endl;
+
+    const size_t CHUNK_BYTES = PageCache::CHUNK_PAGES * PageCache::PAGE_SIZE;
+
+    // 一次映射失败：释放缓存后重试成功
+    Heap *heap = Heap::create();
+    PageCache::injectMapFailures(1);
+    void *ptr = heap->allocate(64);
+    assert(ptr != nullptr);
+    heap->deallocate(ptr);
+    heap->destroy();
+
+    // 映射持续失败：没有处理函数时返回nullptr，处理函数返回false时同样失败
+    heap = Heap::create();
+    PageCache::injectMapFailures(1000);
+    assert(heap->allocate(64) == nullptr);
+    heap->setOomHandler(failingOomHandler);
+    oomCalls = 0;
+    assert(heap->allocate(64) == nullptr);
+    assert(oomCalls == 1);
+
+    // 处理函数解决问题后返回true，申请重试成功
+    heap->setOomHandler(recoveringOomHandler);
+    PageCache::injectMapFailures(1000);
+    oomCalls = 0;
+    ptr = heap->allocate(64);
+    assert(ptr != nullptr && oomCalls == 1);
+    heap->deallocate(ptr);
+    heap->destroy();
+
+    // 处理函数可以抛出std::bad_alloc
+    heap = Heap::create();
+    heap->setOomHandler(throwingOomHandler);
+    PageCache::injectMapFailures(1000);
+    bool thrown = false;
+    try
+    {
+        heap->allocate(64);
+    }
+    catch (const std::bad_alloc &)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    PageCache::injectMapFailures(0);
+    heap->destroy();
+
+    // 硬上限：映射量不超过上限，释放后可以继续分配
+    // 加固模式下的大对象不经过PageCache，这里只使用小对象
+    const size_t BLOCK_SIZE = MAX_BYTES / 2;
+    heap = Heap::create();
+    heap->setMemoryLimits(0, 2 * CHUNK_BYTES);
+    std::vector<void *> blocks;
+    while (void *block = heap->allocate(BLOCK_SIZE))
+    {
+        blocks.push_back(block);
+        assert(heap->mappedBytes() <= 2 * CHUNK_BYTES);
+    }
+    assert(!blocks.empty());
+    assert(heap->mappedBytes() <= 2 * CHUNK_BYTES);
+    heap->deallocate(blocks.back());
+    blocks.pop_back();
+    ptr = heap->allocate(BLOCK_SIZE);
+    assert(ptr != nullptr);
+    blocks.push_back(ptr);
+    for (void *block : blocks)
+    {
+        heap->deallocate(block);
+    }
+    heap->destroy();
+
+    // 软上限：线程退出后内存都在缓存中，再次映射超过软上限时整块空闲的内存块被归还
+    heap = Heap::create();
+    heap->setMemoryLimits(CHUNK_BYTES, 0);
+    std::thread([heap]()
+                {
+        std::vector<void *> ptrs;
+        for (size_t i = 0; i < 10000; ++i)
+        {
+            ptrs.push_back(heap->allocate(16 + i % 200));
+        }
+        for (void *p : ptrs)
+        {
+            heap->deallocate(p);
+        } })
+        .join();
+    assert(heap->mappedBytes() == CHUNK_BYTES);
+    if constexpr (!HARDENED)
+    {
+        const size_t HUGE_SIZE = 2 * CHUNK_BYTES;
+        void *huge = heap->allocate(HUGE_SIZE);
+        assert(huge != nullptr);
+        assert(heap->mappedBytes() == HUGE_SIZE);
+        heap->deallocate(huge);
+        assert(heap->mappedBytes() == 0);
+    }
+
+    // 主动释放：所有内存块归还后映射量回到0
+    std::thread([heap]()
+                {
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            heap->deallocate(heap->allocate(1000));
+        } })
+        .join();
+    assert(heap->mappedBytes() > 0);
+    heap->releaseMemory();
+    assert(heap->mappedBytes() == 0);
+    heap->destroy();
+
+    // 创建PageMap的叶子节点失败时映射的内存块被归还，分配失败而不是崩溃，恢复后正常分配
+    FarPageSource far;
+    heap = Heap::create(far);
+    PageMap::injectLeafFailures(1000);
+    assert(heap->allocate(64) == nullptr);
+    assert(heap->mappedBytes() == 0);
+    PageMap::injectLeafFailures(0);
+    ptr = heap->allocate(64);
+    assert(ptr != nullptr);
+    heap->deallocate(ptr);
+    if constexpr (!HARDENED)
+    {
+        // 专用映射之后的地址被占用，扩大时只能移动到新的区域；其叶子节点创建失败时原对象不变
+        const size_t HUGE_SIZE = 2 * CHUNK_BYTES;
+        char *huge = static_cast<char *>(heap->allocate(HUGE_SIZE));
+        assert(huge != nullptr);
+        huge[HUGE_SIZE - 1] = 7;
+        void *blocker = mmap(huge + HUGE_SIZE, PageCache::PAGE_SIZE, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        assert(blocker == huge + HUGE_SIZE);
+        size_t mapped = heap->mappedBytes();
+        PageMap::injectLeafFailures(1000);
+        assert(heap->reallocate(huge, HUGE_SIZE, 2 * HUGE_SIZE) == nullptr);
+        assert(heap->mappedBytes() == mapped);
+        assert(huge[HUGE_SIZE - 1] == 7);
+        assert(PageMap::getInstance().get(huge)->numPages == HUGE_SIZE / PageCache::PAGE_SIZE);
+        PageMap::injectLeafFailures(0);
+        char *moved = static_cast<char *>(heap->reallocate(huge, HUGE_SIZE, 2 * HUGE_SIZE));
+        assert(moved != nullptr && moved != huge && moved[HUGE_SIZE - 1] == 7);
+        assert(heap->mappedBytes() == mapped + HUGE_SIZE);
+        munmap(blocker, PageCache::PAGE_SIZE);
+        heap->deallocate(moved);
+    }
+    heap->destroy();
+
+    std::cout << "Memory limits test passed!" << std::endl;
+}
+
+// fork安全测试：其他线程持续分配时fork，子进程必须能立即分配，且已消失的线程缓存的内存被回收
+void testForkSafety()
+{
+    std::cout << "Running fork safety test..." << std::endl;
+
+    const int NUM_FORKS = 20;
+    Heap *shared = Heap::create();
+    Heap *parked = Heap::create();
+    std::atomic<bool> stop{false};
+    std::atomic<int> parkedReady{0};
+
+    // 持续分配释放的线程，fork时可能正持有任意一把锁
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            std::vector<std::pair<void *, size_t>> blocks;
+            size_t i = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                size_t size = 8 + (i * 97 + t * 13) % 4000;
+                void *ptr = (i % 2 == 0) ? MemoryPool::allocate(size) : shared->allocate(size);
+                assert(ptr != nullptr);
+                blocks.emplace_back(ptr, size);
+                if (blocks.size() >= 256)
+                {
+                    for (size_t j = 0; j < blocks.size(); ++j)
+                    {
+                        if (j % 2 == 0)
+                        {
+                            MemoryPool::deallocate(blocks[j].first, blocks[j].second);
+                        }
+                        else
+                        {
+                            shared->deallocate(blocks[j].first);
+                        }
+                    }
+                    blocks.clear();
+                }
+                ++i;
+            }
+            for (size_t j = 0; j < blocks.size(); ++j)
+            {
+                if (j % 2 == 0)
+                {
+                    MemoryPool::deallocate(blocks[j].first, blocks[j].second);
+                }
+                else
+                {
+                    shared->deallocate(blocks[j].first);
+                }
+            } });
+    }
+
+    // 释放后内存块留在自己的ThreadCache中，然后一直等待，这些线程在子进程中不存在
+    for (int t = 0; t < 2; ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            std::vector<void *> blocks;
+            for (size_t i = 0; i < 500; ++i)
+            {
+                blocks.push_back(parked->allocate(16 + i % 64));
+            }
+            for (void *ptr : blocks)
+            {
+                parked->deallocate(ptr);
+            }
+            ++parkedReady;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                std::this_thread::yield();
+            } });
+    }
+    while (parkedReady.load() < 2)
+    {
+        std::this_thread::yield();
+    }
+
+    for (int round = 0; round < NUM_FORKS; ++round)
+    {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            // 死锁时由SIGALRM终止
+            alarm(10);
+            for (size_t size = 8; size <= 64 * 1024; size *= 2)
+            {
+                char *a = static_cast<char *>(MemoryPool::allocate(size));
+                char *b = static_cast<char *>(shared->allocate(size));
+                if (a == nullptr || b == nullptr)
+                {
+                    _exit(2);
+                }
+                memset(a, 1, size);
+                memset(b, 2, size);
+                MemoryPool::deallocate(a, size);
+                shared->deallocate(b);
+            }
+
+            // 已消失的线程缓存的内存块被归还，整个堆可以全部还给系统
+            parked->releaseMemory();
+            _exit(parked->mappedBytes() == 0 ? 0 : 3);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        std::this_thread::yield();
+    }
+
+    stop = true;
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    shared->destroy();
+    parked->destroy();
+
+    std::cout << "Fork safety test passed!" << std::endl;
+}
+
+// 统计各操作的调用次数，并可以让之后的reserve/commit失败
+struct CountingPageSource : MmapPageSource
+{
+    std::atomic<size_t> reserves{0};
+    std::atomic<size_t> commits{0};
+    std::atomic<size_t> decommits{0};
+    std::atomic<size_t> releases{0};
+    std::atomic<size_t> reservedBytes{0};
+    std::atomic<size_t> failReserves{0};
+    std::atomic<size_t> failCommits{0};
+
+    static bool consume(std::atomic<size_t> &failures)
+    {
+        size_t remaining = failures.load();
+        while (remaining > 0 && !failures.compare_exchange_weak(remaining, remaining - 1))
+        {
+        }
+        return remaining > 0;
+    }
+
+    void *reserve(size_t size, size_t node) override
+    {
+        ++reserves;
+        if (consume(failReserves))
+        {
+            return nullptr;
+        }
+        void *ptr = MmapPageSource::reserve(size, node);
+        reservedBytes += size;
+        return ptr;
+    }
+
+    bool commit(void *addr, size_t size) override
+    {
+        ++commits;
+        return !consume(failCommits);
+    }
+
+    void decommit(void *addr, size_t size) override
+    {
+        ++decommits;
+        MmapPageSource::decommit(addr, size);
+    }
+
+    void release(void *addr, size_t size) override
+    {
+        ++releases;
+        reservedBytes -= size;
+        MmapPageSource::release(addr, size);
+    }
+};
+
+void testPageSource()
+{
+    std::cout << "Running page source test..." << std::endl;
+
+    // 堆的所有内存块都来自指定的来源，销毁时全部归还
+    CountingPageSource counting;
+    Heap *heap = Heap::create(counting);
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        void *ptr = heap->allocate(16 + (i * 97) % 8000);
+        assert(ptr != nullptr);
+        blocks.push_back(ptr);
+    }
+    blocks.push_back(heap->allocate(4 * 1024 * 1024));
+    assert(counting.reserves > 0 && counting.commits == counting.reserves);
+    for (void *ptr : blocks)
+    {
+        heap->deallocate(ptr);
+    }
+    blocks.clear();
+    heap->releaseMemory();
+    assert(counting.decommits + counting.releases > 0);
+    heap->destroy();
+    assert(counting.reservedBytes == 0 && counting.releases == counting.reserves);
+
+    // 预留失败时释放缓存后重试；提交失败的内存块被归还，没有OOM处理函数时分配失败
+    heap = Heap::create(counting);
+    counting.failReserves = 1;
+    void *ptr = heap->allocate(64);
+    assert(ptr != nullptr && counting.failReserves == 0);
+    heap->deallocate(ptr);
+    heap->destroy();
+    heap = Heap::create(counting);
+    counting.failCommits = 2;
+    ptr = heap->allocate(64);
+    assert(ptr == nullptr && counting.failCommits == 0);
+    heap->destroy();
+    assert(counting.reservedBytes == 0);
+
+    // 固定缓冲区：所有内存都在缓冲区内，用完后分配失败，销毁后缓冲区完整归还
+    const size_t BUFFER_SIZE = 32 * 1024 * 1024;
+    std::vector<char> buffer(BUFFER_SIZE);
+    FixedBufferPageSource fixed(buffer.data(), BUFFER_SIZE);
+    size_t available = fixed.available();
+    assert(available >= BUFFER_SIZE - PageCache::PAGE_SIZE);
+    heap = Heap::create(fixed);
+    while (void *p = heap->allocate(16 * 1024))
+    {
+        assert(static_cast<char *>(p) >= buffer.data() && static_cast<char *>(p) < buffer.data() + BUFFER_SIZE);
+        blocks.push_back(p);
+    }
+    assert(!blocks.empty() && fixed.available() < PageCache::CHUNK_PAGES * PageCache::PAGE_SIZE);
+    for (void *p : blocks)
+    {
+        heap->deallocate(p);
+    }
+    blocks.clear();
+    heap->destroy();
+    assert(fixed.available() == available);
+
+    // 以文件为后端
+    FilePageSource file("/tmp");
+    assert(file.valid() && file.granularity() >= PageCache::PAGE_SIZE);
+    heap = Heap::create(file);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        size_t size = (i % 100 == 0) ? 2 * 1024 * 1024 : 16 + (i * 37) % 4000;
+        char *p = static_cast<char *>(heap->allocate(size));
+        assert(p != nullptr);
+        memset(p, static_cast<int>(i), size);
+        blocks.push_back(p);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        assert(static_cast<char *>(blocks[i])[0] == static_cast<char>(i));
+        heap->deallocate(blocks[i]);
+    }
+    blocks.clear();
+    heap->releaseMemory();
+    heap->destroy();
+
+    // 大页：系统没有挂载hugetlbfs或没有预留大页时跳过
+    HugePageSource huge;
+    if (huge.valid())
+    {
+        heap = Heap::create(huge);
+        if (void *p = heap->allocate(64))
+        {
+            memset(p, 1, 64);
+            heap->deallocate(p);
+        }
+        heap->destroy();
+    }
+    else
+    {
+        std::cout << "hugetlbfs not available, skipping huge page source" << std::endl;
+    }
+
+    std::cout << "Page source test passed!" << std::endl;
+}
+
+// 共享内存段中的单生产者单消费者环形队列，传递内存块的段内偏移
+struct SharedRing
+{
+    static constexpr size_t SIZE = 256;
+    std::atomic<uint64_t> head{0}; // 消费者位置
+    std::atomic<uint64_t> tail{0}; // 生产者位置
+    uint64_t slots[SIZE];
+
+    void push(uint64_t offset)
+    {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (pos - head.load(std::memory_order_acquire) == SIZE)
+        {
+            std::this_thread::yield();
+        }
+        slots[pos % SIZE] = offset;
+        tail.store(pos + 1, std::memory_order_release);
+    }
+
+    uint64_t pop()
+    {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (tail.load(std::memory_order_acquire) == pos)
+        {
+            std::this_thread::yield();
+        }
+        uint64_t offset = slots[pos % SIZE];
+        head.store(pos + 1, std::memory_order_release);
+        return offset;
+    }
+};
+
+void testSharedPool()
+{
+    std::cout << "Running shared pool test..." << std::endl;
+
+    // 各大小类的分配、对齐与复用
+    SharedPool *pool = SharedPool::create(16 * 1024 * 1024);
+    assert(pool != nullptr);
+    assert(pool->freeBytes() == pool->capacity());
+    std::vector<std::pair<char *, size_t>> blocks;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        size_t size = 1 + (i * 131) % (i % 10 == 0 ? SharedPool::MAX_SMALL : 1024);
+        char *ptr = static_cast<char *>(pool->allocate(size));
+        assert(ptr != nullptr);
+        assert(reinterpret_cast<uintptr_t>(ptr) % 16 == 0);
+        memset(ptr, static_cast<int>(i & 0xff), size);
+        blocks.emplace_back(ptr, size);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        assert(blocks[i].first[0] == static_cast<char>(i & 0xff));
+        assert(blocks[i].first[blocks[i].second - 1] == static_cast<char>(i & 0xff));
+    }
+    std::mt19937 rng(7);
+    std::shuffle(blocks.begin(), blocks.end(), rng);
+    for (auto &[ptr, size] : blocks)
+    {
+        pool->deallocate(ptr);
+    }
+    void *first = pool->allocate(100);
+    pool->deallocate(first);
+    assert(pool->allocate(100) == first);
+    pool->deallocate(first);
+    pool->detach();
+
+    // 大对象按页分配，释放后相邻空闲页合并，段满时返回nullptr
+    pool = SharedPool::create(4 * 1024 * 1024);
+    assert(pool != nullptr);
+    std::vector<void *> large;
+    while (void *ptr = pool->allocate(SharedPool::MAX_SMALL + 1 + large.size() * 4096))
+    {
+        large.push_back(ptr);
+    }
+    assert(!large.empty() && pool->allocate(pool->capacity()) == nullptr);
+    std::shuffle(large.begin(), large.end(), rng);
+    for (void *ptr : large)
+    {
+        pool->deallocate(ptr);
+    }
+    assert(pool->freeBytes() == pool->capacity());
+    void *whole = pool->allocate(pool->capacity());
+    assert(whole != nullptr);
+    pool->deallocate(whole);
+
+    // 同一个段的另一个映射：地址不同，偏移相同，可以释放对方分配的内存块
+    SharedPool *other = SharedPool::attach(pool->fd());
+    assert(other != nullptr);
+    char *message = static_cast<char *>(pool->allocate(64));
+    strcpy(message, "hello");
+    pool->setRoot(message);
+    char *seen = static_cast<char *>(other->root());
+    assert(seen != message && strcmp(seen, "hello") == 0);
+    assert(other->offsetOf(seen) == pool->offsetOf(message));
+    other->deallocate(seen);
+    assert(pool->allocate(64) == message);
+    pool->deallocate(message);
+    other->detach();
+    pool->detach();
+
+    // 不是本内存池创建的段不能映射
+    int empty = memfd_create("empty", MFD_CLOEXEC);
+    int truncated = ftruncate(empty, 1 << 20);
+    assert(truncated == 0 && SharedPool::attach(empty) == nullptr);
+    close(empty);
+
+    // 命名段
+    std::string name = "/MyMemoryPool.test." + std::to_string(getpid());
+    pool = SharedPool::create(name.c_str(), 1024 * 1024);
+    assert(pool != nullptr);
+    assert(SharedPool::create(name.c_str(), 1024 * 1024) == nullptr);
+    other = SharedPool::open(name.c_str());
+    assert(other != nullptr);
+    bool unlinked = SharedPool::unlink(name.c_str());
+    assert(unlinked);
+    pool->setRoot(pool->allocate(32));
+    other->deallocate(other->root());
+    other->detach();
+    pool->detach();
+
+    // 两个进程同时分配释放，子进程分配的消息由父进程释放
+    const size_t NUM_MESSAGES = 20000;
+    pool = SharedPool::create(64 * 1024 * 1024);
+    assert(pool != nullptr);
+    auto *ring = new (pool->allocate(sizeof(SharedRing))) SharedRing();
+    pool->setRoot(ring);
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        alarm(20);
+        // 重新映射，地址与父进程不同
+        SharedPool *child = SharedPool::attach(pool->fd());
+        auto *childRing = static_cast<SharedRing *>(child->root());
+        for (size_t i = 0; i < NUM_MESSAGES; ++i)
+        {
+            size_t size = 16 + (i * 37) % 2000;
+            auto *msg = static_cast<uint32_t *>(child->allocate(size));
+            void *scratch = child->allocate(size);
+            if (msg == nullptr || scratch == nullptr)
+            {
+                _exit(2);
+            }
+            msg[0] = static_cast<uint32_t>(i);
+            msg[1] = static_cast<uint32_t>(size);
+            child->deallocate(scratch);
+            childRing->push(child->offsetOf(msg));
+        }
+        _exit(0);
+    }
+    for (size_t i = 0; i < NUM_MESSAGES; ++i)
+    {
+        auto *msg = static_cast<uint32_t *>(pool->pointerAt(ring->pop()));
+        assert(msg[0] == i && msg[1] == 16 + (i * 37) % 2000);
+        void *scratch = pool->allocate(msg[1]);
+        assert(scratch != nullptr);
+        pool->deallocate(scratch);
+        pool->deallocate(msg);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    pool->deallocate(ring);
+    pool->detach();
+
+    std::cout << "Shared pool test passed!" << std::endl;
+}
+
+void testBackgroundRefill()
+{
+    std::cout << "Running background refill test..." << std::endl;
+
+    const size_t SIZE = 64;
+    // 加固模式下内存块之后还有金丝雀
+    const size_t INDEX = SizeClass::getIndex(ThreadCache::blockSizeFor(SIZE));
+    Heap *heap = Heap::create();
+    assert(!heap->backgroundRefill());
+    heap->startRefillWorker(std::chrono::microseconds(100));
+    assert(heap->backgroundRefill());
+
+    // 分批分配，批次之间留出时间让补充线程准备新的span
+    std::vector<void *> blocks;
+    for (size_t burst = 0; burst < 40; ++burst)
+    {
+        for (size_t i = 0; i < 200; ++i)
+        {
+            void *ptr = heap->allocate(SIZE);
+            assert(ptr != nullptr);
+            memset(ptr, 0x5a, SIZE);
+            blocks.push_back(ptr);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    uint64_t refills = 0;
+    uint64_t misses = 0;
+    for (size_t node = 0; node < NumaTopology::getInstance().nodeCount(); ++node)
+    {
+        CentralCache::ClassStats stats = heap->centralCache(node).classStats(INDEX);
+        refills += stats.refills;
+        misses += stats.misses;
+    }
+    assert(refills > 0);
+    // 补充线程接手了绝大部分span申请
+    assert(misses < refills);
+
+    // 补充的span内容没有被改变，释放后可以全部交还
+    for (void *ptr : blocks)
+    {
+        assert(static_cast<unsigned char *>(ptr)[SIZE - 1] == 0x5a);
+        heap->deallocate(ptr, SIZE);
+    }
+    blocks.clear();
+    heap->stopRefillWorker();
+    assert(!heap->backgroundRefill());
+    heap->releaseMemory();
+
+    // fork后子进程中没有补充线程
+    heap->startRefillWorker();
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        void *ptr = heap->allocate(SIZE);
+        heap->deallocate(ptr, SIZE);
+        _exit(heap->backgroundRefill() ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // 销毁时自动停止补充线程
+    heap->destroy();
+
+    std::cout << "Background refill test passed!" << std::endl;
+}
+
+// 堆在所有节点上某个大小类的统计之和
+static CentralCache::ClassStats totalClassStats(Heap &heap, size_t size)
+{
+    size_t blockSize = ThreadCache::blockSizeFor(size);
+    CentralCache::ClassStats total{};
+    for (size_t node = 0; node < NumaTopology::getInstance().nodeCount(); ++node)
+    {
+        CentralCache::ClassStats stats = heap.centralCache(node).classStats(SizeClass::getIndex(blockSize));
+        total.fetches += stats.fetches;
+        total.freeBlocks += stats.freeBlocks;
+        total.inUse += stats.inUse;
+        total.peakInUse += stats.peakInUse;
+    }
+    return total;
+}
+
+void testWarmup()
+{
+    std::cout << "Running warmup test..." << std::endl;
+
+    // 预留的内存块在中心缓存中可以立即分出
+    Heap *heap = Heap::create();
+    assert(heap->reserve(128, 1000));
+    assert(totalClassStats(*heap, 128).freeBlocks >= 1000);
+    assert(heap->mappedBytes() > 0);
+    assert(!heap->reserve(MAX_BYTES + 1, 1));
+
+    // 同时填充线程缓存，之后的分配不再访问中心缓存
+    assert(heap->reserve(256, 32, true));
+    uint64_t fetches = totalClassStats(*heap, 256).fetches;
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 32; ++i)
+    {
+        blocks.push_back(heap->allocate(256));
+        assert(blocks.back() != nullptr);
+    }
+    assert(totalClassStats(*heap, 256).fetches == fetches);
+    for (void *ptr : blocks)
+    {
+        heap->deallocate(ptr, 256);
+    }
+    blocks.clear();
+
+    // 配置记录各大小类同时使用的最大数量
+    for (size_t i = 0; i < 500; ++i)
+    {
+        blocks.push_back(heap->allocate(64));
+    }
+    for (size_t i = 0; i < 300; ++i)
+    {
+        blocks.push_back(heap->allocate(1000));
+    }
+    for (void *ptr : blocks)
+    {
+        heap->deallocate(ptr);
+    }
+    blocks.clear();
+    WarmupProfile profile = heap->captureProfile();
+    auto countOf = [&profile](size_t size)
+    {
+        size_t blockSize = SizeClass::roundUp(ThreadCache::blockSizeFor(size));
+        for (const WarmupProfile::Entry &entry : profile.entries)
+        {
+            if (entry.blockSize == blockSize)
+            {
+                return entry.count;
+            }
+        }
+        return size_t(0);
+    };
+    assert(countOf(64) >= 500 && countOf(1000) >= 300 && countOf(256) >= 32);
+    heap->destroy();
+
+    // 保存后加载得到相同的配置，用它预热新的堆
+    std::string path = "/tmp/MyMemoryPool.warmup." + std::to_string(getpid());
+    assert(profile.save(path));
+    WarmupProfile loaded = WarmupProfile::load(path);
+    assert(loaded.entries.size() == profile.entries.size());
+    for (size_t i = 0; i < loaded.entries.size(); ++i)
+    {
+        assert(loaded.entries[i].blockSize == profile.entries[i].blockSize);
+        assert(loaded.entries[i].count == profile.entries[i].count);
+    }
+    heap = Heap::create();
+    assert(heap->warmup(loaded));
+    assert(totalClassStats(*heap, 64).freeBlocks >= countOf(64));
+    assert(totalClassStats(*heap, 1000).freeBlocks >= countOf(1000));
+    heap->destroy();
+
+    // 格式错误的文件得到空配置
+    {
+        std::ofstream file(path);
+        file << "64 abc\n";
+    }
+    assert(WarmupProfile::load(path).entries.empty());
+    assert(WarmupProfile::load(path + ".missing").entries.empty());
+    unlink(path.c_str());
+
+    // 默认堆的静态接口
+    assert(MemoryPool::reserve(48, 100, true));
+    void *ptr = MemoryPool::allocate(48);
+    assert(ptr != nullptr);
+    MemoryPool::deallocate(ptr, 48);
+
+    std::cout << "Warmup test passed!" << std::endl;
+}
+
+void testRealtimePool()
+{
+    std::cout << "Running real-time pool test..." << std::endl;
+
+    assert(RealtimePool::create(WarmupProfile{}) == nullptr);
+
+    WarmupProfile capacity;
+    capacity.entries = {{32, 1000}, {100, 10}, {4096, 5}, {30, 24}};
+    RealtimePool *pool = RealtimePool::create(capacity);
+    assert(pool != nullptr);
+    // 30向上取整为32，与32合并
+    assert(pool->numClasses() == 3);
+    assert(pool->classBlockSize(0) == 32 && pool->classCapacity(0) == 1024);
+    assert(pool->classBlockSize(1) == 104 && pool->maxBlockSize() == 4096);
+
+    // 用完后确定地返回nullptr，不借用其他大小类
+    std::set<void *> blocks;
+    for (size_t i = 0; i < 1024; ++i)
+    {
+        void *ptr = pool->allocate(1 + i % 32);
+        assert(ptr != nullptr && pool->contains(ptr));
+        assert(reinterpret_cast<uintptr_t>(ptr) % ALIGNMENT == 0);
+        memset(ptr, 0x33, 32);
+        assert(blocks.insert(ptr).second);
+    }
+    assert(pool->allocate(32) == nullptr);
+    assert(pool->allocate(20) == nullptr);
+    assert(pool->allocate(4097) == nullptr);
+    void *big = pool->allocate(4000);
+    assert(big != nullptr);
+    memset(big, 0x44, 4096);
+    for (void *ptr : blocks)
+    {
+        assert(static_cast<unsigned char *>(ptr)[31] == 0x33);
+        pool->deallocate(ptr);
+    }
+    pool->deallocate(big);
+    pool->deallocate(nullptr);
+    blocks.clear();
+    for (size_t i = 0; i < 1024; ++i)
+    {
+        assert(pool->allocate(24) != nullptr);
+    }
+    pool->destroy();
+
+    // 多线程同时分配和释放，每个内存块同一时刻只属于一个线程
+    const size_t NUM_THREADS = 8;
+    const size_t LIVE = 64;
+    capacity.entries = {{64, NUM_THREADS * LIVE}, {512, NUM_THREADS * LIVE}};
+    pool = RealtimePool::create(capacity);
+    assert(pool != nullptr);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < NUM_THREADS; ++t)
+    {
+        threads.emplace_back([pool, t]()
+                             {
+            std::vector<std::pair<unsigned char *, size_t>> live;
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (size_t i = 0; i < 20000; ++i)
+            {
+                if (live.size() == LIVE || (!live.empty() && rng() % 2 == 0))
+                {
+                    size_t pick = rng() % live.size();
+                    auto [ptr, size] = live[pick];
+                    assert(ptr[0] == static_cast<unsigned char>(t) && ptr[size - 1] == static_cast<unsigned char>(t));
+                    pool->deallocate(ptr);
+                    live[pick] = live.back();
+                    live.pop_back();
+                    continue;
+                }
+                size_t size = rng() % 2 == 0 ? 64 : 512;
+                unsigned char *ptr = static_cast<unsigned char *>(pool->allocate(size));
+                assert(ptr != nullptr);
+                memset(ptr, static_cast<int>(t), size);
+                live.emplace_back(ptr, size);
+            }
+            for (auto [ptr, size] : live)
+            {
+                pool->deallocate(ptr);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // 创建之后的分配和释放不进行任何系统调用：子进程进入seccomp严格模式，之后除read/write/exit外的系统调用都会被SIGKILL终止
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_STRICT) != 0)
+        {
+            syscall(SYS_exit, 2);
+        }
+        bool ok = true;
+        void *ptrs[2 * NUM_THREADS * LIVE];
+        for (int round = 0; round < 100; ++round)
+        {
+            for (size_t i = 0; i < 2 * NUM_THREADS * LIVE; ++i)
+            {
+                ptrs[i] = pool->allocate(i % 2 == 0 ? 1 : 300);
+                ok &= ptrs[i] != nullptr;
+            }
+            // 用完时同样不进入内核
+            ok &= pool->allocate(64) == nullptr && pool->allocate(512) == nullptr;
+            for (size_t i = 0; i < 2 * NUM_THREADS * LIVE; ++i)
+            {
+                pool->deallocate(ptrs[i]);
+            }
+        }
+        syscall(SYS_exit, ok ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    pool->destroy();
+
+    std::cout << "Real-time pool test passed!" << std::endl;
+}
+
+void testEpochReclamation()
+{
+    std::cout << "Running epoch reclamation test..." << std::endl;
+
+    // 其他线程停留在临界区时，之后retire的内存块不会被释放
+    std::atomic<int> readerState{0};
+    std::thread reader([&readerState]()
+                       {
+        EpochGuard guard;
+        readerState = 1;
+        while (readerState != 2)
+        {
+            std::this_thread::yield();
+        } });
+    while (readerState != 1)
+    {
+        std::this_thread::yield();
+    }
+    void *ptr = MemoryPool::allocate(64);
+    MemoryPool::retire(ptr, 64);
+    assert(Epoch::pending() == 1);
+    for (int i = 0; i < 10; ++i)
+    {
+        Epoch::tryReclaim();
+    }
+    assert(Epoch::pending() == 1);
+    readerState = 2;
+    reader.join();
+    Epoch::drain();
+    assert(Epoch::pending() == 0);
+
+    // 嵌套的临界区，自己的临界区不阻止释放更早的内存块
+    {
+        EpochGuard outer;
+        {
+            EpochGuard inner;
+        }
+        MemoryPool::retire(MemoryPool::allocate(32), 32);
+    }
+    Epoch::drain();
+
+    // 无锁栈：pop读取next时节点可能已被其他线程摘除，retire保证它不会在读取期间被释放或复用
+    struct Node
+    {
+        Node *next;
+        uint64_t magic;
+        uint64_t value;
+    };
+    constexpr uint64_t LIVE = 0x11111111;
+    constexpr uint64_t RETIRED = 0x22222222;
+    std::atomic<Node *> head{nullptr};
+    std::atomic<uint64_t> pushedSum{0};
+    std::atomic<uint64_t> poppedSum{0};
+    std::atomic<bool> corrupted{false};
+
+    const size_t NUM_THREADS = 8;
+    const size_t OPS = 20000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < NUM_THREADS; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            for (size_t i = 0; i < OPS; ++i)
+            {
+                Node *node = static_cast<Node *>(MemoryPool::allocate(sizeof(Node)));
+                node->magic = LIVE;
+                node->value = t * OPS + i + 1;
+                pushedSum += node->value;
+                node->next = head.load(std::memory_order_relaxed);
+                while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                {
+                }
+
+                EpochGuard guard;
+                Node *top = head.load(std::memory_order_acquire);
+                while (top != nullptr)
+                {
+                    if (top->magic != LIVE && top->magic != RETIRED)
+                    {
+                        corrupted = true;
+                    }
+                    if (head.compare_exchange_weak(top, top->next, std::memory_order_acquire, std::memory_order_acquire))
+                    {
+                        break;
+                    }
+                }
+                if (top != nullptr)
+                {
+                    poppedSum += top->value;
+                    top->magic = RETIRED;
+                    MemoryPool::retire(top, sizeof(Node));
+                }
+            }
+            Epoch::drain(); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    assert(!corrupted);
+    for (Node *node = head.load(); node != nullptr;)
+    {
+        Node *next = node->next;
+        poppedSum += node->value;
+        MemoryPool::deallocate(node, sizeof(Node));
+        node = next;
+    }
+    assert(pushedSum == poppedSum);
+
+    // 退出的线程遗留的内存块由之后回收的线程释放；fork后子进程中不存在的线程不阻止纪元推进
+    std::thread([]()
+                { MemoryPool::retire(MemoryPool::allocate(128), 128); })
+        .join();
+    readerState = 0;
+    reader = std::thread([&readerState]()
+                         {
+        EpochGuard guard;
+        readerState = 1;
+        while (readerState != 2)
+        {
+            std::this_thread::yield();
+        } });
+    while (readerState != 1)
+    {
+        std::this_thread::yield();
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        MemoryPool::retire(MemoryPool::allocate(64), 64);
+        Epoch::drain();
+        _exit(Epoch::pending() == 0 ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    readerState = 2;
+    reader.join();
+
+    std::cout << "Epoch reclamation test passed!" << std::endl;
+}
+
+void testHeapWalk()
+{
+    std::cout << "Running heap walk test..." << std::endl;
+
+    Heap *heap = Heap::create();
+    size_t blockSize = SizeClass::roundUp(ThreadCache::blockSizeFor(48));
+    std::vector<void *> live;
+    std::vector<void *> freed;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        (i % 2 == 0 ? live : freed).push_back(heap->allocate(48));
+    }
+    void *large = heap->allocate(MAX_BYTES + 1);
+    for (void *ptr : freed)
+    {
+        heap->deallocate(ptr, 48);
+    }
+
+    // 逐块遍历：仍在使用的块报告为Live，释放的块在ThreadCache或span中
+    std::unordered_map<void *, BlockState> states;
+    size_t cached = 0;
+    bool largeLive = false;
+    auto visit = [&](void *ptr, size_t size, BlockState state)
+    {
+        if (size == blockSize)
+        {
+            states[ptr] = state;
+            cached += state == BlockState::Cached;
+        }
+        if (ptr == large)
+        {
+            largeLive = state == BlockState::Live && size > MAX_BYTES;
+        }
+    };
+    heap->walk(visit);
+    for (void *ptr : live)
+    {
+        assert(states.at(ptr) == BlockState::Live);
+    }
+    for (void *ptr : freed)
+    {
+        assert(states.at(ptr) != BlockState::Live);
+    }
+    // 加固模式下的大对象不属于堆
+    assert(HARDENED || largeLive);
+
+    // 汇总只访问span，结果与逐块遍历一致
+    HeapSummary summary = heap->summarize();
+    auto usageOf = [&summary](size_t size)
+    {
+        for (const HeapSummary::SizeClassUsage &usage : summary.classes)
+        {
+            if (usage.blockSize == size)
+            {
+                return usage;
+            }
+        }
+        return HeapSummary::SizeClassUsage{size, 0, 0, 0};
+    };
+    HeapSummary::SizeClassUsage usage = usageOf(blockSize);
+    assert(usage.liveBlocks == live.size());
+    assert(usage.cachedBlocks == cached);
+    assert(usage.liveBlocks + usage.cachedBlocks + usage.freeBlocks == states.size());
+    assert(HARDENED || (summary.largeBlocks == 1 && summary.largeBytes > MAX_BYTES));
+
+    std::ostringstream report;
+    heap->reportLeaks(report);
+    assert(report.str().find("size " + std::to_string(blockSize) + ": 500 blocks") != std::string::npos);
+
+    for (void *ptr : live)
+    {
+        heap->deallocate(ptr, 48);
+    }
+    heap->deallocate(large);
+    assert(heap->summarize().liveBytes() == 0);
+    heap->destroy();
+
+    // 退出时的泄漏报告：子进程把标准错误重定向到文件，泄漏内存块后正常退出
+    std::string path = "/tmp/MyMemoryPool.leaks." + std::to_string(getpid());
+    size_t leakSize = SizeClass::roundUp(ThreadCache::blockSizeFor(4000));
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        FILE *file = freopen(path.c_str(), "w", stderr);
+        MemoryPool::enableLeakReport();
+        if (file == nullptr)
+        {
+            _exit(1);
+        }
+        for (size_t i = 0; i < 3; ++i)
+        {
+            MemoryPool::allocate(4000);
+        }
+        // 其他线程已停止，主线程缓存的块在报告中计为缓存，只有泄漏的块仍在使用
+        std::exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+    assert(text.find("still in use") != std::string::npos);
+    assert(text.find("size " + std::to_string(leakSize) + ":") != std::string::npos);
+
+    std::cout << "Heap walk test passed!" << std::endl;
+}
+
+// 析构时释放其中的内存块，再按churnTag分配并释放churn次；heap不为空时都使用该堆，否则按lifetime使用MemoryPool
+// 在线程中先于内存池访问时，它在内存池自己的线程局部变量之后析构
+struct ExitTimeBlocks
+{
+    std::vector<std::pair<void *, size_t>> blocks;
+    size_t churn = 0;
+    MemoryTag churnTag = 0;
+    Heap *heap = nullptr;
+    Lifetime lifetime = Lifetime::Short;
+
+    ~ExitTimeBlocks()
+    {
+        for (const auto &[ptr, size] : blocks)
+        {
+            if (heap != nullptr)
+            {
+                heap->deallocate(ptr, size);
+            }
+            else
+            {
+                MemoryPool::deallocate(ptr, size, lifetime);
+            }
+        }
+        for (size_t i = 0; i < churn; ++i)
+        {
+            if (heap != nullptr)
+            {
+                heap->deallocate(heap->allocate(64), 64);
+            }
+            else if (lifetime == Lifetime::Long)
+            {
+                MemoryPool::deallocate(MemoryPool::allocate(64, Lifetime::Long), 64, Lifetime::Long);
+            }
+            else
+            {
+                MemoryPool::deallocate(MemoryPool::allocate(64, churnTag), 64);
+            }
+        }
+    }
+};
+static thread_local ExitTimeBlocks exitTimeBlocks;
+
+void testMemoryTags()
+{
+    std::cout << "Running memory tag test..." << std::endl;
+
+    constexpr MemoryTag TENANT_A = 7;
+    constexpr MemoryTag TENANT_B = 8;
+    MemoryTags::Usage before = MemoryPool::tagUsage(TENANT_A);
+
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        blocks.push_back(MemoryPool::allocate(100, TENANT_A));
+    }
+    // 作用域内的分配计入当前标签，可以嵌套
+    void *large = nullptr;
+    void *small = nullptr;
+    {
+        MemoryTagScope scope(TENANT_B);
+        large = MemoryPool::allocate(2 * MAX_BYTES);
+        {
+            MemoryTagScope inner(TENANT_A);
+            small = MemoryPool::allocate(32);
+        }
+        assert(MemoryTags::current() == TENANT_B);
+    }
+    assert(MemoryTags::current() == 0);
+
+    MemoryTags::Usage a = MemoryPool::tagUsage(TENANT_A);
+    MemoryTags::Usage b = MemoryPool::tagUsage(TENANT_B);
+    if constexpr (TAGGED)
+    {
+        size_t bytes = 100 * SizeClass::roundUp(ThreadCache::blockSizeFor(100)) +
+                       SizeClass::roundUp(ThreadCache::blockSizeFor(32));
+        assert(a.liveBlocks - before.liveBlocks == 101);
+        assert(a.liveBytes - before.liveBytes == static_cast<int64_t>(bytes));
+        assert(a.allocations - before.allocations == 101);
+        assert(b.liveBlocks == 1 && b.liveBytes >= static_cast<int64_t>(2 * MAX_BYTES));
+    }
+    else
+    {
+        // 未开启标记模式时不计数
+        assert(a.allocations == 0 && b.allocations == 0);
+    }
+
+    // 在其他线程释放一半，仍计入分配时的标签；该线程退出后它的计数继续参与合并
+    std::thread worker([&blocks]()
+                       {
+        for (size_t i = 0; i < 50; ++i)
+        {
+            MemoryPool::deallocate(blocks[i], 100);
+        } });
+    worker.join();
+    // 另一半和大对象使用不带大小的释放
+    for (size_t i = 50; i < 100; ++i)
+    {
+        Heap::defaultHeap().deallocate(blocks[i]);
+    }
+    Heap::defaultHeap().deallocate(large);
+    MemoryPool::deallocate(small, 32);
+
+    a = MemoryPool::tagUsage(TENANT_A);
+    b = MemoryPool::tagUsage(TENANT_B);
+    assert(a.liveBlocks == before.liveBlocks && a.liveBytes == before.liveBytes);
+    assert(b.liveBlocks == 0 && b.liveBytes == 0);
+    if constexpr (TAGGED)
+    {
+        auto snapshot = MemoryTags::snapshot();
+        auto found = std::find_if(snapshot.begin(), snapshot.end(),
+                                  [](const auto &entry) { return entry.first == TENANT_B; });
+        assert(found != snapshot.end() && found->second.allocations == 1);
+    }
+
+    // 线程交还标签分片之后，更晚析构的线程局部变量释放带标签的内存块，同时有新线程启动并接手分片
+    // 这些释放计入共享分片，不会与新线程写入同一分片而丢失计数
+    constexpr MemoryTag TENANT_C = 9;
+    // 标记模式下交替足够多次，单核上也会在计数的读和写之间发生线程切换
+    constexpr size_t ROUNDS = 20;
+    constexpr size_t THREADS = 4;
+    constexpr size_t PER_THREAD = TAGGED ? 300000 : 1000;
+    MemoryTags::Usage beforeC = MemoryPool::tagUsage(TENANT_C);
+    for (size_t round = 0; round < ROUNDS; ++round)
+    {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < THREADS; ++t)
+        {
+            threads.emplace_back([]()
+                                 {
+                exitTimeBlocks.churn = PER_THREAD;
+                exitTimeBlocks.churnTag = TENANT_C;
+                for (size_t i = 0; i < 100; ++i)
+                {
+                    exitTimeBlocks.blocks.emplace_back(MemoryPool::allocate(64, TENANT_C), 64);
+                } });
+            threads.emplace_back([]()
+                                 {
+                for (size_t i = 0; i < PER_THREAD; ++i)
+                {
+                    MemoryPool::deallocate(MemoryPool::allocate(64, TENANT_C), 64);
+                } });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+    MemoryTags::Usage c = MemoryPool::tagUsage(TENANT_C);
+    assert(c.liveBlocks == beforeC.liveBlocks && c.liveBytes == beforeC.liveBytes);
+    if constexpr (TAGGED)
+    {
+        assert(c.allocations - beforeC.allocations == ROUNDS * THREADS * (2 * PER_THREAD + 100));
+    }
+
+    std::cout << "Memory tag test passed!" << std::endl;
+}
+
+void testLifetimeSegregation()
+{
+    std::cout << "Running lifetime segregation test..." << std::endl;
+
+    // 交替分配的长短寿命对象不会出现在同一个span中
+    std::vector<void *> shortBlocks;
+    std::vector<void *> longBlocks;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        shortBlocks.push_back(MemoryPool::allocate(200, Lifetime::Short));
+        longBlocks.push_back(MemoryPool::allocate(200, Lifetime::Long));
+        assert(shortBlocks.back() != nullptr && longBlocks.back() != nullptr);
+    }
+    std::set<Span *> shortSpans;
+    for (void *ptr : shortBlocks)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        assert(&span->owner->heap() == &Heap::defaultHeap());
+        shortSpans.insert(span);
+    }
+    for (void *ptr : longBlocks)
+    {
+        Span *span = PageMap::getInstance().get(ptr);
+        assert(&span->owner->heap() == &Heap::longLivedHeap());
+        assert(shortSpans.count(span) == 0);
+    }
+    assert(Heap::longLivedHeap().mappedBytes() > 0);
+
+    // 带大小的释放传入相同的lifetime，不带大小的释放由span确定所属的堆
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        MemoryPool::deallocate(shortBlocks[i], 200, Lifetime::Short);
+        if (i % 2 == 0)
+        {
+            MemoryPool::deallocate(longBlocks[i], 200, Lifetime::Long);
+        }
+        else
+        {
+            Heap::defaultHeap().deallocate(longBlocks[i]);
+        }
+    }
+
+    // 线程退出时在内存池的线程局部变量之后析构的对象仍可分配和释放长寿命对象，
+    // 这时长寿命堆的线程缓存已经释放，内存块直接还给中心缓存
+    const size_t COUNT = 200;
+    size_t inUse = totalClassStats(Heap::longLivedHeap(), 200).inUse;
+    size_t churnInUse = totalClassStats(Heap::longLivedHeap(), 64).inUse;
+    std::thread([]()
+                {
+        exitTimeBlocks.blocks.reserve(COUNT);
+        exitTimeBlocks.churn = 10;
+        exitTimeBlocks.lifetime = Lifetime::Long;
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            exitTimeBlocks.blocks.emplace_back(MemoryPool::allocate(200, Lifetime::Long), 200);
+        } })
+        .join();
+    assert(totalClassStats(Heap::longLivedHeap(), 200).inUse == inUse);
+    assert(totalClassStats(Heap::longLivedHeap(), 64).inUse == churnInUse);
+
+    std::cout << "Lifetime segregation test passed!" << std::endl;
+}
+
+void testThreadCacheAdoption()
+{
+    std::cout << "Running thread cache adoption test..." << std::endl;
+
+    // 释放之前测试停放的缓存，之后接管的对象是确定的
+    Heap::defaultHeap().releaseMemory();
+    const size_t SIZE = 1500;
+
+    // 退出的线程留下的缓存连同其中的内存块被下一个新线程接管，不再向中心缓存取块
+    ThreadCache *first = nullptr;
+    std::thread([&first]()
+                {
+        first = ThreadCache::getInstance();
+        std::vector<void *> blocks;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            blocks.push_back(MemoryPool::allocate(SIZE));
+        }
+        for (void *ptr : blocks)
+        {
+            MemoryPool::deallocate(ptr, SIZE);
+        } })
+        .join();
+    uint64_t fetches = totalClassStats(Heap::defaultHeap(), SIZE).fetches;
+    std::thread([&]()
+                {
+        assert(ThreadCache::getInstance() == first);
+        void *ptr = MemoryPool::allocate(SIZE);
+        assert(totalClassStats(Heap::defaultHeap(), SIZE).fetches == fetches);
+        MemoryPool::deallocate(ptr, SIZE); })
+        .join();
+
+    // 显式迁移：在一个线程上取下的缓存装到另一个线程上继续使用
+    ThreadCache *handle = nullptr;
+    std::thread([&handle]()
+                {
+        MemoryPool::deallocate(MemoryPool::allocate(SIZE), SIZE);
+        handle = MemoryPool::detachThreadCache();
+        assert(handle != nullptr);
+        // 取下后本线程的分配使用另一个缓存
+        MemoryPool::deallocate(MemoryPool::allocate(64), 64);
+        assert(ThreadCache::getInstance() != handle); })
+        .join();
+    std::thread([&]()
+                {
+        MemoryPool::attachThreadCache(handle);
+        assert(ThreadCache::getInstance() == handle);
+        uint64_t before = totalClassStats(Heap::defaultHeap(), SIZE).fetches;
+        void *ptr = MemoryPool::allocate(SIZE);
+        assert(totalClassStats(Heap::defaultHeap(), SIZE).fetches == before);
+        MemoryPool::deallocate(ptr, SIZE); })
+        .join();
+
+    // 线程退出时在内存池的线程局部变量之后析构的对象仍会分配和释放：
+    // 这时不再接管停放的缓存，也不创建新的缓存，内存块直接还给中心缓存
+    const size_t COUNT = 200;
+    const size_t CHURN_SIZE = 64;
+    size_t parked = 0;
+    CentralCache::ClassStats atExit{};
+    CentralCache::ClassStats churnAtExit{};
+    std::thread([&]()
+                {
+        // 先于内存池访问，在内存池的线程局部变量之后析构
+        exitTimeBlocks.blocks.reserve(COUNT);
+        exitTimeBlocks.churn = 10;
+        MemoryPool::deallocate(MemoryPool::allocate(CHURN_SIZE), CHURN_SIZE);
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            exitTimeBlocks.blocks.emplace_back(MemoryPool::allocate(SIZE), SIZE);
+        }
+        // 本线程的缓存在退出时停放
+        parked = ThreadCache::parkedCount() + 1;
+        atExit = totalClassStats(Heap::defaultHeap(), SIZE);
+        churnAtExit = totalClassStats(Heap::defaultHeap(), CHURN_SIZE); })
+        .join();
+    assert(ThreadCache::parkedCount() == parked);
+    assert(totalClassStats(Heap::defaultHeap(), SIZE).inUse == atExit.inUse - COUNT);
+    assert(totalClassStats(Heap::defaultHeap(), CHURN_SIZE).inUse == churnAtExit.inUse);
+
+    // 其他堆的线程缓存同样在线程退出时释放，之后析构的对象不能再使用它们
+    Heap *heap = Heap::create();
+    std::thread([&]()
+                {
+        exitTimeBlocks.blocks.reserve(COUNT);
+        exitTimeBlocks.churn = 10;
+        exitTimeBlocks.heap = heap;
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            exitTimeBlocks.blocks.emplace_back(heap->allocate(SIZE), SIZE);
+        } })
+        .join();
+    assert(totalClassStats(*heap, SIZE).inUse == 0);
+    assert(totalClassStats(*heap, CHURN_SIZE).inUse == 0);
+    heap->destroy();
+
+    // 停放的缓存在fork后的子进程中被回收，子进程仍可正常分配
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        std::thread([]()
+                    { MemoryPool::deallocate(MemoryPool::allocate(SIZE), SIZE); })
+            .join();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::cout << "Thread cache adoption test passed!" << std::endl;
+}
+
+void testReallocate()
+{
+    std::cout << "Running reallocate test..." << std::endl;
+
+    auto fill = [](void *ptr, size_t size, unsigned char seed)
+    {
+        for (size_t i = 0; i < size; i += 97)
+        {
+            static_cast<unsigned char *>(ptr)[i] = static_cast<unsigned char>(seed + i);
+        }
+    };
+    auto check = [](void *ptr, size_t size, unsigned char seed)
+    {
+        for (size_t i = 0; i < size; i += 97)
+        {
+            assert(static_cast<unsigned char *>(ptr)[i] == static_cast<unsigned char>(seed + i));
+        }
+    };
+
+    // 大小类不变时返回原指针；加固模式下金丝雀随之移动，按新的大小释放不报错
+    void *small = MemoryPool::reallocate(nullptr, 0, 97);
+    assert(small != nullptr);
+    fill(small, 97, 1);
+    assert(MemoryPool::reallocate(small, 97, 104) == small);
+    void *moved = MemoryPool::reallocate(small, 104, 2000);
+    assert(moved != nullptr && moved != small);
+    check(moved, 97, 1);
+    // 缩小到其他大小类时复制前newSize字节
+    small = MemoryPool::reallocate(moved, 2000, 50);
+    check(small, 50, 1);
+    assert(MemoryPool::reallocate(small, 50, 0) == nullptr);
+
+    // 大对象：独立的堆中布局确定，span之后是同一内存块中的空闲页
+    Heap *heap = Heap::create();
+    const size_t LARGE = 300 * 1024;
+    void *large = heap->allocate(LARGE);
+    fill(large, LARGE, 2);
+    void *grown = heap->reallocate(large, LARGE, 2 * LARGE);
+    void *shrunk = heap->reallocate(grown, 2 * LARGE, LARGE);
+    void *regrown = heap->reallocate(shrunk, LARGE, 3 * LARGE);
+    check(regrown, LARGE, 2);
+    if constexpr (!HARDENED)
+    {
+        // 原地扩大、缩小，缩小时释放的尾部页又被再次扩大接管
+        assert(grown == large && shrunk == large && regrown == large);
+        assert(PageMap::getInstance().get(static_cast<char *>(large) + 3 * LARGE - 1)->pageAddr == large);
+    }
+
+    // 之后的页被占用时只能复制
+    void *blocker = heap->allocate(LARGE);
+    fill(regrown, 3 * LARGE, 3);
+    void *copied = heap->reallocate(regrown, 3 * LARGE, 4 * LARGE);
+    assert(copied != nullptr);
+    check(copied, 3 * LARGE, 3);
+    if constexpr (!HARDENED)
+    {
+        assert(copied != regrown);
+        // 超过一个内存块的大对象使用专用映射，之后的扩大与缩小调整映射本身，已计入堆的映射字节数
+        void *huge = heap->reallocate(copied, 4 * LARGE, 8 << 20);
+        fill(huge, 8 << 20, 4);
+        size_t mapped = heap->mappedBytes();
+        huge = heap->reallocate(huge, 8 << 20, 32 << 20);
+        assert(huge != nullptr);
+        check(huge, 8 << 20, 4);
+        assert(heap->mappedBytes() == mapped + (24 << 20));
+        huge = heap->reallocate(huge, 32 << 20, 6 << 20);
+        check(huge, 6 << 20, 4);
+        assert(heap->mappedBytes() == mapped - (2 << 20));
+        copied = huge;
+    }
+    heap->deallocate(copied);
+    heap->deallocate(blocker, LARGE);
+    heap->destroy();
+
+    if constexpr (TAGGED)
+    {
+        // 无论原地调整还是复制，结果仍计入原来的标签
+        constexpr MemoryTag TAG = 50;
+        void *tagged = MemoryPool::allocate(100, TAG);
+        tagged = MemoryPool::reallocate(tagged, 100, 2 * LARGE);
+        tagged = MemoryPool::reallocate(tagged, 2 * LARGE, 3 * LARGE);
+        MemoryTags::Usage usage = MemoryPool::tagUsage(TAG);
+        assert(usage.allocations >= 2 && usage.liveBlocks == 1);
+        assert(usage.liveBytes == static_cast<int64_t>(3 * LARGE));
+        MemoryPool::deallocate(tagged, 3 * LARGE);
+        assert(MemoryPool::tagUsage(TAG).liveBytes == 0);
+    }
+
+    std::cout << "Reallocate test passed!" << std::endl;
+}
+
+void testCrossThreadFree()
+{
+    std::cout << "Running cross-thread free test..." << std::endl;
+
+    // 生产者分配、消费者释放：消费者从不向中心缓存取块，它的自由链表上限仍要增长，
+    // 之后成批归还，而不是每次释放都访问中心缓存
+    Heap *heap = Heap::create();
+    const size_t SIZE = 96;
+    const size_t COUNT = 2000;
+    std::vector<void *> blocks(COUNT);
+    std::thread([&]()
+                {
+        for (void *&ptr : blocks)
+        {
+            ptr = heap->allocate(SIZE);
+            assert(ptr != nullptr);
+        } })
+        .join();
+
+    size_t returns = 0;
+    std::thread([&]()
+                {
+        size_t inUse = totalClassStats(*heap, SIZE).inUse;
+        for (void *ptr : blocks)
+        {
+            heap->deallocate(ptr, SIZE);
+            size_t now = totalClassStats(*heap, SIZE).inUse;
+            returns += now != inUse;
+            inUse = now;
+        } })
+        .join();
+    // 其他节点的内存块总是直接送回所属节点
+    if (NumaTopology::getInstance().nodeCount() == 1)
+    {
+        assert(returns <= COUNT / THREAD_MAX_SIZE * 2);
+    }
+    assert(totalClassStats(*heap, SIZE).inUse == 0);
+    heap->destroy();
+
+    std::cout << "Cross-thread free test passed!" << std::endl;
+}
+
 int main()
 {
     try
@@ -193,6 +2449,27 @@ int main()
         testMultiThreading();
         testEdgeCases();
         testStress();
+        testSpanReuse();
+        testNumaPartitioning();
+        testConcurrentSizeClasses();
+        testHardening();
+        testArena();
+        testPoolResource();
+        testHeap();
+        testMemoryLimits();
+        testForkSafety();
+        testPageSource();
+        testSharedPool();
+        testBackgroundRefill();
+        testWarmup();
+        testRealtimePool();
+        testEpochReclamation();
+        testHeapWalk();
+        testMemoryTags();
+        testLifetimeSegregation();
+        testThreadCacheAdoption();
+        testReallocate();
+        testCrossThreadFree();
 
         std::cout << "All tests passed successfully!" << std::endl;
         return 0;